@@ -5,7 +5,7 @@
 
 # variables
 EXE="./src/dragonizer"
-LIBS="pthread tbb"
+LIBS="pthread tbb stl tiled"
 SERIAL="serial"
 PWR=28
 THREADS_MAX=8
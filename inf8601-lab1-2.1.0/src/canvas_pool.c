@@ -0,0 +1,194 @@
+/*
+ * canvas_pool.c
+ *
+ * Regions are mapped with mmap, aligned on CANVAS_ALIGN and advised with
+ * MADV_HUGEPAGE. A fresh region is never touched here, so that its pages
+ * are placed by the first touch of the threads of the caller:
+ *
+ *  - a canvas is cleared by the threads of every parallel backend before
+ *    the draw (the clear chunks of pthread, tbb, stl, onepass, async and
+ *    the curves, the owned tiles of tiled), each page lands on the node
+ *    of the thread that clears it. The draw itself cannot follow the
+ *    pages, a chunk of the curve writes all over the canvas;
+ *  - an image is first written by the parallel render, by bands of rows;
+ *  - the canvas of a snapshot is decoded by rows in parallel.
+ *
+ * Touching the pages here, from the thread of canvas_alloc(), would put
+ * them all on one node. A released region keeps its pages and their
+ * placement, and is reused by the next allocation that fits in it
+ * without wasting more than CANVAS_POOL_RATIO times the request. The free
+ * regions are trimmed on their total size, so a few huge canvases are not
+ * kept as long as many small ones.
+ *
+ *  Created on: 2026-10-19
+ *      Author: francis
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "canvas_pool.h"
+
+struct region {
+	void *addr;
+	size_t len;
+	/* bytes asked by the user of the region */
+	size_t size;
+	int used;
+	unsigned long last_use;
+};
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct region *regions = NULL;
+static int nb_regions = 0;
+static unsigned long pool_clock = 0;
+
+static void *region_map(size_t len)
+{
+	/* map one more huge page to align the start */
+	size_t span = len + CANVAS_ALIGN;
+	char *raw = mmap(NULL, span, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (raw == MAP_FAILED)
+		return NULL;
+
+	char *addr = (char *) (((uintptr_t) raw + CANVAS_ALIGN - 1) & ~((uintptr_t) CANVAS_ALIGN - 1));
+	if (addr > raw)
+		munmap(raw, addr - raw);
+	if (raw + span > addr + len)
+		munmap(addr + len, (raw + span) - (addr + len));
+#ifdef MADV_HUGEPAGE
+	madvise(addr, len, MADV_HUGEPAGE);
+#endif
+	return addr;
+}
+
+/* unmap the least recently used free regions above CANVAS_POOL_BYTES */
+static void pool_trim(void)
+{
+	size_t free_bytes = 0;
+	int i;
+
+	for (i = 0; i < nb_regions; i++) {
+		if (!regions[i].used)
+			free_bytes += regions[i].len;
+	}
+	while (free_bytes > CANVAS_POOL_BYTES) {
+		int lru = -1;
+		for (i = 0; i < nb_regions; i++) {
+			if (!regions[i].used && (lru < 0 || regions[i].last_use < regions[lru].last_use))
+				lru = i;
+		}
+		free_bytes -= regions[lru].len;
+		munmap(regions[lru].addr, regions[lru].len);
+		regions[lru] = regions[--nb_regions];
+	}
+}
+
+void *canvas_alloc(size_t size)
+{
+	struct region *r = NULL;
+	void *addr = NULL;
+	size_t len;
+	int i;
+
+	if (size == 0)
+		return NULL;
+	len = (size + CANVAS_ALIGN - 1) & ~((size_t) CANVAS_ALIGN - 1);
+
+	pthread_mutex_lock(&pool_lock);
+
+	/* smallest free region large enough, not too large for the request */
+	for (i = 0; i < nb_regions; i++) {
+		if (!regions[i].used && regions[i].len >= len &&
+				regions[i].len / CANVAS_POOL_RATIO <= len &&
+				(r == NULL || regions[i].len < r->len))
+			r = &regions[i];
+	}
+
+	if (r == NULL) {
+		struct region *tmp = realloc(regions, sizeof(struct region) * (nb_regions + 1));
+		if (tmp == NULL)
+			goto done;
+		regions = tmp;
+		if ((addr = region_map(len)) == NULL)
+			goto done;
+		r = &regions[nb_regions++];
+		r->addr = addr;
+		r->len = len;
+	}
+
+	r->used = 1;
+	r->size = size;
+	r->last_use = ++pool_clock;
+	addr = r->addr;
+
+done:
+	pthread_mutex_unlock(&pool_lock);
+	return addr;
+}
+
+void canvas_free(void *canvas)
+{
+	int i;
+
+	if (canvas == NULL)
+		return;
+
+	pthread_mutex_lock(&pool_lock);
+	for (i = 0; i < nb_regions; i++) {
+		if (regions[i].addr == canvas) {
+			regions[i].used = 0;
+			regions[i].last_use = ++pool_clock;
+			break;
+		}
+	}
+	if (i == nb_regions)
+		fprintf(stderr, "canvas_free: unknown canvas %p\n", canvas);
+	pool_trim();
+	pthread_mutex_unlock(&pool_lock);
+}
+
+/*
+ * bytes asked for an allocated canvas, 0 if unknown
+ */
+size_t canvas_size(void *canvas)
+{
+	size_t size = 0;
+	int i;
+
+	pthread_mutex_lock(&pool_lock);
+	for (i = 0; i < nb_regions; i++) {
+		if (regions[i].used && regions[i].addr == canvas) {
+			size = regions[i].size;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&pool_lock);
+	return size;
+}
+
+/* unmap all the free regions */
+void canvas_pool_clear(void)
+{
+	int i = 0;
+
+	pthread_mutex_lock(&pool_lock);
+	while (i < nb_regions) {
+		if (regions[i].used) {
+			i++;
+			continue;
+		}
+		munmap(regions[i].addr, regions[i].len);
+		regions[i] = regions[--nb_regions];
+	}
+	if (nb_regions == 0) {
+		free(regions);
+		regions = NULL;
+	}
+	pthread_mutex_unlock(&pool_lock);
+}
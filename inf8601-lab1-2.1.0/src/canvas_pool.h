@@ -0,0 +1,37 @@
+/*
+ * canvas_pool.h
+ *
+ * Allocator for the dragon canvas and the images. Regions are aligned on
+ * huge pages and kept after canvas_free() to be handed out again, so
+ * repeated draws do not pay the page faults again. The pages of a new
+ * region are not touched, the caller writes them first from the threads
+ * that use them.
+ *
+ *  Created on: 2026-10-19
+ *      Author: francis
+ */
+
+#ifndef CANVAS_POOL_H_
+#define CANVAS_POOL_H_
+
+#include <stddef.h>
+
+#define CANVAS_ALIGN	(2 * 1024 * 1024)
+/* bytes of the free regions kept for reuse */
+#define CANVAS_POOL_BYTES	((size_t) 1024 * 1024 * 1024)
+/* a free region is reused for a request at least 1 / ratio of its size */
+#define CANVAS_POOL_RATIO	2
+
+void *canvas_alloc(size_t size);
+void canvas_free(void *canvas);
+size_t canvas_size(void *canvas);
+void canvas_pool_clear(void);
+
+#define CANVAS_FREE(var) do {	\
+	if (var != NULL) {			\
+		canvas_free(var);		\
+		var = NULL;				\
+	}							\
+} while(0)
+
+#endif /* CANVAS_POOL_H_ */
@@ -0,0 +1,301 @@
+/*
+ * curve.h
+ *
+ * Curves made of unit steps on a lattice, where the turn after step n
+ * depends only on n. The Heighway dragon of dragon.c is the paperfolding
+ * sequence on the square lattice with diagonal steps. The lattice, the
+ * turn rule and the fold pattern are template parameters, so that each
+ * curve compiles to the same loop as dragon_draw_raw.
+ *
+ *  Created on: 2026-10-19
+ *      Author: francis
+ */
+
+#ifndef CURVE_H_
+#define CURVE_H_
+
+extern "C" {
+#include "dragon.h"
+}
+
+/* turns are counted in steps of the lattice rotation, positive to the left */
+#define TURN_LEFT	1
+#define TURN_RIGHT	-1
+
+/*
+ * Square lattice with diagonal steps, orientation 0 is (1, 1). Pixels are
+ * the middle of the steps, as in dragon_draw_raw.
+ */
+struct square_lattice {
+	enum { nb_dirs = 4 };
+
+	static inline xy_t dir(int o) {
+		static const int64_t dx[4] = { 1, -1, -1, 1 };
+		static const int64_t dy[4] = { 1, 1, -1, -1 };
+		xy_t d = { dx[o], dy[o] };
+		return d;
+	}
+	static inline int wrap(int o) { return o & 3; }
+	/* rotation of one step to the left, as rotate_left but inlined */
+	static inline void rotate(xy_t *v) {
+		int64_t x = v->x;
+		v->x = -v->y;
+		v->y = x;
+	}
+	static inline void rotate_back(xy_t *v) {
+		int64_t x = v->x;
+		v->x = v->y;
+		v->y = -x;
+	}
+	static inline int64_t raster_x(xy_t p) { return p.x; }
+	static inline int64_t raster_y(xy_t p) { return p.y; }
+
+	/* linear forms kept by walk_extent, see curve_extent */
+	enum { nb_bounds = 4 };
+	static inline void bounds(xy_t m, int64_t *f) {
+		f[0] = m.x;
+		f[1] = m.y;
+		f[2] = -m.x;
+		f[3] = -m.y;
+	}
+	/* form of the raster x and y of m rotated o times */
+	static inline int bound_x(int o) {
+		static const int k[4] = { 0, 3, 2, 1 };
+		return k[o];
+	}
+	static inline int bound_y(int o) {
+		static const int k[4] = { 1, 0, 3, 2 };
+		return k[o];
+	}
+};
+
+/*
+ * Triangular lattice in axial coordinates, one step of rotation is 60
+ * degrees. The raster uses doubled columns (x = 2q + r, y = r): a step is
+ * two pixels wide and one pixel high, so the image is flattened vertically
+ * by a factor sqrt(3).
+ */
+struct triangular_lattice {
+	enum { nb_dirs = 6 };
+
+	static inline xy_t dir(int o) {
+		static const int64_t dq[6] = { 1, 0, -1, -1, 0, 1 };
+		static const int64_t dr[6] = { 0, 1, 1, 0, -1, -1 };
+		xy_t d = { dq[o], dr[o] };
+		return d;
+	}
+	static inline int wrap(int o) {
+		if (o < 0)
+			return o + 6;
+		if (o >= 6)
+			return o - 6;
+		return o;
+	}
+	static inline void rotate(xy_t *v) {
+		int64_t q = v->x;
+		v->x = -v->y;
+		v->y = q + v->y;
+	}
+	static inline void rotate_back(xy_t *v) {
+		int64_t q = v->x;
+		v->x = q + v->y;
+		v->y = -q;
+	}
+	static inline int64_t raster_x(xy_t p) { return 2 * p.x + p.y; }
+	static inline int64_t raster_y(xy_t p) { return p.y; }
+
+	/* raster x then raster y of m rotated 0 to 5 times */
+	enum { nb_bounds = 12 };
+	static inline void bounds(xy_t m, int64_t *f) {
+		int64_t q = m.x, r = m.y;
+		f[0] = 2 * q + r;
+		f[1] = q - r;
+		f[2] = -q - 2 * r;
+		f[3] = -2 * q - r;
+		f[4] = r - q;
+		f[5] = q + 2 * r;
+		f[6] = r;
+		f[7] = q + r;
+		f[8] = q;
+		f[9] = -r;
+		f[10] = -q - r;
+		f[11] = -q;
+	}
+	static inline int bound_x(int o) { return o; }
+	static inline int bound_y(int o) { return 6 + o; }
+};
+
+/*
+ * Generalized paperfolding sequence. The turn after step n = 2^k * (2m+1)
+ * is given by the parity of m, flipped when bit k of Folds is set (the
+ * direction of the k-th fold). Folds = 0 is the Heighway dragon.
+ */
+template <uint64_t Folds>
+struct paperfold_turn {
+	static inline int turn(uint64_t n, __attribute__((unused)) uint64_t size) {
+		/* 2^k, tested as in dragon_draw_raw, without a shift by k */
+		uint64_t low = n & -n;
+		if (((n & (low << 1)) != 0) ^ ((Folds & low) != 0))
+			return TURN_LEFT;
+		return TURN_RIGHT;
+	}
+};
+
+/*
+ * Twindragon: two copies of a curve one after the other, joined by a turn
+ * to the right. The dragon of the next order has the same turn in its
+ * middle, but walks its second half backwards.
+ */
+template <class Turn>
+struct twin_turn {
+	static inline int turn(uint64_t n, uint64_t size) {
+		uint64_t half = size >> 1;
+		if (n < half)
+			return Turn::turn(n, half);
+		if (n == half)
+			return TURN_RIGHT;
+		return Turn::turn(n - half, size - half);
+	}
+};
+
+/*
+ * Terdragon: turn of 120 degrees to the left when the lowest non zero
+ * digit of n in base 3 is 1, to the right when it is 2.
+ */
+struct ter_turn {
+	static inline int turn(uint64_t n, __attribute__((unused)) uint64_t size) {
+		while (n % 3 == 0)
+			n /= 3;
+		return n % 3 == 1 ? 2 * TURN_LEFT : 2 * TURN_RIGHT;
+	}
+};
+
+/* position and orientation of the curve between two steps */
+struct curve_state {
+	xy_t position;
+	int orientation;
+};
+
+#define CURVE_MAX_BOUNDS 12
+
+/*
+ * Bounds of a walk done from the origin: the largest value of each linear
+ * form of the lattice over twice the middle of the steps. Once the walk is
+ * rotated o times, the largest raster x is max[bound_x(o)]. The half turn
+ * negates, so the smallest one is -max[bound_x(o + nb_dirs / 2)].
+ */
+struct curve_extent {
+	int64_t max[CURVE_MAX_BOUNDS];
+};
+
+template <class Lattice, class Turn>
+struct curve {
+	typedef Lattice lattice_type;
+	typedef Turn turn_type;
+
+	static inline curve_state origin() {
+		curve_state s = { { 0, 0 }, 0 };
+		return s;
+	}
+
+	/*
+	 * Turn t steps from orientation o, d is rotated along so that the
+	 * walks keep it in registers instead of reading Lattice::dir().
+	 */
+	static inline int turn(int o, xy_t *d, int t) {
+		int i;
+		for (i = 0; i < t; i++)
+			Lattice::rotate(d);
+		for (i = 0; i > t; i--)
+			Lattice::rotate_back(d);
+		return Lattice::wrap(o + t);
+	}
+
+	/*
+	 * Walk the steps (start, end] from s, visit(x, y) gets the pixel of
+	 * each step. s is left after the last step.
+	 */
+	template <class Visit>
+	static inline void walk(curve_state *s, uint64_t start, uint64_t end,
+			uint64_t size, Visit visit) {
+		xy_t p = s->position;
+		int o = s->orientation;
+		xy_t d = Lattice::dir(o);
+		uint64_t n;
+		for (n = start + 1; n <= end; n++) {
+			visit((2 * Lattice::raster_x(p) + Lattice::raster_x(d)) >> 1,
+					(2 * Lattice::raster_y(p) + Lattice::raster_y(d)) >> 1);
+			p.x += d.x;
+			p.y += d.y;
+			o = turn(o, &d, Turn::turn(n, size));
+		}
+		s->position = p;
+		s->orientation = o;
+	}
+
+	/*
+	 * Walk the steps (start, end] from s like walk(), and keep their
+	 * bounds in e for every start orientation. s must be the origin.
+	 */
+	static inline void walk_extent(curve_state *s, uint64_t start, uint64_t end,
+			uint64_t size, curve_extent *e) {
+		xy_t p = s->position;
+		int o = s->orientation;
+		int64_t max[Lattice::nb_bounds];
+		int64_t f[Lattice::nb_bounds];
+		uint64_t n;
+		int k;
+		for (k = 0; k < Lattice::nb_bounds; k++)
+			max[k] = INT64_MIN;
+		xy_t d = Lattice::dir(o);
+		for (n = start + 1; n <= end; n++) {
+			xy_t m = { 2 * p.x + d.x, 2 * p.y + d.y };
+			Lattice::bounds(m, f);
+#pragma GCC unroll 12
+			for (k = 0; k < Lattice::nb_bounds; k++)
+				max[k] = max[k] < f[k] ? f[k] : max[k];
+			p.x += d.x;
+			p.y += d.y;
+			o = turn(o, &d, Turn::turn(n, size));
+		}
+		for (k = 0; k < Lattice::nb_bounds; k++)
+			e->max[k] = max[k];
+		s->position = p;
+		s->orientation = o;
+	}
+
+	/*
+	 * Pixels touched by a walk of extent e started from s, as the visits
+	 * of walk() from s would give them. Return 0 for an empty walk.
+	 */
+	static inline int extent_limits(const curve_extent *e, curve_state s,
+			limits_t *l) {
+		int o = s.orientation;
+		int h = Lattice::wrap(o + Lattice::nb_dirs / 2);
+		int64_t x = 2 * Lattice::raster_x(s.position);
+		int64_t y = 2 * Lattice::raster_y(s.position);
+		if (e->max[0] == INT64_MIN)
+			return 0;
+		l->minimums.x = (x - e->max[Lattice::bound_x(h)]) >> 1;
+		l->minimums.y = (y - e->max[Lattice::bound_y(h)]) >> 1;
+		l->maximums.x = (x + e->max[Lattice::bound_x(o)]) >> 1;
+		l->maximums.y = (y + e->max[Lattice::bound_y(o)]) >> 1;
+		return 1;
+	}
+
+	/*
+	 * state reached by walking b, computed from the origin, after a.
+	 * This operation is associative, but not commutative.
+	 */
+	static inline curve_state compose(curve_state a, curve_state b) {
+		int i;
+		for (i = 0; i < a.orientation; i++)
+			Lattice::rotate(&b.position);
+		b.position.x += a.position.x;
+		b.position.y += a.position.y;
+		b.orientation = Lattice::wrap(a.orientation + b.orientation);
+		return b;
+	}
+};
+
+#endif /* CURVE_H_ */
@@ -12,6 +12,7 @@
 #include <stdlib.h>
 #include <time.h>
 #include <math.h>
+#include <string.h>
 
 #include "dragon.h"
 #include "color.h"
@@ -58,6 +59,19 @@ xy_t compute_orientation(int64_t i)
 
 /* draw dragon in raw matrix */
 int dragon_draw_raw(uint64_t start, uint64_t end, char *dragon, int width, int height, limits_t limits, char id)
+{
+	piece_t piece;
+	piece.position = compute_position(start);
+	piece.orientation = compute_orientation(start);
+	return dragon_draw_piece(start, end, &piece, dragon, width, height, limits, id);
+}
+
+/*
+ * Draw the segments (start, end] from the position and orientation of
+ * piece, the state of the dragon after the segment start. piece is left
+ * after the segment end, consecutive calls continue the dragon.
+ */
+int dragon_draw_piece(uint64_t start, uint64_t end, piece_t *piece, char *dragon, int width, int height, limits_t limits, char id)
 {
 	//printf("start=%" PRId64" end=%"PRId64" id=%d\n", start, end, id);
 	if (end < start)
@@ -66,12 +80,10 @@ int dragon_draw_raw(uint64_t start, uint64_t end, char *dragon, int width, int h
 	if (end == start)
 		return 0;
 
-	xy_t position;
-	xy_t orientation;
+	xy_t position = piece->position;
+	xy_t orientation = piece->orientation;
 	int i, j;
 	uint64_t n;
-	position = compute_position(start);
-	orientation = compute_orientation(start);
 
 	// draw dragon
 	position.x -= limits.minimums.x;
@@ -93,6 +105,32 @@ int dragon_draw_raw(uint64_t start, uint64_t end, char *dragon, int width, int h
 		else
 			rotate_right(&orientation);
 	}
+	piece->position.x = position.x + limits.minimums.x;
+	piece->position.y = position.y + limits.minimums.y;
+	piece->orientation = orientation;
+	return 0;
+}
+
+/*
+ * Draw the segments (start, end] from piece with the colors of
+ * dragon_draw_serial: the color m covers the segments
+ * (m * size / nb_colors, (m + 1) * size / nb_colors].
+ */
+int dragon_draw_colors(uint64_t start, uint64_t end, piece_t *piece, char *dragon, int width, int height, limits_t limits, uint64_t size, int nb_colors)
+{
+	int m = start * nb_colors / size;
+
+	while (start < end) {
+		uint64_t next = (m + 1) * size / nb_colors;
+		if (next > start) {
+			if (next > end)
+				next = end;
+			if (dragon_draw_piece(start, next, piece, dragon, width, height, limits, m) < 0)
+				return -1;
+			start = next;
+		}
+		m++;
+	}
 	return 0;
 }
 
@@ -197,7 +235,7 @@ int dragon_draw_serial(char **canvas, struct rgb *image, int width, int height,
 	int area = dragon_width * dragon_height;
 	int m;
 
-	dragon = (char*)malloc(sizeof(char) * area);
+	dragon = (char*)canvas_alloc(sizeof(char) * area);
 	if (dragon == NULL)
 		goto err;
 
@@ -224,7 +262,7 @@ done:
 	return ret;
 
 err:
-	FREE(dragon);
+	CANVAS_FREE(dragon);
 	ret = -1;
 	goto done;
 }
@@ -270,30 +308,54 @@ int cmp_limits(limits_t *l1, limits_t *l2)
 		return -1;
 	return !(l1->maximums.x == l2->maximums.x &&
 		l1->maximums.y == l2->maximums.y &&
-		l2->minimums.x == l2->minimums.x &&
+		l1->minimums.x == l2->minimums.x &&
 		l1->minimums.y == l2->minimums.y);
 }
 /*
  * compare each position exp(i,j) with act(i,j)
  * return the number of pixels that doesn't match
  */
-int cmp_canvas(char *exp, char *act, int width, int height, int verbose)
+int cmp_canvas(char *exp, char *act, int width, int height, int verbose, int limit)
 {
-	int i, j;
+	return cmp_canvas_range(exp, act, width, 0, width * height, verbose, limit);
+}
+
+/*
+ * compare exp and act between indexes start and end of a canvas of the
+ * given width. Blocks are first compared with memcmp, only the blocks
+ * that differ are counted byte by byte. Unless verbose, the blocks left
+ * are skipped once limit pixels differ, limit <= 0 counts them all.
+ */
+int cmp_canvas_range(char *exp, char *act, int width, int start, int end, int verbose, int limit)
+{
+	int block;
 	int sum = 0;
-	int index;
 	if (exp == NULL || act == NULL)
 		return -1;
-	#pragma omp parallel for reduction(+:sum) private(index, j)
-	for (i = 0; i < height; i++) {
-		for (j = 0; j < width; j++) {
-			index = i * width + j;
+	if (end <= start)
+		return 0;
+	if (verbose)
+		limit = 0;
+	int nb_block = (end - start + CMP_BLOCK - 1) / CMP_BLOCK;
+	#pragma omp parallel for schedule(dynamic, 16)
+	for (block = 0; block < nb_block; block++) {
+		int first = start + block * CMP_BLOCK;
+		int last = first + CMP_BLOCK < end ? first + CMP_BLOCK : end;
+		int index;
+		if (limit > 0 && __atomic_load_n(&sum, __ATOMIC_RELAXED) >= limit)
+			continue;
+		if (memcmp(exp + first, act + first, last - first) == 0)
+			continue;
+		int diff = 0;
+		for (index = first; index < last; index++) {
 			if (exp[index] != act[index]) {
 				if (verbose)
-					printf("pix error (%5d, %5d) expected=%2d actual=%2d\n", j, i, exp[index], act[index]);
-				sum += 1;
+					printf("pix error (%5d, %5d) expected=%2d actual=%2d\n",
+							index % width, index / width, exp[index], act[index]);
+				diff++;
 			}
 		}
+		__atomic_fetch_add(&sum, diff, __ATOMIC_RELAXED);
 	}
 	return sum;
 }
@@ -327,7 +389,7 @@ struct rgb *make_canvas(int width, int height)
 	if (area <= 0) {
 		return NULL;
 	}
-	return (struct rgb *) malloc(sizeof(struct rgb) * area);
+	return (struct rgb *) canvas_alloc(sizeof(struct rgb) * area);
 }
 
 void piece_limit(int64_t start, int64_t end, piece_t *m)
@@ -13,6 +13,7 @@
 #include <stdlib.h>
 #include <inttypes.h>
 #include "color.h"
+#include "canvas_pool.h"
 
 /**
  * TODO:
@@ -30,6 +31,9 @@
 	}					\
 } while(0)
 
+/* bytes compared at once by cmp_canvas */
+#define CMP_BLOCK 4096
+
 typedef struct xy_ {
 	int64_t	x;
 	int64_t y;
@@ -46,6 +50,13 @@ typedef struct morceau_ {
 	limits_t	limits;
 } piece_t;
 
+struct limit_data {
+	int id;
+	uint64_t start;
+	uint64_t end;
+	piece_t piece;
+} __attribute__((aligned(128)));
+
 struct draw_data {
 	int id;
 	int nb_thread;
@@ -62,13 +73,8 @@ struct draw_data {
 	uint64_t size;
 	limits_t limits;
 	pthread_barrier_t *barrier;
-} __attribute__((aligned(128)));
-
-struct limit_data {
-	int id;
-	uint64_t start;
-	uint64_t end;
-	piece_t piece;
+	struct limit_data *chunks;
+	int nb_chunk;
 } __attribute__((aligned(128)));
 
 int dragon_limits_serial(limits_t *limits, uint64_t nbIterations, int nb_thread);
@@ -87,10 +93,13 @@ void dump_canvas(char *canvas, int width, int height);
 void dump_canvas_rgb(struct rgb *canvas, int width, int height);
 int write_img(struct rgb *image, char *file, int width, int height);
 struct rgb *make_canvas(int width, int height);
-int cmp_canvas(char *exp, char *act, int width, int height, int verbose);
+int cmp_canvas(char *exp, char *act, int width, int height, int verbose, int limit);
+int cmp_canvas_range(char *exp, char *act, int width, int start, int end, int verbose, int limit);
 void init_canvas(int start, int end, char *canvas, char value);
 void scale_dragon(int start, int end, struct rgb *image, int image_width, int image_height,
         char *dragon, int dragon_width, int dragon_height, struct palette *palette);
 int dragon_draw_raw(uint64_t start, uint64_t end, char *dragon, int width, int height, limits_t limits, char id);
+int dragon_draw_piece(uint64_t start, uint64_t end, piece_t *piece, char *dragon, int width, int height, limits_t limits, char id);
+int dragon_draw_colors(uint64_t start, uint64_t end, piece_t *piece, char *dragon, int width, int height, limits_t limits, uint64_t size, int nb_colors);
 
 #endif /* DRAGON_H_ */
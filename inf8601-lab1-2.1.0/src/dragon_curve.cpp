@@ -0,0 +1,330 @@
+/*
+ * dragon_curve.cpp
+ *
+ * Parallel limits, draw and render of the curves of curve.h with TBB.
+ * The curve is cut in chunks; the end state and the bounds of each chunk
+ * are computed from the origin in parallel, then the states are merged in
+ * order to get the start of every chunk, which places its bounds. The
+ * chunks are walked again from their start to draw.
+ *
+ * The limits are the pixels touched by the curve. For the Heighway dragon
+ * they are the same as the limits of dragon.c, so "heighway" is checked
+ * against the serial dragon like the other libraries. The other curves
+ * are checked against the plain walk of dragon_curve_reference().
+ *
+ *  Created on: 2026-10-19
+ *      Author: francis
+ */
+
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+extern "C" {
+#include "config.h"
+#include "dragon.h"
+#include "color.h"
+#include "tuning.h"
+}
+#include "curve.h"
+#include "dragon_curve.h"
+#include "tbb/tbb.h"
+
+using namespace std;
+using namespace tbb;
+
+/* number of chunks per thread, gives some room to the load balancer */
+#define CURVE_PIECES_PER_THREAD 4
+
+typedef curve<square_lattice, paperfold_turn<0> > heighway_curve;
+typedef curve<square_lattice, twin_turn<paperfold_turn<0> > > twindragon_curve;
+typedef curve<triangular_lattice, ter_turn> terdragon_curve;
+/* alternate folds */
+typedef curve<square_lattice, paperfold_turn<0x5555555555555555ULL> > paperfold_curve;
+
+static inline uint64_t chunk_start(uint64_t size, int chunk, int nb_chunk)
+{
+	return chunk * size / nb_chunk;
+}
+
+/*
+ * Start state of every chunk in starts and limits of the curve.
+ */
+template <class Curve>
+static void curve_limits(limits_t *limits, vector<curve_state>& starts,
+		uint64_t size, int nb_chunk)
+{
+	vector<curve_state> ends(nb_chunk);
+	vector<curve_extent> extents(nb_chunk);
+	limits_t l;
+	int found = 0;
+
+	/* 1. Etat final et bornes de chaque morceau, depuis l'origine */
+	parallel_for(0, nb_chunk, [&](int c) {
+		curve_state s = Curve::origin();
+		Curve::walk_extent(&s, chunk_start(size, c, nb_chunk),
+				chunk_start(size, c + 1, nb_chunk), size, &extents[c]);
+		ends[c] = s;
+	});
+
+	/* 2. Etat initial de chaque morceau, fusion dans l'ordre */
+	starts.resize(nb_chunk);
+	starts[0] = Curve::origin();
+	for (int c = 1; c < nb_chunk; c++)
+		starts[c] = Curve::compose(starts[c - 1], ends[c - 1]);
+
+	/* 3. Limites de chaque morceau, placees par son etat initial */
+	memset(limits, 0, sizeof(limits_t));
+	for (int c = 0; c < nb_chunk; c++) {
+		if (!Curve::extent_limits(&extents[c], starts[c], &l))
+			continue;
+		if (!found) {
+			*limits = l;
+			found = 1;
+			continue;
+		}
+		if (limits->minimums.x > l.minimums.x) limits->minimums.x = l.minimums.x;
+		if (limits->minimums.y > l.minimums.y) limits->minimums.y = l.minimums.y;
+		if (limits->maximums.x < l.maximums.x) limits->maximums.x = l.maximums.x;
+		if (limits->maximums.y < l.maximums.y) limits->maximums.y = l.maximums.y;
+	}
+	if (!found)
+		return;
+	/* the canvas includes the last pixel */
+	limits->maximums.x++;
+	limits->maximums.y++;
+}
+
+template <class Curve>
+static int curve_draw(const char *name, char **canvas, struct rgb *image,
+		int width, int height, uint64_t size, int nb_thread)
+{
+	vector<curve_state> starts;
+	limits_t limits;
+	char *dragon = NULL;
+	int dragon_width;
+	int dragon_height;
+	int dragon_surface;
+	int nb_chunk;
+	int pieces;
+	atomic<int> ret(0);
+
+	if (nb_thread <= 0)
+		return -1;
+
+	struct palette *palette = init_palette(nb_thread);
+	if (palette == NULL)
+		return -1;
+
+	/* the chunks of a color never span two colors */
+	nb_chunk = tuning_chunks(name, TUNING_DRAW, size, width, height,
+			nb_thread, CURVE_PIECES_PER_THREAD);
+	pieces = nb_chunk / nb_thread;
+	task_arena arena(nb_thread);
+
+	/* 1. Calculer les limites et le debut de chaque morceau */
+	arena.execute([&] { curve_limits<Curve>(&limits, starts, size, nb_chunk); });
+
+	dragon_width = limits.maximums.x - limits.minimums.x;
+	dragon_height = limits.maximums.y - limits.minimums.y;
+	dragon_surface = dragon_width * dragon_height;
+
+	dragon = (char *) canvas_alloc(dragon_surface);
+	if (dragon == NULL) {
+		free_palette(palette);
+		*canvas = NULL;
+		return -1;
+	}
+
+	arena.execute([&] {
+		/* 2. Initialiser la surface */
+		int clear = tuning_chunks(name, TUNING_CLEAR, size, width, height,
+				nb_thread, 1);
+		parallel_for(0, clear, [&](int i) {
+			init_canvas((int64_t) i * dragon_surface / clear,
+					(int64_t) (i + 1) * dragon_surface / clear, dragon, -1);
+		});
+
+		/*
+		 * 3. Dessiner chaque morceau depuis son etat initial. Les stores
+		 * dans la surface peuvent tout aliaser : la visite travaille sur
+		 * des copies locales, sinon elles sont relues a chaque pas.
+		 */
+		parallel_for(0, nb_chunk, [&](int c) {
+			curve_state s = starts[c];
+			char *d = dragon;
+			char id = c / pieces;
+			int64_t w = dragon_width;
+			int64_t area = dragon_surface;
+			int64_t origin = limits.minimums.y * w + limits.minimums.x;
+			int err = 0;
+			Curve::walk(&s, chunk_start(size, c, nb_chunk),
+					chunk_start(size, c + 1, nb_chunk), size,
+					[d, id, w, area, origin, &err](int64_t x, int64_t y) {
+				int64_t index = y * w + x - origin;
+				if (index < 0 || index >= area) {
+					err = 1;
+					return;
+				}
+				d[index] = id;
+			});
+			if (err)
+				ret = -1;
+		});
+
+		/* 4. Effectuer le rendu final par bandes de lignes */
+		int render = tuning_chunks(name, TUNING_RENDER, size, width, height,
+				nb_thread, 1);
+		parallel_for(0, render, [&](int i) {
+			scale_dragon(i * height / render, (i + 1) * height / render,
+					image, width, height, dragon, dragon_width,
+					dragon_height, palette);
+		});
+	});
+
+	if (ret < 0)
+		printf("index is out of range\n");
+	free_palette(palette);
+	*canvas = dragon;
+	return ret.load();
+}
+
+template <class Curve>
+static int curve_limits_only(const char *name, limits_t *limits, uint64_t size,
+		int nb_thread)
+{
+	vector<curve_state> starts;
+
+	if (nb_thread <= 0)
+		return -1;
+
+	int nb_chunk = tuning_chunks(name, TUNING_LIMITS, size, 0, 0, nb_thread,
+			CURVE_PIECES_PER_THREAD);
+	task_arena arena(nb_thread);
+	arena.execute([&] { curve_limits<Curve>(limits, starts, size, nb_chunk); });
+	return 0;
+}
+
+/*
+ * Serial reference for the check: a plain walk, one step at a time from
+ * Lattice::dir(), without the extents, the composition of the chunks nor
+ * the rotations of walk(). The pixels touched are 0 in the canvas, the
+ * others -1, since the colors depend on the chunks of the draw.
+ */
+template <class Curve>
+static int curve_reference(limits_t *limits, char **canvas, uint64_t size)
+{
+	typedef typename Curve::lattice_type Lattice;
+	typedef typename Curve::turn_type Turn;
+	xy_t p;
+	xy_t d;
+	int64_t x, y;
+	int64_t width = 0, height = 0;
+	uint64_t n;
+	int o;
+	int pass;
+	char *dragon = NULL;
+
+	memset(limits, 0, sizeof(limits_t));
+	/* 1. Calculer les limites, puis 2. dessiner avec la meme marche */
+	for (pass = 0; pass < 2; pass++) {
+		p.x = p.y = 0;
+		o = 0;
+		for (n = 1; n <= size; n++) {
+			d = Lattice::dir(o);
+			x = (2 * Lattice::raster_x(p) + Lattice::raster_x(d)) >> 1;
+			y = (2 * Lattice::raster_y(p) + Lattice::raster_y(d)) >> 1;
+			if (pass == 1) {
+				dragon[(y - limits->minimums.y) * width + x - limits->minimums.x] = 0;
+			} else if (n == 1) {
+				limits->minimums.x = limits->maximums.x = x;
+				limits->minimums.y = limits->maximums.y = y;
+			} else {
+				if (limits->minimums.x > x) limits->minimums.x = x;
+				if (limits->minimums.y > y) limits->minimums.y = y;
+				if (limits->maximums.x < x) limits->maximums.x = x;
+				if (limits->maximums.y < y) limits->maximums.y = y;
+			}
+			p.x += d.x;
+			p.y += d.y;
+			o = Lattice::wrap(o + Turn::turn(n, size));
+		}
+		if (pass == 1)
+			break;
+		if (size > 0) {
+			limits->maximums.x++;
+			limits->maximums.y++;
+		}
+		width = limits->maximums.x - limits->minimums.x;
+		height = limits->maximums.y - limits->minimums.y;
+		dragon = (char *) canvas_alloc(width * height);
+		if (dragon == NULL)
+			return -1;
+		init_canvas(0, width * height, dragon, -1);
+	}
+	*canvas = dragon;
+	return 0;
+}
+
+int dragon_curve_reference(const char *name, limits_t *limits, char **canvas,
+		uint64_t size)
+{
+	*canvas = NULL;
+	if (strcmp(name, "heighway") == 0)
+		return curve_reference<heighway_curve>(limits, canvas, size);
+	if (strcmp(name, "twindragon") == 0)
+		return curve_reference<twindragon_curve>(limits, canvas, size);
+	if (strcmp(name, "terdragon") == 0)
+		return curve_reference<terdragon_curve>(limits, canvas, size);
+	if (strcmp(name, "paperfold") == 0)
+		return curve_reference<paperfold_curve>(limits, canvas, size);
+	return -1;
+}
+
+int dragon_draw_heighway(char **canvas, struct rgb *image, int width, int height,
+		uint64_t size, int nb_thread)
+{
+	return curve_draw<heighway_curve>("heighway", canvas, image, width,
+			height, size, nb_thread);
+}
+
+int dragon_limits_heighway(limits_t *limits, uint64_t size, int nb_thread)
+{
+	return curve_limits_only<heighway_curve>("heighway", limits, size, nb_thread);
+}
+
+int dragon_draw_twindragon(char **canvas, struct rgb *image, int width, int height,
+		uint64_t size, int nb_thread)
+{
+	return curve_draw<twindragon_curve>("twindragon", canvas, image, width,
+			height, size, nb_thread);
+}
+
+int dragon_limits_twindragon(limits_t *limits, uint64_t size, int nb_thread)
+{
+	return curve_limits_only<twindragon_curve>("twindragon", limits, size, nb_thread);
+}
+
+int dragon_draw_terdragon(char **canvas, struct rgb *image, int width, int height,
+		uint64_t size, int nb_thread)
+{
+	return curve_draw<terdragon_curve>("terdragon", canvas, image, width,
+			height, size, nb_thread);
+}
+
+int dragon_limits_terdragon(limits_t *limits, uint64_t size, int nb_thread)
+{
+	return curve_limits_only<terdragon_curve>("terdragon", limits, size, nb_thread);
+}
+
+int dragon_draw_paperfold(char **canvas, struct rgb *image, int width, int height,
+		uint64_t size, int nb_thread)
+{
+	return curve_draw<paperfold_curve>("paperfold", canvas, image, width,
+			height, size, nb_thread);
+}
+
+int dragon_limits_paperfold(limits_t *limits, uint64_t size, int nb_thread)
+{
+	return curve_limits_only<paperfold_curve>("paperfold", limits, size, nb_thread);
+}
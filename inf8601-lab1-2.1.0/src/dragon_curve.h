@@ -0,0 +1,29 @@
+/*
+ * dragon_curve.h
+ *
+ *  Created on: 2026-10-19
+ *      Author: francis
+ */
+
+#ifndef DRAGON_CURVE_H_
+#define DRAGON_CURVE_H_
+
+#include "dragon.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+int dragon_draw_heighway(char **canvas, struct rgb *image, int width, int height, uint64_t size, int nb_thread);
+int dragon_limits_heighway(limits_t *limits, uint64_t size, int nb_thread);
+int dragon_draw_twindragon(char **canvas, struct rgb *image, int width, int height, uint64_t size, int nb_thread);
+int dragon_limits_twindragon(limits_t *limits, uint64_t size, int nb_thread);
+int dragon_draw_terdragon(char **canvas, struct rgb *image, int width, int height, uint64_t size, int nb_thread);
+int dragon_limits_terdragon(limits_t *limits, uint64_t size, int nb_thread);
+int dragon_draw_paperfold(char **canvas, struct rgb *image, int width, int height, uint64_t size, int nb_thread);
+int dragon_limits_paperfold(limits_t *limits, uint64_t size, int nb_thread);
+int dragon_curve_reference(const char *name, limits_t *limits, char **canvas, uint64_t size);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DRAGON_CURVE_H_ */
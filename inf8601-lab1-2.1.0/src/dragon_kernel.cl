@@ -0,0 +1,265 @@
+/*
+ * dragon_kernel.cl
+ *
+ * Limits and draw of the dragon in OpenCL. The structures have the layout
+ * of dragon.h. OpenCL C has no recursion: compute_position and
+ * compute_orientation of dragon.c are unrolled into loops.
+ *
+ *  Created on: 2026-10-19
+ *      Author: francis
+ */
+
+#pragma OPENCL EXTENSION cl_khr_byte_addressable_store : enable
+
+typedef struct xy_ {
+	long x;
+	long y;
+} xy_t;
+
+typedef struct limites_ {
+	xy_t minimums;
+	xy_t maximums;
+} limits_t;
+
+typedef struct morceau_ {
+	xy_t position;
+	xy_t orientation;
+	limits_t limits;
+} piece_t;
+
+void rotate_left(xy_t *xy)
+{
+	long tmp_y = xy->x;
+	xy->x = -xy->y;
+	xy->y = tmp_y;
+}
+
+void rotate_right(xy_t *xy)
+{
+	long tmp_y = -xy->x;
+	xy->x = xy->y;
+	xy->y = tmp_y;
+}
+
+void limits_invert(limits_t *limites)
+{
+	long nouveauMaxY = limites->maximums.x;
+	limites->maximums.x = -limites->minimums.y;
+	limites->minimums.y = limites->minimums.x;
+	limites->minimums.x = -limites->maximums.y;
+	limites->maximums.y = nouveauMaxY;
+}
+
+void piece_init(piece_t *piece)
+{
+	piece->position.x = 0;
+	piece->position.y = 0;
+	piece->orientation.x = 1;
+	piece->orientation.y = 1;
+	piece->limits.minimums = piece->position;
+	piece->limits.maximums = piece->position;
+}
+
+void piece_limit(long start, long end, piece_t *m)
+{
+	long n;
+	for (n = start + 1; n <= end; n++) {
+		m->position.x += m->orientation.x;
+		m->position.y += m->orientation.y;
+		if (((n & -n) << 1) & n)
+			rotate_left(&m->orientation);
+		else
+			rotate_right(&m->orientation);
+		if (m->limits.minimums.x > m->position.x) m->limits.minimums.x = m->position.x;
+		if (m->limits.minimums.y > m->position.y) m->limits.minimums.y = m->position.y;
+		if (m->limits.maximums.x < m->position.x) m->limits.maximums.x = m->position.x;
+		if (m->limits.maximums.y < m->position.y) m->limits.maximums.y = m->position.y;
+	}
+}
+
+/* merge m2 into m1, associative but not commutative */
+void piece_merge(piece_t *m1, piece_t m2)
+{
+	xy_t orientation;
+	orientation.x = 1;
+	orientation.y = 1;
+
+	while (orientation.x != m1->orientation.x ||
+			orientation.y != m1->orientation.y) {
+		rotate_left(&m2.position);
+		rotate_left(&m2.orientation);
+		limits_invert(&m2.limits);
+		rotate_left(&orientation);
+	}
+
+	m2.limits.minimums.x += m1->position.x;
+	m2.limits.minimums.y += m1->position.y;
+	m2.limits.maximums.x += m1->position.x;
+	m2.limits.maximums.y += m1->position.y;
+
+	m1->position.x += m2.position.x;
+	m1->position.y += m2.position.y;
+	m1->orientation = m2.orientation;
+
+	if (m1->limits.minimums.x > m2.limits.minimums.x) m1->limits.minimums.x = m2.limits.minimums.x;
+	if (m1->limits.minimums.y > m2.limits.minimums.y) m1->limits.minimums.y = m2.limits.minimums.y;
+	if (m1->limits.maximums.x < m2.limits.maximums.x) m1->limits.maximums.x = m2.limits.maximums.x;
+	if (m1->limits.maximums.y < m2.limits.maximums.y) m1->limits.maximums.y = m2.limits.maximums.y;
+}
+
+/*
+ * compute_orientation(i) is compute_orientation((mask << 1) - (i + 1))
+ * rotated to the right: count the rotations down to 0.
+ */
+xy_t compute_orientation(long i)
+{
+	xy_t orientation;
+	int rotations = 0;
+
+	while (i > 0) {
+		long mask = 1;
+		while ((i ^ mask) > mask)
+			mask <<= 1;
+		i = (mask << 1) - (i + 1);
+		rotations++;
+	}
+	orientation.x = 1;
+	orientation.y = 1;
+	for (rotations &= 3; rotations > 0; rotations--)
+		rotate_right(&orientation);
+	return orientation;
+}
+
+/*
+ * compute_position(i) is c + rotate_left(compute_position(j)), with c
+ * and j given by the loop on mask: the terms are summed, each one rotated
+ * once more than the previous.
+ */
+xy_t compute_position(long i)
+{
+	xy_t sum;
+	int rotations = 0;
+
+	sum.x = 0;
+	sum.y = 0;
+	while (i > 0) {
+		long mask = 1;
+		long position_y = 1;
+		xy_t position;
+		xy_t term;
+		int k;
+
+		position.x = 1;
+		position.y = 1;
+		while ((i ^ mask) > mask) {
+			mask <<= 1;
+			position_y -= position.x;
+			position.x += position.y;
+			position.y = position_y;
+		}
+		if (i ^ mask) {
+			term.x = position.x + position.y;
+			term.y = position_y - position.x;
+		} else {
+			term = position;
+		}
+		for (k = 0; k < (rotations & 3); k++)
+			rotate_left(&term);
+		sum.x += term.x;
+		sum.y += term.y;
+		if (!(i ^ mask))
+			break;
+		i = (mask << 1) - i;
+		rotations++;
+	}
+	return sum;
+}
+
+/*
+ * Each work item computes the piece of its chunk, the pieces of the work
+ * group are merged by pairs of neighbors to keep their order. One piece
+ * per work group is written, merged in order by the host.
+ */
+__kernel void dragon_limits_kernel(ulong size, ulong chunk,
+		__global piece_t *pieces, __local piece_t *scratch)
+{
+	size_t gid = get_global_id(0);
+	size_t lid = get_local_id(0);
+	size_t lsize = get_local_size(0);
+	ulong start = min(gid * chunk, size);
+	ulong end = min(start + chunk, size);
+	size_t s;
+	piece_t piece;
+
+	piece_init(&piece);
+	piece_limit(start, end, &piece);
+	scratch[lid] = piece;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (s = 1; s < lsize; s <<= 1) {
+		if ((lid & ((s << 1) - 1)) == 0 && lid + s < lsize) {
+			piece = scratch[lid];
+			piece_merge(&piece, scratch[lid + s]);
+			scratch[lid] = piece;
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	if (lid == 0)
+		pieces[get_group_id(0)] = scratch[0];
+}
+
+/*
+ * Each work item draws its chunk from the position given by the jump
+ * ahead. The segment n has the color m when m * size / nb_colors < n <=
+ * (m + 1) * size / nb_colors, as with dragon_draw_serial. A work item
+ * that leaves the canvas sets error and stops, the host fails the draw.
+ */
+__kernel void dragon_draw_kernel(ulong size, ulong chunk, int nb_colors,
+		__global char *dragon, int width, int height, long min_x, long min_y,
+		__global int *error)
+{
+	size_t gid = get_global_id(0);
+	ulong start = min(gid * chunk, size);
+	ulong end = min(start + chunk, size);
+	long area = (long) width * height;
+	xy_t position;
+	xy_t orientation;
+	ulong next;
+	ulong n;
+	int id;
+
+	if (start >= end)
+		return;
+
+	position = compute_position(start);
+	orientation = compute_orientation(start);
+	position.x -= min_x;
+	position.y -= min_y;
+
+	id = start * nb_colors / size;
+	while (id > 0 && id * size / nb_colors > start)
+		id--;
+	next = (id + 1) * size / nb_colors;
+
+	for (n = start + 1; n <= end; n++) {
+		while (n > next) {
+			id++;
+			next = (id + 1) * size / nb_colors;
+		}
+		long j = (position.x + (position.x + orientation.x)) >> 1;
+		long i = (position.y + (position.y + orientation.y)) >> 1;
+		long index = i * width + j;
+		if (index < 0 || index >= area) {
+			atomic_or(error, 1);
+			return;
+		}
+		dragon[index] = id;
+		position.x += orientation.x;
+		position.y += orientation.y;
+		if (((n & -n) << 1) & n)
+			rotate_left(&orientation);
+		else
+			rotate_right(&orientation);
+	}
+}
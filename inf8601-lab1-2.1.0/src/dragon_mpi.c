@@ -0,0 +1,335 @@
+/*
+ * dragon_mpi.c
+ *
+ * Dragon distributed on the ranks of MPI_COMM_WORLD. Each rank gets a
+ * contiguous share of the segments and uses nb_thread OpenMP threads.
+ *
+ * The limits are reduced with an operator wrapping piece_merge, declared
+ * non commutative so that MPI merges the pieces in the order of the ranks.
+ * For the draw, each rank only allocates the canvas covering its share
+ * and sums its colors per pixel of the image. The sums and the number of
+ * colored cells are reduced on rank 0, which makes the same average as
+ * scale_dragon; the canvas never leaves its rank. A cell of the dragon is
+ * drawn exactly once, so the image is the same as with the serial dragon.
+ *
+ *  Created on: 2026-10-19
+ *      Author: francis
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+
+#include "color.h"
+#include "dragon.h"
+#include "dragon_mpi.h"
+
+/* r, g, b, colored cells */
+#define ACC_FIELDS 4
+
+static MPI_Datatype piece_type;
+static MPI_Op piece_op;
+static int mpi_rank = 0;
+static int mpi_size = 1;
+
+/*
+ * inout = in . inout, in comes from the lower ranks
+ */
+static void piece_merge_op(void *in, void *inout, int *len,
+		__attribute__((unused)) MPI_Datatype *type)
+{
+	piece_t *m1 = (piece_t *) in;
+	piece_t *m2 = (piece_t *) inout;
+	int i;
+
+	for (i = 0; i < *len; i++) {
+		piece_t piece = m1[i];
+		piece_merge(&piece, m2[i]);
+		m2[i] = piece;
+	}
+}
+
+int dragon_mpi_init(int *argc, char ***argv)
+{
+	if (MPI_Init(argc, argv) != MPI_SUCCESS)
+		return -1;
+	MPI_Comm_rank(MPI_COMM_WORLD, &mpi_rank);
+	MPI_Comm_size(MPI_COMM_WORLD, &mpi_size);
+	MPI_Type_contiguous(sizeof(piece_t) / sizeof(int64_t), MPI_INT64_T, &piece_type);
+	MPI_Type_commit(&piece_type);
+	MPI_Op_create(piece_merge_op, 0, &piece_op);
+	return mpi_rank;
+}
+
+void dragon_mpi_finalize(void)
+{
+	MPI_Op_free(&piece_op);
+	MPI_Type_free(&piece_type);
+	MPI_Finalize();
+}
+
+int dragon_mpi_rank(void)
+{
+	return mpi_rank;
+}
+
+static uint64_t rank_start(uint64_t size, int rank)
+{
+	return rank * size / mpi_size;
+}
+
+/*
+ * piece of the segments (start, end], from the origin, computed by
+ * nb_thread pieces merged in order
+ */
+static int rank_piece(piece_t *piece, uint64_t start, uint64_t end, int nb_thread)
+{
+	piece_t *pieces;
+	int i;
+
+	pieces = (piece_t *) calloc(nb_thread, sizeof(piece_t));
+	if (pieces == NULL)
+		return -1;
+
+	#pragma omp parallel for num_threads(nb_thread)
+	for (i = 0; i < nb_thread; i++) {
+		piece_init(&pieces[i]);
+		piece_limit(start + i * (end - start) / nb_thread,
+				start + (i + 1) * (end - start) / nb_thread, &pieces[i]);
+	}
+
+	piece_init(piece);
+	for (i = 0; i < nb_thread; i++)
+		piece_merge(piece, pieces[i]);
+	FREE(pieces);
+	return 0;
+}
+
+/*
+ * Limits of the segments (start, end] in the coordinates of the dragon,
+ * each thread starts from the absolute position of its first segment.
+ */
+static void rank_limits(limits_t *limits, uint64_t start, uint64_t end, int nb_thread)
+{
+	limits_t *all;
+	int i;
+
+	all = (limits_t *) calloc(nb_thread, sizeof(limits_t));
+	if (all == NULL)
+		MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+
+	#pragma omp parallel for num_threads(nb_thread)
+	for (i = 0; i < nb_thread; i++) {
+		piece_t piece;
+		uint64_t s = start + i * (end - start) / nb_thread;
+		piece.position = compute_position(s);
+		piece.orientation = compute_orientation(s);
+		piece.limits.minimums = piece.position;
+		piece.limits.maximums = piece.position;
+		piece_limit(s, start + (i + 1) * (end - start) / nb_thread, &piece);
+		all[i] = piece.limits;
+	}
+
+	*limits = all[0];
+	for (i = 1; i < nb_thread; i++) {
+		if (limits->minimums.x > all[i].minimums.x) limits->minimums.x = all[i].minimums.x;
+		if (limits->minimums.y > all[i].minimums.y) limits->minimums.y = all[i].minimums.y;
+		if (limits->maximums.x < all[i].maximums.x) limits->maximums.x = all[i].maximums.x;
+		if (limits->maximums.y < all[i].maximums.y) limits->maximums.y = all[i].maximums.y;
+	}
+	FREE(all);
+}
+
+/*
+ * Add the colored cells of the local canvas to the pixels of the image.
+ * (oi, oj) is the position of the local canvas in the dragon.
+ */
+static void accumulate(unsigned int *acc, int width, int height, char *local,
+		int local_width, int local_height, int oi, int oj, int scale,
+		int deltaI, int deltaJ, struct palette *palette, int nb_thread)
+{
+	struct rgb *colors = palette->colors;
+	int y;
+
+	#pragma omp parallel for schedule(dynamic) num_threads(nb_thread)
+	for (y = 0; y < height; y++) {
+		int i1 = y * scale - deltaI - oi;
+		int i2 = i1 + scale;
+		int x, i, j;
+		if (i1 < 0) i1 = 0;
+		if (i2 > local_height) i2 = local_height;
+		if (i1 >= i2)
+			continue;
+		for (x = 0; x < width; x++) {
+			int j1 = x * scale - deltaJ - oj;
+			int j2 = j1 + scale;
+			unsigned int *a = &acc[(y * width + x) * ACC_FIELDS];
+			if (j1 < 0) j1 = 0;
+			if (j2 > local_width) j2 = local_width;
+			for (i = i1; i < i2; i++) {
+				for (j = j1; j < j2; j++) {
+					int id = local[i * local_width + j];
+					if (id < 0)
+						continue;
+					a[0] += colors[id].r;
+					a[1] += colors[id].g;
+					a[2] += colors[id].b;
+					a[3]++;
+				}
+			}
+		}
+	}
+}
+
+/*
+ * Average of the pixels as in scale_dragon, uncolored cells are white.
+ */
+static void resolve(struct rgb *image, unsigned int *acc, int width, int height,
+		int dragon_width, int dragon_height, int scale, int deltaI, int deltaJ)
+{
+	int y;
+
+	#pragma omp parallel for
+	for (y = 0; y < height; y++) {
+		int i1 = y * scale - deltaI;
+		int i2 = i1 + scale;
+		int x;
+		if (i1 < 0) i1 = 0;
+		if (i2 > dragon_height) i2 = dragon_height;
+		for (x = 0; x < width; x++) {
+			int j1 = x * scale - deltaJ;
+			int j2 = j1 + scale;
+			int index = y * width + x;
+			unsigned int *a = &acc[index * ACC_FIELDS];
+			if (j1 < 0) j1 = 0;
+			if (j2 > dragon_width) j2 = dragon_width;
+			if (i1 >= i2 || j1 >= j2) {
+				image[index] = white;
+				continue;
+			}
+			unsigned int cnt = (i2 - i1) * (j2 - j1);
+			unsigned int blank = (cnt - a[3]) * 255;
+			image[index].r = (unsigned char) ((a[0] + blank) / cnt);
+			image[index].g = (unsigned char) ((a[1] + blank) / cnt);
+			image[index].b = (unsigned char) ((a[2] + blank) / cnt);
+		}
+	}
+}
+
+/*
+ * Draw the dragon on all the ranks, the image is returned on every rank.
+ * No canvas is assembled, *canvas is always NULL.
+ */
+int dragon_draw_mpi(char **canvas, struct rgb *image, int width, int height,
+		uint64_t size, int nb_thread)
+{
+	struct palette *palette = NULL;
+	unsigned int *acc = NULL;
+	char *local = NULL;
+	limits_t limits;
+	limits_t local_limits;
+	int local_width = 0;
+	int local_height = 0;
+	int ret = 0;
+	int m;
+
+	*canvas = NULL;
+	if (nb_thread <= 0)
+		return -1;
+
+	/* the other ranks would wait in the collectives, as for the canvas */
+	palette = init_palette(nb_thread);
+	if (palette == NULL)
+		MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+
+	/* 1. Calculer les limites du dragon sur tous les rangs */
+	if (dragon_limits_mpi(&limits, size, nb_thread) < 0)
+		goto err;
+
+	int dragon_width = limits.maximums.x - limits.minimums.x;
+	int dragon_height = limits.maximums.y - limits.minimums.y;
+	int scale_x = dragon_width / width + 1;
+	int scale_y = dragon_height / height + 1;
+	int scale = (scale_x > scale_y ? scale_x : scale_y);
+	int deltaJ = (scale * width - dragon_width) / 2;
+	int deltaI = (scale * height - dragon_height) / 2;
+
+	/* 2. Dessiner la part du rang sur une surface a sa mesure */
+	uint64_t start = rank_start(size, mpi_rank);
+	uint64_t end = rank_start(size, mpi_rank + 1);
+	memset(&local_limits, 0, sizeof(limits_t));
+	if (start < end) {
+		rank_limits(&local_limits, start, end, nb_thread);
+		local_width = local_limits.maximums.x - local_limits.minimums.x;
+		local_height = local_limits.maximums.y - local_limits.minimums.y;
+		local = (char *) canvas_alloc(local_width * local_height);
+		if (local == NULL)
+			MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+		init_canvas(0, local_width * local_height, local, -1);
+
+		#pragma omp parallel for schedule(dynamic) num_threads(nb_thread)
+		for (m = 0; m < nb_thread; m++) {
+			uint64_t s = m * size / nb_thread;
+			uint64_t e = (m + 1) * size / nb_thread;
+			if (s < start) s = start;
+			if (e > end) e = end;
+			if (s < e)
+				dragon_draw_raw(s, e, local, local_width, local_height,
+						local_limits, m);
+		}
+	}
+
+	/* 3. Accumuler les couleurs par pixel de l'image */
+	acc = (unsigned int *) calloc(width * height * ACC_FIELDS, sizeof(unsigned int));
+	if (acc == NULL)
+		MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+	if (local != NULL)
+		accumulate(acc, width, height, local, local_width, local_height,
+				local_limits.minimums.y - limits.minimums.y,
+				local_limits.minimums.x - limits.minimums.x,
+				scale, deltaI, deltaJ, palette, nb_thread);
+
+	/* 4. Reduire les sommes sur le rang 0, puis diffuser l'image */
+	if (mpi_rank == 0) {
+		MPI_Reduce(MPI_IN_PLACE, acc, width * height * ACC_FIELDS,
+				MPI_UNSIGNED, MPI_SUM, 0, MPI_COMM_WORLD);
+		resolve(image, acc, width, height, dragon_width, dragon_height,
+				scale, deltaI, deltaJ);
+	} else {
+		MPI_Reduce(acc, NULL, width * height * ACC_FIELDS,
+				MPI_UNSIGNED, MPI_SUM, 0, MPI_COMM_WORLD);
+	}
+	MPI_Bcast(image, width * height * sizeof(struct rgb), MPI_BYTE, 0, MPI_COMM_WORLD);
+
+done:
+	FREE(acc);
+	CANVAS_FREE(local);
+	free_palette(palette);
+	return ret;
+err:
+	ret = -1;
+	goto done;
+}
+
+/*
+ * Calcule les limites en terme de largeur et de hauteur de
+ * la forme du dragon. Chaque rang calcule le morceau de sa part,
+ * les morceaux sont fusionnes dans l'ordre des rangs.
+ */
+int dragon_limits_mpi(limits_t *limits, uint64_t size, int nb_thread)
+{
+	piece_t local;
+	piece_t piece;
+
+	if (nb_thread <= 0)
+		return -1;
+
+	if (rank_piece(&local, rank_start(size, mpi_rank),
+			rank_start(size, mpi_rank + 1), nb_thread) < 0)
+		MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+
+	MPI_Allreduce(&local, &piece, 1, piece_type, piece_op, MPI_COMM_WORLD);
+	*limits = piece.limits;
+	return 0;
+}
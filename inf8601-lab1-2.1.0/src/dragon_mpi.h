@@ -0,0 +1,19 @@
+/*
+ * dragon_mpi.h
+ *
+ *  Created on: 2026-10-19
+ *      Author: francis
+ */
+
+#ifndef DRAGON_MPI_H_
+#define DRAGON_MPI_H_
+
+#include "dragon.h"
+
+int dragon_mpi_init(int *argc, char ***argv);
+void dragon_mpi_finalize(void);
+int dragon_mpi_rank(void);
+int dragon_draw_mpi(char **canvas, struct rgb *image, int width, int height, uint64_t size, int nb_thread);
+int dragon_limits_mpi(limits_t *limits, uint64_t size, int nb_thread);
+
+#endif /* DRAGON_MPI_H_ */
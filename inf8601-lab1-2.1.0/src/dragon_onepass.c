@@ -0,0 +1,415 @@
+/*
+ * dragon_onepass.c
+ *
+ * Limits and draw in a single walk of the dragon. Each chunk is walked
+ * from the origin, as for its piece in the limits, and its cells are kept
+ * in a sparse set of tiles in the coordinates of the chunk. Once the
+ * pieces are merged, the state of the dragon at the start of each chunk
+ * gives the rotation and the translation of its tiles into the canvas.
+ *
+ * The segments are walked once instead of twice, the tiles cost about the
+ * size of the canvas in memory and a copy of each cell.
+ *
+ *  Created on: 2026-10-19
+ *      Author: francis
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "color.h"
+#include "dragon.h"
+#include "dragon_onepass.h"
+#include "tuning.h"
+
+#define TILE_SHIFT		6
+#define TILE_DIM		(1 << TILE_SHIFT)
+#define TILE_MASK		(TILE_DIM - 1)
+#define TILE_SLOTS		64
+/* tiles are carved from slabs of one huge page */
+#define TILE_SLAB		(CANVAS_ALIGN / sizeof(struct sparse_tile))
+
+struct sparse_tile {
+	int64_t tx;
+	int64_t ty;
+	char cells[TILE_DIM * TILE_DIM];
+};
+
+/* open addressing on (tx, ty), never more than half full */
+struct tile_set {
+	int len;
+	int nb_slot;
+	struct sparse_tile **slots;
+	struct sparse_tile *last;
+	int nb_slab;
+	struct sparse_tile **slabs;
+};
+
+struct onepass_chunk {
+	uint64_t start;
+	uint64_t end;
+	piece_t piece;
+	struct tile_set tiles;
+} __attribute__((aligned(128)));
+
+struct onepass_shared {
+	struct draw_data draw;
+	struct onepass_chunk *chunks;
+	int nb_chunk;
+	int error;
+};
+
+struct onepass_data {
+	int id;
+	struct onepass_shared *shared;
+	pthread_barrier_t *barrier;
+} __attribute__((aligned(128)));
+
+static inline int tile_hash(int64_t tx, int64_t ty, int nb_slot)
+{
+	uint64_t h = (uint64_t) tx * 0x9E3779B97F4A7C15ULL ^ (uint64_t) ty * 0xC2B2AE3D27D4EB4FULL;
+	return (int) ((h ^ (h >> 32)) & (nb_slot - 1));
+}
+
+static void tile_set_free(struct tile_set *set)
+{
+	int i;
+	for (i = 0; i < set->nb_slab; i++)
+		FREE(set->slabs[i]);
+	FREE(set->slabs);
+	FREE(set->slots);
+	memset(set, 0, sizeof(struct tile_set));
+}
+
+/* next unused tile, a new slab is taken when the last one is full */
+static struct sparse_tile *tile_set_new(struct tile_set *set)
+{
+	if (set->len == set->nb_slab * (int) TILE_SLAB) {
+		struct sparse_tile **slabs;
+		struct sparse_tile *slab;
+		slabs = (struct sparse_tile **) realloc(set->slabs,
+				(set->nb_slab + 1) * sizeof(struct sparse_tile *));
+		if (slabs == NULL)
+			return NULL;
+		set->slabs = slabs;
+		if (posix_memalign((void **) &slab, CANVAS_ALIGN, CANVAS_ALIGN) != 0)
+			return NULL;
+#ifdef MADV_HUGEPAGE
+		madvise(slab, CANVAS_ALIGN, MADV_HUGEPAGE);
+#endif
+		set->slabs[set->nb_slab++] = slab;
+	}
+	return &set->slabs[set->len / TILE_SLAB][set->len % TILE_SLAB];
+}
+
+static int tile_set_grow(struct tile_set *set)
+{
+	struct sparse_tile **old = set->slots;
+	int nb_old = set->nb_slot;
+	int i;
+
+	set->nb_slot = nb_old > 0 ? nb_old * 2 : TILE_SLOTS;
+	set->slots = (struct sparse_tile **) calloc(set->nb_slot, sizeof(struct sparse_tile *));
+	if (set->slots == NULL) {
+		set->slots = old;
+		set->nb_slot = nb_old;
+		return -1;
+	}
+	for (i = 0; i < nb_old; i++) {
+		struct sparse_tile *t = old[i];
+		int h;
+		if (t == NULL)
+			continue;
+		h = tile_hash(t->tx, t->ty, set->nb_slot);
+		while (set->slots[h] != NULL)
+			h = (h + 1) & (set->nb_slot - 1);
+		set->slots[h] = t;
+	}
+	FREE(old);
+	return 0;
+}
+
+/*
+ * cell (x, y) of the set, its tile is created empty if needed
+ */
+static char *tile_set_cell(struct tile_set *set, int64_t x, int64_t y)
+{
+	int64_t tx = x >> TILE_SHIFT;
+	int64_t ty = y >> TILE_SHIFT;
+	struct sparse_tile *t = set->last;
+	int h;
+
+	if (t == NULL || t->tx != tx || t->ty != ty) {
+		if (2 * (set->len + 1) > set->nb_slot && tile_set_grow(set) < 0)
+			return NULL;
+		h = tile_hash(tx, ty, set->nb_slot);
+		while ((t = set->slots[h]) != NULL && (t->tx != tx || t->ty != ty))
+			h = (h + 1) & (set->nb_slot - 1);
+		if (t == NULL) {
+			if ((t = tile_set_new(set)) == NULL)
+				return NULL;
+			t->tx = tx;
+			t->ty = ty;
+			memset(t->cells, -1, sizeof(t->cells));
+			set->slots[h] = t;
+			set->len++;
+		}
+		set->last = t;
+	}
+	return &t->cells[((y & TILE_MASK) << TILE_SHIFT) | (x & TILE_MASK)];
+}
+
+/*
+ * Walk the chunk from the origin: its piece, as piece_limit, and its cells
+ * with the colors of dragon_draw_serial, as dragon_draw_raw. The state is
+ * kept in locals, the writes to the cells could alias the piece.
+ */
+static int onepass_walk(struct onepass_chunk *chunk, uint64_t size, int nb_colors)
+{
+	xy_t position = { 0, 0 };
+	xy_t orientation = { 1, 1 };
+	limits_t limits = { { 0, 0 }, { 0, 0 } };
+	int id = chunk->start * nb_colors / size;
+	uint64_t next = (id + 1) * size / nb_colors;
+	/* current tile, its first cell is (x0, y0) */
+	char *cells = NULL;
+	int64_t x0 = 0;
+	int64_t y0 = 0;
+	uint64_t n;
+
+	for (n = chunk->start + 1; n <= chunk->end; n++) {
+		while (n > next) {
+			id++;
+			next = (id + 1) * size / nb_colors;
+		}
+		int64_t x = (position.x + (position.x + orientation.x)) >> 1;
+		int64_t y = (position.y + (position.y + orientation.y)) >> 1;
+		uint64_t dx = x - x0;
+		uint64_t dy = y - y0;
+		if (cells == NULL || (dx | dy) >= TILE_DIM) {
+			char *cell = tile_set_cell(&chunk->tiles, x, y);
+			if (cell == NULL)
+				return -1;
+			cells = chunk->tiles.last->cells;
+			x0 = x & ~(int64_t) TILE_MASK;
+			y0 = y & ~(int64_t) TILE_MASK;
+			dx = x - x0;
+			dy = y - y0;
+		}
+		cells[(dy << TILE_SHIFT) | dx] = id;
+
+		position.x += orientation.x;
+		position.y += orientation.y;
+		if (((n & -n) << 1) & n)
+			rotate_left(&orientation);
+		else
+			rotate_right(&orientation);
+		if (limits.minimums.x > position.x) limits.minimums.x = position.x;
+		if (limits.minimums.y > position.y) limits.minimums.y = position.y;
+		if (limits.maximums.x < position.x) limits.maximums.x = position.x;
+		if (limits.maximums.y < position.y) limits.maximums.y = position.y;
+	}
+	chunk->piece.position = position;
+	chunk->piece.orientation = orientation;
+	chunk->piece.limits = limits;
+	return 0;
+}
+
+/*
+ * Copy the tiles of the chunk in the canvas. The cell (x, y) is the middle
+ * of a segment, (2x + 1, 2y + 1) in doubled coordinates, rotated as the
+ * chunk start orientation and moved to the chunk start position. Only the
+ * first cell of a row is transformed, the rotation keeps the rows straight.
+ */
+static void onepass_blit(struct onepass_chunk *chunk, struct draw_data *draw)
+{
+	struct tile_set *set = &chunk->tiles;
+	xy_t ex = { 1, 0 };
+	xy_t ey = { 0, 1 };
+	xy_t orientation = { 1, 1 };
+	int64_t ox = 2 * chunk->piece.position.x;
+	int64_t oy = 2 * chunk->piece.position.y;
+	int64_t min_x = draw->limits.minimums.x;
+	int64_t min_y = draw->limits.minimums.y;
+	int width = draw->dragon_width;
+	int64_t stride;
+	int k, i, j;
+
+	while (orientation.x != chunk->piece.orientation.x ||
+			orientation.y != chunk->piece.orientation.y) {
+		rotate_left(&ex);
+		rotate_left(&ey);
+		rotate_left(&orientation);
+	}
+	/* the next cell of a row of the tile is one step along ex */
+	stride = ex.y * width + ex.x;
+
+	for (k = 0; k < set->len; k++) {
+		struct sparse_tile *t = &set->slabs[k / TILE_SLAB][k % TILE_SLAB];
+		for (i = 0; i < TILE_DIM; i++) {
+			int64_t cx = 2 * (t->tx << TILE_SHIFT) + 1;
+			int64_t cy = 2 * ((t->ty << TILE_SHIFT) + i) + 1;
+			int64_t x = ((ox + ex.x * cx + ey.x * cy) >> 1) - min_x;
+			int64_t y = ((oy + ex.y * cx + ey.y * cy) >> 1) - min_y;
+			int64_t index = y * width + x;
+			char *row = &t->cells[i << TILE_SHIFT];
+			for (j = 0; j < TILE_DIM; j++) {
+				if (row[j] >= 0)
+					draw->dragon[index + j * stride] = row[j];
+			}
+		}
+	}
+}
+
+void *dragon_onepass_worker(void *arg)
+{
+	struct onepass_data *data = (struct onepass_data *) arg;
+	struct onepass_shared *shared = data->shared;
+	struct draw_data *lData = &shared->draw;
+	int lChunks;
+	int i;
+
+	/* 1. Parcourir les morceaux du fil, limites et cellules */
+	for (i = data->id; i < shared->nb_chunk; i += lData->nb_thread) {
+		if (onepass_walk(&shared->chunks[i], lData->size, lData->nb_thread) < 0)
+			__sync_fetch_and_or(&shared->error, 1);
+	}
+
+	/*
+	 * 2. Somme prefixe exclusive des morceaux par un seul fil : chaque
+	 * morceau recoit l'etat du dragon a son debut, puis allocation de la
+	 * surface aux limites du dragon
+	 */
+	if (pthread_barrier_wait(data->barrier) == PTHREAD_BARRIER_SERIAL_THREAD &&
+			!shared->error) {
+		piece_t master;
+		piece_init(&master);
+		for (i = 0; i < shared->nb_chunk; i++) {
+			piece_t piece = shared->chunks[i].piece;
+			shared->chunks[i].piece = master;
+			piece_merge(&master, piece);
+		}
+		lData->limits = master.limits;
+		lData->dragon_width = master.limits.maximums.x - master.limits.minimums.x;
+		lData->dragon_height = master.limits.maximums.y - master.limits.minimums.y;
+		lData->dragon = (char *) canvas_alloc(lData->dragon_width * lData->dragon_height);
+		if (lData->dragon == NULL)
+			shared->error = 1;
+	}
+	pthread_barrier_wait(data->barrier);
+	if (shared->error)
+		goto done;
+
+	/* 3. Initialiser la surface */
+	uint64_t lSurface = (uint64_t) lData->dragon_width * lData->dragon_height;
+	lChunks = tuning_chunks("onepass", TUNING_CLEAR, lData->size, lData->image_width,
+			lData->image_height, lData->nb_thread, 1);
+	for (i = data->id; i < lChunks; i += lData->nb_thread)
+		init_canvas(i * lSurface / lChunks, (i + 1) * lSurface / lChunks, lData->dragon, -1);
+
+	pthread_barrier_wait(data->barrier);
+
+	/* 4. Copier les tuiles, chaque cellule du dragon est dessinee une fois */
+	for (i = data->id; i < shared->nb_chunk; i += lData->nb_thread) {
+		onepass_blit(&shared->chunks[i], lData);
+		tile_set_free(&shared->chunks[i].tiles);
+	}
+
+	pthread_barrier_wait(data->barrier);
+
+	/* 5. Effectuer le rendu final */
+	lChunks = tuning_chunks("onepass", TUNING_RENDER, lData->size, lData->image_width,
+			lData->image_height, lData->nb_thread, 1);
+	for (i = data->id; i < lChunks; i += lData->nb_thread) {
+		int lStartImage = i * lData->image_height / lChunks;
+		int lEndImage = (i + 1) * lData->image_height / lChunks;
+		scale_dragon(lStartImage, lEndImage, lData->image, lData->image_width,
+				lData->image_height, lData->dragon, lData->dragon_width,
+				lData->dragon_height, lData->palette);
+	}
+
+done:
+	return NULL;
+}
+
+int dragon_draw_onepass(char **canvas, struct rgb *image, int width, int height, uint64_t size, int nb_thread)
+{
+	pthread_t *threads = NULL;
+	pthread_barrier_t barrier;
+	struct onepass_shared shared;
+	struct onepass_data *data = NULL;
+	int barrier_init = 0;
+	int i;
+	int ret = 0;
+
+	memset(&shared, 0, sizeof(shared));
+
+	shared.draw.palette = init_palette(nb_thread);
+	if (shared.draw.palette == NULL)
+		goto err;
+
+	if (pthread_barrier_init(&barrier, NULL, nb_thread) != 0) {
+		printf("barrier init error\n");
+		goto err;
+	}
+	barrier_init = 1;
+
+	shared.draw.nb_thread = nb_thread;
+	shared.draw.image_width = width;
+	shared.draw.image_height = height;
+	shared.draw.image = image;
+	shared.draw.size = size;
+	shared.nb_chunk = tuning_chunks("onepass", TUNING_DRAW, size, width, height, nb_thread, 1);
+
+	if ((shared.chunks = calloc(shared.nb_chunk, sizeof(struct onepass_chunk))) == NULL)
+		goto err;
+	for (i = 0; i < shared.nb_chunk; i++) {
+		shared.chunks[i].start = i * size / shared.nb_chunk;
+		shared.chunks[i].end = (i + 1) * size / shared.nb_chunk;
+	}
+
+	if ((data = calloc(nb_thread, sizeof(struct onepass_data))) == NULL)
+		goto err;
+
+	if ((threads = malloc(sizeof(pthread_t) * nb_thread)) == NULL)
+		goto err;
+
+	/* 1. Lancement du calcul parallèle avec dragon_onepass_worker */
+	for (i = 0; i < nb_thread; ++i) {
+		data[i].id = i;
+		data[i].shared = &shared;
+		data[i].barrier = &barrier;
+		if (pthread_create(&threads[i], 0, &dragon_onepass_worker, &data[i]) != 0)
+			goto err;
+	}
+
+	/* 2. Attendre la fin du traitement */
+	for (i = 0; i < nb_thread; ++i) {
+		if (pthread_join(threads[i], 0) != 0)
+			goto err;
+	}
+	if (shared.error)
+		goto err;
+
+done:
+	if (barrier_init)
+		pthread_barrier_destroy(&barrier);
+	if (shared.chunks != NULL) {
+		for (i = 0; i < shared.nb_chunk; i++)
+			tile_set_free(&shared.chunks[i].tiles);
+		FREE(shared.chunks);
+	}
+	FREE(data);
+	FREE(threads);
+	free_palette(shared.draw.palette);
+	*canvas = shared.draw.dragon;
+	return ret;
+
+err:
+	CANVAS_FREE(shared.draw.dragon);
+	ret = -1;
+	goto done;
+}
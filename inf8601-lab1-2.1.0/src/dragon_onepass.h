@@ -0,0 +1,15 @@
+/*
+ * dragon_onepass.h
+ *
+ *  Created on: 2026-10-19
+ *      Author: francis
+ */
+
+#ifndef DRAGON_ONEPASS_H_
+#define DRAGON_ONEPASS_H_
+
+#include "dragon.h"
+
+int dragon_draw_onepass(char **canvas, struct rgb *image, int width, int height, uint64_t size, int nb_thread);
+
+#endif /* DRAGON_ONEPASS_H_ */
@@ -0,0 +1,325 @@
+/*
+ * dragon_opencl.cpp
+ *
+ * Dragon computed by the kernels of dragon_kernel.cl. A CPU device is
+ * preferred, so that the OpenCL compiler can be compared with the other
+ * libraries on the same machine (PoCL for instance); any other device is
+ * used when there is no CPU device. The image is rendered on the host.
+ *
+ *  Created on: 2026-10-19
+ *      Author: francis
+ */
+
+#include <iostream>
+
+extern "C" {
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "dragon.h"
+#include "color.h"
+#include "utils.h"
+}
+
+#define CL_TARGET_OPENCL_VERSION 120
+#include <CL/cl.h>
+#include "dragon_opencl.h"
+
+using namespace std;
+
+#define BUF_SIZE 1024
+#define MAGIC "!@#~"
+/* work items of a work group for the limits */
+#define CL_LIMITS_GROUP 64
+/* work groups for the limits, and work items for the draw */
+#define CL_LIMITS_GROUPS 64
+#define CL_DRAW_ITEMS 4096
+
+extern char __ocl_code_start, __ocl_code_end;
+static cl_command_queue queue = NULL;
+static cl_context context = NULL;
+static cl_program prog = NULL;
+static cl_kernel limits_kernel = NULL;
+static cl_kernel draw_kernel = NULL;
+static size_t limits_group = CL_LIMITS_GROUP;
+
+static int get_device(cl_platform_id platform, cl_device_type type, cl_device_id *device)
+{
+	cl_uint num_dev;
+	return clGetDeviceIDs(platform, type, 1, device, &num_dev) == CL_SUCCESS ? 0 : -1;
+}
+
+static int get_opencl_queue()
+{
+	cl_int ret;
+	cl_uint i;
+	cl_device_id device = NULL;
+	cl_platform_id *platform_ids = NULL;
+	cl_uint num_platforms;
+	char name[BUF_SIZE];
+
+	ret = clGetPlatformIDs(0, NULL, &num_platforms);
+	ERR_THROW(CL_SUCCESS, ret, "failed to get number of platforms");
+	ERR_ASSERT(num_platforms > 0, "no opencl platform found");
+
+	platform_ids = (cl_platform_id *) malloc(num_platforms * sizeof(cl_platform_id));
+	ERR_NOMEM(platform_ids);
+
+	ret = clGetPlatformIDs(num_platforms, platform_ids, NULL);
+	ERR_THROW(CL_SUCCESS, ret, "failed to get plateform ids");
+
+	for (i = 0; i < num_platforms && device == NULL; i++) {
+		if (get_device(platform_ids[i], CL_DEVICE_TYPE_CPU, &device) < 0)
+			device = NULL;
+	}
+	for (i = 0; i < num_platforms && device == NULL; i++) {
+		if (get_device(platform_ids[i], CL_DEVICE_TYPE_ALL, &device) < 0)
+			device = NULL;
+	}
+	ERR_ASSERT(device != NULL, "failed to find a device");
+
+#ifdef DEBUG
+	ret = clGetDeviceInfo(device, CL_DEVICE_NAME, BUF_SIZE, name, NULL);
+	ERR_THROW(CL_SUCCESS, ret, "failed to get device info");
+	cout << "opencl device " << name << "\n";
+#else
+	(void) name;
+#endif
+
+	context = clCreateContext(0, 1, &device, NULL, NULL, &ret);
+	ERR_THROW(CL_SUCCESS, ret, "failed to create context");
+
+	queue = clCreateCommandQueue(context, device, 0, &ret);
+	ERR_THROW(CL_SUCCESS, ret, "failed to create queue");
+
+	ret = 0;
+
+done:
+	FREE(platform_ids);
+	return ret;
+error:
+	ret = -1;
+	goto done;
+}
+
+/*
+ * The kernel source is embedded between __ocl_code_start and
+ * __ocl_code_end, terminated by MAGIC (see dragon_kernel_embed.S).
+ */
+static int load_kernel_code(char **code, size_t *length)
+{
+	int ret = 0;
+	int found = 0;
+	size_t kernel_size = 0;
+	size_t code_size = 0;
+	char *kernel_code = NULL;
+	char *ptr = NULL;
+	char *code_start = NULL, *code_end = NULL;
+
+	code_start = &__ocl_code_start;
+	code_end = &__ocl_code_end;
+	code_size = code_end - code_start;
+	kernel_code = (char *) malloc(code_size);
+	ERR_NOMEM(kernel_code);
+	for (ptr = code_start; ptr <= code_end - 4; ptr++) {
+		if (memcmp(ptr, MAGIC, 4) == 0) {
+			found = 1;
+			break;
+		}
+	}
+	if (found == 0)
+		goto error;
+	kernel_size = ptr - code_start;
+	memcpy(kernel_code, code_start, kernel_size);
+	*code = kernel_code;
+	*length = kernel_size;
+done:
+	return ret;
+error:
+	ret = -1;
+	FREE(kernel_code);
+	goto done;
+}
+
+/*
+ * Queue, program and kernels are created on the first call and kept for
+ * the following ones.
+ */
+static int opencl_init()
+{
+	cl_int err;
+	char *code = NULL;
+	size_t length = 0;
+	size_t max_group;
+	cl_device_id device;
+
+	if (draw_kernel != NULL)
+		return 0;
+
+	if (queue == NULL && get_opencl_queue() < 0)
+		return -1;
+	if (load_kernel_code(&code, &length) < 0)
+		return -1;
+
+	prog = clCreateProgramWithSource(context, 1, (const char **) &code, &length, &err);
+	ERR_THROW(CL_SUCCESS, err, "clCreateProgramWithSource failed");
+	err = clBuildProgram(prog, 0, NULL, NULL, NULL, NULL);
+	ERR_THROW(CL_SUCCESS, err, "clBuildProgram failed");
+	limits_kernel = clCreateKernel(prog, "dragon_limits_kernel", &err);
+	ERR_THROW(CL_SUCCESS, err, "clCreateKernel failed");
+	draw_kernel = clCreateKernel(prog, "dragon_draw_kernel", &err);
+	ERR_THROW(CL_SUCCESS, err, "clCreateKernel failed");
+
+	/* the scratch of the tree reduction has one piece per work item */
+	err = clGetCommandQueueInfo(queue, CL_QUEUE_DEVICE, sizeof(device), &device, NULL);
+	ERR_THROW(CL_SUCCESS, err, "clGetCommandQueueInfo failed");
+	err = clGetKernelWorkGroupInfo(limits_kernel, device, CL_KERNEL_WORK_GROUP_SIZE,
+			sizeof(max_group), &max_group, NULL);
+	ERR_THROW(CL_SUCCESS, err, "clGetKernelWorkGroupInfo failed");
+	while (limits_group > max_group)
+		limits_group >>= 1;
+
+	FREE(code);
+	return 0;
+error:
+	/* built again by the next call */
+	if (draw_kernel)
+		clReleaseKernel(draw_kernel);
+	if (limits_kernel)
+		clReleaseKernel(limits_kernel);
+	if (prog)
+		clReleaseProgram(prog);
+	draw_kernel = NULL;
+	limits_kernel = NULL;
+	prog = NULL;
+	FREE(code);
+	return -1;
+}
+
+int dragon_limits_opencl(limits_t *limits, uint64_t size, __attribute__((unused)) int nb_thread)
+{
+	cl_int err;
+	cl_mem output = NULL;
+	piece_t *pieces = NULL;
+	piece_t master;
+	int ret = 0;
+	int i;
+
+	if (opencl_init() < 0)
+		return -1;
+
+	size_t global_work_size = CL_LIMITS_GROUPS * limits_group;
+	size_t local_work_size = limits_group;
+	cl_ulong cl_size = size;
+	cl_ulong chunk = (size + global_work_size - 1) / global_work_size;
+
+	pieces = (piece_t *) malloc(CL_LIMITS_GROUPS * sizeof(piece_t));
+	ERR_NOMEM(pieces);
+	output = clCreateBuffer(context, CL_MEM_WRITE_ONLY,
+			CL_LIMITS_GROUPS * sizeof(piece_t), NULL, &err);
+	ERR_THROW(CL_SUCCESS, err, "clCreateBuffer failed");
+
+	/* 1. Un morceau par groupe de travail, reduit en arbre */
+	ERR_THROW(CL_SUCCESS, clSetKernelArg(limits_kernel, 0, sizeof(cl_ulong), &cl_size), "clSetKernelArg failed");
+	ERR_THROW(CL_SUCCESS, clSetKernelArg(limits_kernel, 1, sizeof(cl_ulong), &chunk), "clSetKernelArg failed");
+	ERR_THROW(CL_SUCCESS, clSetKernelArg(limits_kernel, 2, sizeof(cl_mem), &output), "clSetKernelArg failed");
+	ERR_THROW(CL_SUCCESS, clSetKernelArg(limits_kernel, 3, limits_group * sizeof(piece_t), NULL), "clSetKernelArg failed");
+	ERR_THROW(CL_SUCCESS, clEnqueueNDRangeKernel(queue, limits_kernel, 1, NULL,
+			&global_work_size, &local_work_size, 0, NULL, NULL), "clEnqueueNDRangeKernel failed");
+	ERR_THROW(CL_SUCCESS, clEnqueueReadBuffer(queue, output, CL_TRUE, 0,
+			CL_LIMITS_GROUPS * sizeof(piece_t), pieces, 0, NULL, NULL), "clEnqueueReadBuffer failed");
+
+	/* 2. Fusionner les morceaux des groupes dans l'ordre */
+	piece_init(&master);
+	for (i = 0; i < CL_LIMITS_GROUPS; i++)
+		piece_merge(&master, pieces[i]);
+	*limits = master.limits;
+
+done:
+	if (output)
+		clReleaseMemObject(output);
+	FREE(pieces);
+	return ret;
+error:
+	ret = -1;
+	goto done;
+}
+
+int dragon_draw_opencl(char **canvas, struct rgb *image, int width, int height,
+		uint64_t size, int nb_thread)
+{
+	cl_int err;
+	cl_mem output = NULL;
+	cl_mem error_flag = NULL;
+	struct palette *palette = NULL;
+	limits_t limits;
+	char *dragon = NULL;
+	char clear = -1;
+	cl_int out_of_range = 0;
+	int ret = 0;
+
+	if (dragon_limits_opencl(&limits, size, nb_thread) < 0)
+		return -1;
+
+	int dragon_width = limits.maximums.x - limits.minimums.x;
+	int dragon_height = limits.maximums.y - limits.minimums.y;
+	size_t area = (size_t) dragon_width * dragon_height;
+	size_t global_work_size = CL_DRAW_ITEMS;
+	cl_ulong cl_size = size;
+	cl_ulong chunk = (size + global_work_size - 1) / global_work_size;
+	cl_long min_x = limits.minimums.x;
+	cl_long min_y = limits.minimums.y;
+
+	palette = init_palette(nb_thread);
+	ERR_NOMEM(palette);
+	dragon = (char *) canvas_alloc(area);
+	ERR_NOMEM(dragon);
+	output = clCreateBuffer(context, CL_MEM_READ_WRITE, area, NULL, &err);
+	ERR_THROW(CL_SUCCESS, err, "clCreateBuffer failed");
+	/* set by the work items that leave the canvas */
+	error_flag = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+			sizeof(cl_int), &out_of_range, &err);
+	ERR_THROW(CL_SUCCESS, err, "clCreateBuffer failed");
+
+	/* 1. Initialiser la surface */
+	ERR_THROW(CL_SUCCESS, clEnqueueFillBuffer(queue, output, &clear, sizeof(clear),
+			0, area, 0, NULL, NULL), "clEnqueueFillBuffer failed");
+
+	/* 2. Dessiner le dragon, un morceau par item de travail */
+	ERR_THROW(CL_SUCCESS, clSetKernelArg(draw_kernel, 0, sizeof(cl_ulong), &cl_size), "clSetKernelArg failed");
+	ERR_THROW(CL_SUCCESS, clSetKernelArg(draw_kernel, 1, sizeof(cl_ulong), &chunk), "clSetKernelArg failed");
+	ERR_THROW(CL_SUCCESS, clSetKernelArg(draw_kernel, 2, sizeof(int), &nb_thread), "clSetKernelArg failed");
+	ERR_THROW(CL_SUCCESS, clSetKernelArg(draw_kernel, 3, sizeof(cl_mem), &output), "clSetKernelArg failed");
+	ERR_THROW(CL_SUCCESS, clSetKernelArg(draw_kernel, 4, sizeof(int), &dragon_width), "clSetKernelArg failed");
+	ERR_THROW(CL_SUCCESS, clSetKernelArg(draw_kernel, 5, sizeof(int), &dragon_height), "clSetKernelArg failed");
+	ERR_THROW(CL_SUCCESS, clSetKernelArg(draw_kernel, 6, sizeof(cl_long), &min_x), "clSetKernelArg failed");
+	ERR_THROW(CL_SUCCESS, clSetKernelArg(draw_kernel, 7, sizeof(cl_long), &min_y), "clSetKernelArg failed");
+	ERR_THROW(CL_SUCCESS, clSetKernelArg(draw_kernel, 8, sizeof(cl_mem), &error_flag), "clSetKernelArg failed");
+	ERR_THROW(CL_SUCCESS, clEnqueueNDRangeKernel(queue, draw_kernel, 1, NULL,
+			&global_work_size, NULL, 0, NULL, NULL), "clEnqueueNDRangeKernel failed");
+	ERR_THROW(CL_SUCCESS, clEnqueueReadBuffer(queue, output, CL_TRUE, 0, area,
+			dragon, 0, NULL, NULL), "clEnqueueReadBuffer failed");
+	ERR_THROW(CL_SUCCESS, clEnqueueReadBuffer(queue, error_flag, CL_TRUE, 0,
+			sizeof(cl_int), &out_of_range, 0, NULL, NULL), "clEnqueueReadBuffer failed");
+	if (out_of_range) {
+		printf("index is out of range\n");
+		goto error;
+	}
+
+	/* 3. Effectuer le rendu final */
+	scale_dragon(0, height, image, width, height, dragon, dragon_width,
+			dragon_height, palette);
+
+done:
+	if (output)
+		clReleaseMemObject(output);
+	if (error_flag)
+		clReleaseMemObject(error_flag);
+	free_palette(palette);
+	*canvas = dragon;
+	return ret;
+error:
+	CANVAS_FREE(dragon);
+	ret = -1;
+	goto done;
+}
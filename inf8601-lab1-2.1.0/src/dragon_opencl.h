@@ -0,0 +1,22 @@
+/*
+ * dragon_opencl.h
+ *
+ *  Created on: 2026-10-19
+ *      Author: francis
+ */
+
+#ifndef DRAGON_OPENCL_H_
+#define DRAGON_OPENCL_H_
+
+#include "dragon.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+int dragon_draw_opencl(char **canvas, struct rgb *image, int width, int height, uint64_t size, int nb_thread);
+int dragon_limits_opencl(limits_t *limits, uint64_t size, int nb_thread);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DRAGON_OPENCL_H_ */
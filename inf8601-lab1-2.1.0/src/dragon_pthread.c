@@ -11,10 +11,12 @@
 #include <stdarg.h>
 #include <string.h>
 
+#include "config.h"
 #include "utils.h"
 #include "color.h"
 #include "dragon.h"
 #include "dragon_pthread.h"
+#include "tuning.h"
 
 pthread_mutex_t mutex_stdout;
 
@@ -29,33 +31,120 @@ void printf_safe(char *format, ...)
 	va_end(ap);
 }
 
+struct limit_worker {
+	int id;
+	int nb_thread;
+	int nb_chunk;
+	struct limit_data *chunks;
+};
+
+void *dragon_limit_worker(void *data)
+{
+	struct limit_worker *worker = (struct limit_worker *) data;
+	int i;
+	for (i = worker->id; i < worker->nb_chunk; i += worker->nb_thread) {
+		struct limit_data *lim = &worker->chunks[i];
+		piece_init(&lim->piece);
+		piece_limit(lim->start, lim->end, &lim->piece);
+	}
+	return NULL;
+}
+
+/*
+ * Pieces of nb_chunk consecutive chunks of the dragon, each one computed
+ * from the origin by nb_thread threads. The caller must free the chunks.
+ */
+static struct limit_data *limits_chunks(uint64_t size, int nb_chunk, int nb_thread)
+{
+	pthread_t *threads = NULL;
+	struct limit_worker *workers = NULL;
+	struct limit_data *thread_data = NULL;
+	int i;
+
+	if ((threads = calloc(nb_thread, sizeof(pthread_t))) == NULL)
+		goto err;
+
+	if ((workers = calloc(nb_thread, sizeof(struct limit_worker))) == NULL)
+		goto err;
+
+	if ((thread_data = calloc(nb_chunk, sizeof(struct limit_data))) == NULL)
+		goto err;
+
+	/* 1. Lancement du calcul en parallèle avec dragon_limit_worker */
+	for (i = 0; i < nb_chunk; ++i) {
+		thread_data[i].id = i;
+		thread_data[i].start = i * size / nb_chunk;
+		thread_data[i].end = (i + 1) * size / nb_chunk;
+	}
+	for (i = 0; i < nb_thread; ++i) {
+		workers[i].id = i;
+		workers[i].nb_thread = nb_thread;
+		workers[i].nb_chunk = nb_chunk;
+		workers[i].chunks = thread_data;
+		if (pthread_create(&threads[i], 0, &dragon_limit_worker, &workers[i]) != 0) {
+			goto err;
+		}
+	}
+
+	/* 2. Attendre la fin du traitement */
+	for (i = 0; i < nb_thread; ++i) {
+		if (pthread_join(threads[i], NULL) != 0) {
+			goto err;
+		}
+	}
+
+done:
+	FREE(threads);
+	FREE(workers);
+	return thread_data;
+err:
+	FREE(thread_data);
+	goto done;
+}
+
 void *dragon_draw_worker(void *data)
 {
 	struct draw_data *lData = (struct draw_data*) data;
 	if (lData) {
+		int i;
+		int lChunks;
+		int lWidth = lData->image_width;
+		int lHeight = lData->image_height;
+		uint64_t lSize = lData->size;
+
 		/* 1. Initialiser la surface */
-		uint64_t lSurfaceStep = (lData->dragon_width * lData->dragon_height) / lData->nb_thread;
-		int lSurfaceStart = lData->id * lSurfaceStep;
-		int lSurfaceEnd = (lData->id + 1) * lSurfaceStep;
-		init_canvas(lSurfaceStart, lSurfaceEnd, lData->dragon, -1);
+		uint64_t lSurface = (uint64_t) lData->dragon_width * lData->dragon_height;
+		lChunks = tuning_chunks("pthread", TUNING_CLEAR, lSize, lWidth, lHeight, lData->nb_thread, 1);
+		for (i = lData->id; i < lChunks; i += lData->nb_thread) {
+			int lSurfaceStart = i * lSurface / lChunks;
+			int lSurfaceEnd = (i + 1) * lSurface / lChunks;
+			init_canvas(lSurfaceStart, lSurfaceEnd, lData->dragon, -1);
+		}
 
 		pthread_barrier_wait((lData->barrier));
 
-		/* 2. Dessiner le dragon */
-		uint64_t lDragonStep = lData->size / (uint64_t) lData->nb_thread;
-		uint64_t lStartDragon = lData->id * lDragonStep;
-		uint64_t lStopDragon = (lData->id + 1) * lDragonStep;
-		dragon_draw_raw(lStartDragon, lStopDragon, lData->dragon, lData->dragon_width, lData->dragon_height, lData->limits, lData->id);
-
-		printf_safe("draw_data id :=  %i, tid := %i , lStartDragon := %lu, lStopDragon := %lu\n", 0, gettid(), lStartDragon, lStopDragon);
+		/*
+		 * 2. Dessiner le dragon, chaque morceau part de la position et de
+		 * l'orientation gardees par le calcul des limites
+		 */
+		for (i = lData->id; i < lData->nb_chunk; i += lData->nb_thread) {
+			struct limit_data *lChunk = &lData->chunks[i];
+			piece_t lStart = lChunk->piece;
+			dragon_draw_colors(lChunk->start, lChunk->end, &lStart, lData->dragon, lData->dragon_width, lData->dragon_height, lData->limits, lSize, lData->nb_thread);
+#ifdef DEBUG
+			printf_safe("draw_data id :=  %i, tid := %i , lStartDragon := %lu, lStopDragon := %lu\n", lData->id, gettid(), lChunk->start, lChunk->end);
+#endif
+		}
 
 		pthread_barrier_wait((lData->barrier));
 
 		/* 3. Effectuer le rendu final */
-		uint64_t lImageStep = lData->image_height / lData->nb_thread;
-		uint64_t lStartImage = lData->id * lImageStep;
-		uint64_t lEndImage = (lData->id + 1) * lImageStep;
-		scale_dragon(lStartImage, lEndImage, lData->image, lData->image_width, lData->image_height, lData->dragon, lData->dragon_width, lData->dragon_height, lData->palette);
+		lChunks = tuning_chunks("pthread", TUNING_RENDER, lSize, lWidth, lHeight, lData->nb_thread, 1);
+		for (i = lData->id; i < lChunks; i += lData->nb_thread) {
+			int lStartImage = i * lHeight / lChunks;
+			int lEndImage = (i + 1) * lHeight / lChunks;
+			scale_dragon(lStartImage, lEndImage, lData->image, lData->image_width, lData->image_height, lData->dragon, lData->dragon_width, lData->dragon_height, lData->palette);
+		}
 	}
 
 	return NULL;
@@ -66,12 +155,16 @@ int dragon_draw_pthread(char **canvas, struct rgb *image, int width, int height,
 	pthread_t *threads = NULL;
 	pthread_barrier_t barrier;
 	limits_t limits;
+	int i;
 	struct draw_data info;
 	char *dragon = NULL;
 	int scale_x;
 	int scale_y;
 	struct draw_data *data = NULL;
 	struct palette *palette = NULL;
+	struct limit_data *chunks = NULL;
+	piece_t master;
+	int nb_chunk;
 	int ret = 0;
 
 	palette = init_palette(nb_thread);
@@ -83,14 +176,30 @@ int dragon_draw_pthread(char **canvas, struct rgb *image, int width, int height,
 		goto err;
 	}
 
-	/* 1. Calculer les limites du dragon */
-	if (dragon_limits_pthread(&limits, size, nb_thread) < 0)
+	/*
+	 * 1. Calculer les limites du dragon, les morceaux sont gardes pour
+	 * le dessin avec le meme decoupage
+	 */
+	nb_chunk = tuning_chunks("pthread", TUNING_DRAW, size, width, height, nb_thread, 1);
+	if ((chunks = limits_chunks(size, nb_chunk, nb_thread)) == NULL)
 		goto err;
 
+	/*
+	 * Somme prefixe exclusive des morceaux : chaque morceau devient
+	 * l'etat du dragon au debut de son intervalle
+	 */
+	piece_init(&master);
+	for (i = 0; i < nb_chunk; ++i) {
+		piece_t piece = chunks[i].piece;
+		chunks[i].piece = master;
+		piece_merge(&master, piece);
+	}
+	limits = master.limits;
+
 	info.dragon_width = limits.maximums.x - limits.minimums.x;
 	info.dragon_height = limits.maximums.y - limits.minimums.y;
 
-	if ((dragon = (char *) malloc(info.dragon_width * info.dragon_height)) == NULL) {
+	if ((dragon = (char *) canvas_alloc(info.dragon_width * info.dragon_height)) == NULL) {
 		printf("malloc error dragon\n");
 		goto err;
 	}
@@ -119,11 +228,12 @@ int dragon_draw_pthread(char **canvas, struct rgb *image, int width, int height,
 	info.limits = limits;
 	info.barrier = &barrier;
 	info.palette = palette;
+	info.chunks = chunks;
+	info.nb_chunk = nb_chunk;
 	info.dragon = dragon;
 	info.image = image;
 
 	/* 2. Lancement du calcul parallèle principal avec draw_dragon_worker */
-	int i;
 	for (i = 0; i < nb_thread; ++i) {
 		data[i] = info;
 		data[i].id = i;
@@ -147,73 +257,40 @@ int dragon_draw_pthread(char **canvas, struct rgb *image, int width, int height,
 done:
 	FREE(data);
 	FREE(threads);
+	FREE(chunks);
 	free_palette(palette);
 	*canvas = dragon;
 	return ret;
 
 err:
-	FREE(dragon);
+	CANVAS_FREE(dragon);
 	ret = -1;
 	goto done;
 }
 
-void *dragon_limit_worker(void *data)
-{
-	struct limit_data *lim = (struct limit_data *) data;
-	piece_init(&lim->piece);
-	piece_limit(lim->start, lim->end, &lim->piece);
-	return NULL;
-}
-
 /*
  * Calcule les limites en terme de largeur et de hauteur de
  * la forme du dragon. Requis pour allouer la matrice de dessin.
  */
 int dragon_limits_pthread(limits_t *limits, uint64_t size, int nb_thread)
 {
-	int ret = 0;
-	pthread_t *threads = NULL;
 	struct limit_data *thread_data = NULL;
 	piece_t master;
+	int nb_chunk;
+	int i;
 
 	piece_init(&master);
 
-	if ((threads = calloc(nb_thread, sizeof(pthread_t))) == NULL)
-		goto err;
-
-	if ((thread_data = calloc(nb_thread, sizeof(struct limit_data))) == NULL)
-		goto err;
-
-	/* 1. Lancement du calcul en parallèle avec dragon_limit_worker */
-	int i;
-	double lStep =  size / nb_thread;
-	for (i = 0; i < nb_thread; ++i) {
-		thread_data[i].id = i;
-		thread_data[i].start = i * lStep;
-		thread_data[i].end = (i + 1) * lStep;
-		if (pthread_create(&threads[i], 0, &dragon_limit_worker, &thread_data[i]) != 0) {
-			goto err;
-		}
-	}
-
-	/* 2. Attendre la fin du traitement */
-	for (i = 0; i < nb_thread; ++i) {
-		if (pthread_join(threads[i], NULL) != 0) {
-			goto err;
-		}
-	}
+	nb_chunk = tuning_chunks("pthread", TUNING_LIMITS, size, 0, 0, nb_thread, 1);
+	if ((thread_data = limits_chunks(size, nb_chunk, nb_thread)) == NULL)
+		return -1;
 
-	/* 3. Fusion des pièces */
-	for (i = 0; i < nb_thread; ++i) {
+	/* 3. Fusion des pièces, dans l'ordre */
+	for (i = 0; i < nb_chunk; ++i) {
 		piece_merge(&master, thread_data[i].piece);
 	}
 
-done:
-	FREE(threads);
 	FREE(thread_data);
 	*limits = master.limits;
-	return ret;
-err:
-	ret = -1;
-	goto done;
+	return 0;
 }
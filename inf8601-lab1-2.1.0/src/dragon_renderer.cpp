@@ -0,0 +1,278 @@
+/*
+ * dragon_renderer.cpp
+ *
+ * Each job is enqueued as a task of the shared arena, no thread is made
+ * for it: the workers of the arena go to the jobs that have chunks left,
+ * and the result is handed to the future of the job. A job cuts
+ * the dragon in chunks as dragon_draw_tbb, computes their pieces, scans
+ * them in order to get the start of each chunk, then draws and renders.
+ * The cancel flag is checked before each chunk and each row.
+ *
+ *  Created on: 2026-10-19
+ *      Author: francis
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include "config.h"
+#include "dragon.h"
+#include "color.h"
+#include "tuning.h"
+}
+#include "dragon_renderer.h"
+#include "tbb/tbb.h"
+
+using namespace std;
+using namespace tbb;
+
+/* chunks per thread, the granularity of the cancellation */
+#define RENDERER_CHUNKS_PER_THREAD 16
+/* renderers kept by dragon_draw_async, each has its arena */
+#define RENDERERS_MAX 4
+
+struct PaletteDeleter {
+	void operator()(struct palette *palette) const {
+		free_palette(palette);
+	}
+};
+
+/* no thread joins the arena, all its slots are for the workers */
+DragonRenderer::DragonRenderer(int nb_thread) :
+		aArena(nb_thread, 0), aThreads(nb_thread) {
+}
+
+DragonJob DragonRenderer::submit(uint64_t size, int width, int height,
+		int nb_colors) {
+	DragonJob job;
+	int nb_chunk = aThreads * RENDERER_CHUNKS_PER_THREAD;
+
+	job.aState = make_shared<DragonJobState>();
+	job.aState->cancelled = false;
+	job.aState->done = 0;
+	job.aState->total = 2 * nb_chunk + height;
+
+	shared_ptr<DragonJobState> state = job.aState;
+	shared_ptr<promise<DragonImage> > result = make_shared<promise<DragonImage> >();
+	job.aFuture = result->get_future();
+	aArena.enqueue([this, state, result, size, width, height, nb_colors] {
+		try {
+			result->set_value(render(state.get(), size, width, height,
+					nb_colors));
+		} catch (...) {
+			result->set_exception(current_exception());
+		}
+	});
+	return job;
+}
+
+static void check_cancel(DragonJobState *state) {
+	if (state->cancelled)
+		throw DragonCancelled();
+}
+
+DragonImage DragonRenderer::render(DragonJobState *state, uint64_t size,
+		int width, int height, int nb_colors) {
+	DragonImage result;
+	int nb_chunk = aThreads * RENDERER_CHUNKS_PER_THREAD;
+	vector<limit_data> chunks(nb_chunk);
+
+	if (nb_colors <= 0 || width <= 0 || height <= 0)
+		throw invalid_argument("dragon render: bad colors or resolution");
+	unique_ptr<struct palette, PaletteDeleter> palette(init_palette(nb_colors));
+	if (!palette)
+		throw bad_alloc();
+
+	for (int i = 0; i < nb_chunk; ++i) {
+		chunks[i].id = i;
+		chunks[i].start = i * size / nb_chunk;
+		chunks[i].end = (i + 1) * size / nb_chunk;
+	}
+
+	/* 1. Calculer le morceau de chaque intervalle */
+	aArena.execute([&] {
+		parallel_for(0, nb_chunk, [&](int i) {
+			if (state->cancelled)
+				return;
+			piece_init(&chunks[i].piece);
+			piece_limit(chunks[i].start, chunks[i].end, &chunks[i].piece);
+			state->done++;
+		});
+	});
+	check_cancel(state);
+
+	/* 2. Somme prefixe exclusive : l'etat du dragon au debut de chaque morceau */
+	piece_t master;
+	piece_init(&master);
+	for (int i = 0; i < nb_chunk; ++i) {
+		piece_t piece = chunks[i].piece;
+		chunks[i].piece = master;
+		piece_merge(&master, piece);
+	}
+
+	result.limits = master.limits;
+	result.size = size;
+	result.width = width;
+	result.height = height;
+	result.dragon_width = master.limits.maximums.x - master.limits.minimums.x;
+	result.dragon_height = master.limits.maximums.y - master.limits.minimums.y;
+	int64_t surface = (int64_t) result.dragon_width * result.dragon_height;
+	result.canvas.reset((char *) canvas_alloc(surface));
+	result.image.reset(make_canvas(width, height));
+	if (!result.canvas || !result.image)
+		throw bad_alloc();
+
+	char *dragon = result.canvas.get();
+	struct rgb *image = result.image.get();
+	aArena.execute([&] {
+		/* 3. Initialiser la surface */
+		parallel_for(0, nb_chunk, [&](int i) {
+			init_canvas(i * surface / nb_chunk, (i + 1) * surface / nb_chunk,
+					dragon, -1);
+		});
+
+		/* 4. Dessiner chaque morceau depuis son etat initial */
+		parallel_for(0, nb_chunk, [&](int i) {
+			if (state->cancelled)
+				return;
+			piece_t start = chunks[i].piece;
+			dragon_draw_colors(chunks[i].start, chunks[i].end, &start, dragon,
+					result.dragon_width, result.dragon_height, result.limits,
+					size, nb_colors);
+			state->done++;
+		});
+		if (state->cancelled)
+			return;
+
+		/* 5. Effectuer le rendu final */
+		parallel_for(0, height, [&](int y) {
+			if (state->cancelled)
+				return;
+			scale_dragon(y, y + 1, image, width, height, dragon,
+					result.dragon_width, result.dragon_height, palette.get());
+			state->done++;
+		});
+	});
+	check_cancel(state);
+	return result;
+}
+
+/*
+ * Renderers of dragon_draw_async, one per number of threads. At most
+ * RENDERERS_MAX are kept, the least recently used is dropped for a new
+ * one. A caller holds its renderer until its job is done, so a renderer
+ * dropped while in use is freed by its last caller.
+ */
+struct RendererEntry {
+	shared_ptr<DragonRenderer> renderer;
+	uint64_t last_use;
+};
+
+static mutex renderers_lock;
+static map<int, RendererEntry> renderers;
+static uint64_t renderers_clock;
+
+static shared_ptr<DragonRenderer> get_renderer(int nb_thread) {
+	lock_guard<mutex> guard(renderers_lock);
+	map<int, RendererEntry>::iterator it = renderers.find(nb_thread);
+	if (it == renderers.end()) {
+		if (renderers.size() >= RENDERERS_MAX) {
+			map<int, RendererEntry>::iterator lru = renderers.begin();
+			for (map<int, RendererEntry>::iterator e = renderers.begin();
+					e != renderers.end(); ++e) {
+				if (e->second.last_use < lru->second.last_use)
+					lru = e;
+			}
+			renderers.erase(lru);
+		}
+		it = renderers.insert(make_pair(nb_thread, RendererEntry())).first;
+		it->second.renderer = make_shared<DragonRenderer>(nb_thread);
+	}
+	it->second.last_use = ++renderers_clock;
+	return it->second.renderer;
+}
+
+/*
+ * Drop the renderers, those still drawing are freed by their caller.
+ */
+void dragon_renderer_free(void) {
+	lock_guard<mutex> guard(renderers_lock);
+	renderers.clear();
+}
+
+/*
+ * Blocking draw on the shared renderer, reentrant. The canvas is moved to
+ * the caller, the image is copied in the buffer of the caller.
+ */
+int dragon_draw_async(char **canvas, struct rgb *image, int width, int height,
+		uint64_t size, int nb_thread) {
+	*canvas = NULL;
+	if (nb_thread <= 0)
+		return -1;
+	try {
+		shared_ptr<DragonRenderer> renderer = get_renderer(nb_thread);
+		DragonJob job = renderer->submit(size, width, height, nb_thread);
+		DragonImage result = job.get();
+		memcpy(image, result.image.get(), sizeof(struct rgb) * width * height);
+		*canvas = result.canvas.release();
+	} catch (exception& e) {
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Cancel a job in the middle of its draw: its progress never goes back,
+ * stays within [0, 1], and the job ends cancelled, or done when it was
+ * faster than the cancel. Returns -1 on failure.
+ */
+int dragon_renderer_check(uint64_t size, int width, int height,
+		int nb_thread) {
+	double last = 0;
+	int cancelled = 0;
+
+	if (nb_thread <= 0)
+		return -1;
+	/* the pieces are the first nb_chunk of the 2 * nb_chunk + height steps */
+	int nb_chunk = nb_thread * RENDERER_CHUNKS_PER_THREAD;
+	double drawing = (double) nb_chunk / (2 * nb_chunk + height);
+	try {
+		shared_ptr<DragonRenderer> renderer = get_renderer(nb_thread);
+		DragonJob job = renderer->submit(size, width, height, nb_thread);
+		for (;;) {
+			double progress = job.progress();
+			if (progress < last || progress > 1) {
+				printf("progress went from %f to %f\n", last, progress);
+				job.cancel();
+				job.future().wait();
+				return -1;
+			}
+			last = progress;
+			if (!cancelled && progress > drawing) {
+				job.cancel();
+				cancelled = 1;
+			}
+			if (job.future().wait_for(chrono::seconds(0)) ==
+					future_status::ready)
+				break;
+			this_thread::yield();
+		}
+		if (job.progress() < last)
+			return -1;
+		job.get();
+	} catch (DragonCancelled& e) {
+		return 0;
+	} catch (exception& e) {
+		printf("Error: %s\n", e.what());
+		return -1;
+	}
+	return 0;
+}
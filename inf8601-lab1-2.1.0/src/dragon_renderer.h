@@ -0,0 +1,126 @@
+/*
+ * dragon_renderer.h
+ *
+ * Asynchronous renders of the dragon on a shared TBB arena. submit()
+ * returns at once with a DragonJob: a future of the result, its progress
+ * and a way to cancel it between two chunks. The canvas and the image of
+ * the result are moved to the caller, never copied.
+ *
+ *  Created on: 2026-10-19
+ *      Author: francis
+ */
+
+#ifndef DRAGON_RENDERER_H_
+#define DRAGON_RENDERER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include "dragon.h"
+int dragon_draw_async(char **canvas, struct rgb *image, int width, int height, uint64_t size, int nb_thread);
+int dragon_renderer_check(uint64_t size, int width, int height, int nb_thread);
+void dragon_renderer_free(void);
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef __cplusplus
+
+#include <atomic>
+#include <exception>
+#include <future>
+#include <memory>
+#include "tbb/task_arena.h"
+
+struct CanvasDeleter {
+	void operator()(void *ptr) const {
+		canvas_free(ptr);
+	}
+};
+
+typedef std::unique_ptr<char[], CanvasDeleter> CanvasPtr;
+typedef std::unique_ptr<struct rgb[], CanvasDeleter> ImagePtr;
+
+struct DragonImage {
+	CanvasPtr canvas;
+	ImagePtr image;
+	limits_t limits;
+	int dragon_width;
+	int dragon_height;
+	int width;
+	int height;
+	uint64_t size;
+};
+
+class DragonCancelled : public std::exception {
+public:
+	const char *what() const noexcept {
+		return "dragon render cancelled";
+	}
+};
+
+/* shared by a job and the thread rendering it */
+struct DragonJobState {
+	std::atomic<bool> cancelled;
+	std::atomic<uint64_t> done;
+	uint64_t total;
+};
+
+class DragonJob {
+public:
+	DragonJob() {}
+	DragonJob(DragonJob&&) = default;
+	DragonJob& operator=(DragonJob&&) = default;
+
+	/* wait for the result, throws DragonCancelled after cancel() */
+	DragonImage get() {
+		return aFuture.get();
+	}
+
+	std::future<DragonImage>& future() {
+		return aFuture;
+	}
+
+	/* stop at the end of the chunks being drawn */
+	void cancel() {
+		aState->cancelled = true;
+	}
+
+	/* fraction of the chunks and rows done, from 0 to 1 */
+	double progress() const {
+		if (aState->total == 0)
+			return 0;
+		return (double) aState->done / aState->total;
+	}
+
+private:
+	friend class DragonRenderer;
+	std::shared_ptr<DragonJobState> aState;
+	std::future<DragonImage> aFuture;
+};
+
+/*
+ * Reentrant, several jobs share the threads of the arena. The renderer
+ * must outlive its jobs.
+ */
+class DragonRenderer {
+public:
+	DragonRenderer(int nb_thread);
+
+	DragonJob submit(uint64_t size, int width, int height, int nb_colors);
+
+	int threads() const {
+		return aThreads;
+	}
+
+private:
+	DragonImage render(DragonJobState *state, uint64_t size, int width,
+			int height, int nb_colors);
+
+	tbb::task_arena aArena;
+	int aThreads;
+};
+
+#endif /* __cplusplus */
+
+#endif /* DRAGON_RENDERER_H_ */
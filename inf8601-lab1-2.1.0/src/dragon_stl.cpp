@@ -0,0 +1,161 @@
+/*
+ * dragon_stl.cpp
+ *
+ * Dragon drawn with the C++17 parallel algorithms. The partitioning and
+ * the scheduling are left to the standard library backend (TBB with
+ * libstdc++, OpenMP with other vendors).
+ *
+ *  Created on: 2026-10-19
+ *      Author: francis
+ */
+
+#include <algorithm>
+#include <execution>
+#include <numeric>
+#include <vector>
+
+extern "C" {
+#include "dragon.h"
+#include "color.h"
+#include "tuning.h"
+}
+#include "dragon_stl.h"
+
+using namespace std;
+
+/* number of pieces per thread, gives some room to the load balancer */
+#define STL_PIECES_PER_THREAD 4
+
+struct span {
+	uint64_t start;
+	uint64_t end;
+	char id;
+};
+
+/*
+ * Split [0, size) in nb_pieces contiguous spans.
+ */
+static vector<span> make_spans(uint64_t size, int nb_pieces)
+{
+	vector<span> spans(nb_pieces);
+	for (int i = 0; i < nb_pieces; i++) {
+		spans[i].start = i * size / nb_pieces;
+		spans[i].end = (i + 1) * size / nb_pieces;
+		spans[i].id = 0;
+	}
+	return spans;
+}
+
+static piece_t span_piece(const span& s)
+{
+	piece_t piece;
+	piece_init(&piece);
+	piece_limit(s.start, s.end, &piece);
+	return piece;
+}
+
+static piece_t span_merge(piece_t m1, const piece_t& m2)
+{
+	piece_merge(&m1, m2);
+	return m1;
+}
+
+int dragon_draw_stl(char **canvas, struct rgb *image, int width, int height,
+		uint64_t size, int nb_thread)
+{
+	limits_t limits;
+	char *dragon = NULL;
+	int dragon_width;
+	int dragon_height;
+	int dragon_surface;
+
+	struct palette *palette = init_palette(nb_thread);
+	if (palette == NULL)
+		return -1;
+
+	/* 1. Calculer les limites du dragon */
+	if (dragon_limits_stl(&limits, size, nb_thread) < 0)
+		goto err;
+
+	dragon_width = limits.maximums.x - limits.minimums.x;
+	dragon_height = limits.maximums.y - limits.minimums.y;
+	dragon_surface = dragon_width * dragon_height;
+
+	dragon = (char *) canvas_alloc(dragon_surface);
+	if (dragon == NULL)
+		goto err;
+
+	{
+		/* 2. Initialiser la surface */
+		fill(execution::par_unseq, dragon, dragon + dragon_surface, -1);
+
+		/*
+		 * 3. Dessiner le dragon : chaque couleur est decoupee en
+		 * morceaux, le dessin d'un morceau ne depend que de son debut
+		 */
+		int pieces = tuning_chunks("stl", TUNING_DRAW, size, width, height,
+				nb_thread, STL_PIECES_PER_THREAD) / nb_thread;
+		vector<span> draw(nb_thread * pieces);
+		for (int i = 0; i < nb_thread; i++) {
+			uint64_t start = i * size / nb_thread;
+			uint64_t end = (i + 1) * size / nb_thread;
+			for (int j = 0; j < pieces; j++) {
+				span& s = draw[i * pieces + j];
+				s.start = start + j * (end - start) / pieces;
+				s.end = start + (j + 1) * (end - start) / pieces;
+				s.id = i;
+			}
+		}
+		for_each(execution::par, draw.begin(), draw.end(),
+				[&](const span& s) {
+			dragon_draw_raw(s.start, s.end, dragon, dragon_width,
+					dragon_height, limits, s.id);
+		});
+
+		/* 4. Effectuer le rendu final par bandes de lignes */
+		vector<span> bands = make_spans(height, tuning_chunks("stl",
+				TUNING_RENDER, size, width, height, nb_thread,
+				STL_PIECES_PER_THREAD));
+		for_each(execution::par, bands.begin(), bands.end(),
+				[&](const span& s) {
+			scale_dragon(s.start, s.end, image, width, height, dragon,
+					dragon_width, dragon_height, palette);
+		});
+	}
+
+	free_palette(palette);
+	*canvas = dragon;
+	return 0;
+
+err:
+	free_palette(palette);
+	CANVAS_FREE(dragon);
+	*canvas = NULL;
+	return -1;
+}
+
+/*
+ * Calcule les limites en terme de largeur et de hauteur de
+ * la forme du dragon. Requis pour allouer la matrice de dessin.
+ *
+ * piece_merge est associative mais pas commutative, alors que
+ * transform_reduce peut reordonner ses operandes : les morceaux sont
+ * calcules en parallele, puis fusionnes dans l'ordre.
+ */
+int dragon_limits_stl(limits_t *limits, uint64_t size, int nb_thread)
+{
+	if (nb_thread <= 0)
+		return -1;
+
+	vector<span> spans = make_spans(size, tuning_chunks("stl", TUNING_LIMITS,
+			size, 0, 0, nb_thread, STL_PIECES_PER_THREAD));
+	vector<piece_t> pieces(spans.size());
+	transform(execution::par, spans.begin(), spans.end(), pieces.begin(),
+			span_piece);
+
+	piece_t master;
+	piece_init(&master);
+	master = accumulate(pieces.begin(), pieces.end(), master, span_merge);
+	*limits = master.limits;
+	return 0;
+}
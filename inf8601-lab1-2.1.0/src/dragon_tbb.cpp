@@ -6,19 +6,121 @@
  */
 
 #include <iostream>
+#include <mutex>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
 
 extern "C" {
+#include "config.h"
 #include "dragon.h"
 #include "color.h"
 #include "utils.h"
+#include "tuning.h"
 }
 #include "dragon_tbb.h"
 #include "tbb/tbb.h"
+#include "tbb/task_arena.h"
+#include "tbb/task_scheduler_observer.h"
 #include "TidMap.h"
 
 using namespace std;
 using namespace tbb;
 
+static int tbb_pin = 0;
+
+/*
+ * Pin each thread of the arena on a core given by its slot, the mask of
+ * the thread is restored when it leaves the arena.
+ */
+class PinObserver : public task_scheduler_observer {
+public:
+	PinObserver(task_arena& arena) : task_scheduler_observer(arena) {
+		observe(true);
+	}
+
+	~PinObserver() {
+		observe(false);
+	}
+
+	void on_scheduler_entry(bool) {
+		cpu_set_t set;
+		int slot = this_task_arena::current_thread_index();
+		int nb_cpu = sysconf(_SC_NPROCESSORS_ONLN);
+		if (slot < 0 || nb_cpu <= 0)
+			return;
+		pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &aSaved);
+		CPU_ZERO(&set);
+		CPU_SET(slot % nb_cpu, &set);
+		pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set);
+	}
+
+	void on_scheduler_exit(bool) {
+		pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &aSaved);
+	}
+
+private:
+	static thread_local cpu_set_t aSaved;
+};
+
+thread_local cpu_set_t PinObserver::aSaved;
+
+/*
+ * Arena kept from one call to the next while the number of threads does
+ * not change. The affinity partitioners remember on which thread each
+ * chunk ran, the next passes over the same ranges replay it.
+ */
+struct TbbContext {
+	TbbContext(int nb_thread) : arena(nb_thread), observer(NULL) {
+		arena.initialize();
+		if (tbb_pin)
+			observer = new PinObserver(arena);
+	}
+
+	~TbbContext() {
+		delete observer;
+	}
+
+	task_arena arena;
+	PinObserver *observer;
+	affinity_partitioner limits;
+	affinity_partitioner chunks;
+	affinity_partitioner clear;
+	affinity_partitioner render;
+};
+
+/*
+ * The context is replaced when the number of threads or the pinning
+ * changes, and its partitioners cannot be shared by two passes: a call
+ * holds tbb_lock from tbb_get_context() to its end.
+ */
+static mutex tbb_lock;
+static TbbContext *tbb_context = NULL;
+
+static TbbContext *tbb_get_context(int nb_thread) {
+	if (tbb_context != NULL &&
+			(tbb_context->arena.max_concurrency() != nb_thread ||
+			(tbb_context->observer != NULL) != (tbb_pin != 0))) {
+		delete tbb_context;
+		tbb_context = NULL;
+	}
+	if (tbb_context == NULL)
+		tbb_context = new TbbContext(nb_thread);
+	return tbb_context;
+}
+
+void dragon_tbb_pin(int enable) {
+	tbb_pin = enable;
+}
+
+/*
+ * grain size giving about chunks blocks over total, never 0
+ */
+static size_t tbb_grainsize(uint64_t total, int chunks) {
+	size_t grainsize = total / chunks;
+	return grainsize > 0 ? grainsize : 1;
+}
+
 class DragonLimits {
 public:
 	DragonLimits() {
@@ -45,6 +147,69 @@ private:
 	piece_t aPiece;
 };
 
+class DragonPieces {
+public:
+	DragonPieces(struct limit_data *chunks) {
+		aChunks = chunks;
+	}
+
+	void operator()(const blocked_range<int>& range) const {
+		for (int i = range.begin(); i != range.end(); ++i) {
+			piece_init(&aChunks[i].piece);
+			piece_limit(aChunks[i].start, aChunks[i].end, &aChunks[i].piece);
+		}
+	}
+
+private:
+	struct limit_data *aChunks;
+};
+
+/*
+ * Exclusive prefix scan of the chunk pieces with piece_merge. After the
+ * final scan, each chunk holds the state of the dragon at its start and
+ * mGetPiece() the merge of all the chunks.
+ */
+class DragonScan {
+public:
+	DragonScan(struct limit_data *chunks) {
+		aChunks = chunks;
+		piece_init(&aPiece);
+	}
+
+	DragonScan(const DragonScan& ds, split) {
+		aChunks = ds.aChunks;
+		piece_init(&aPiece);
+	}
+
+	template<typename Tag>
+	void operator()(const blocked_range<int>& range, Tag) {
+		for (int i = range.begin(); i != range.end(); ++i) {
+			piece_t piece = aChunks[i].piece;
+			if (Tag::is_final_scan())
+				aChunks[i].piece = aPiece;
+			piece_merge(&aPiece, piece);
+		}
+	}
+
+	void reverse_join(const DragonScan& left) {
+		piece_t piece = left.mGetPiece();
+		piece_merge(&piece, aPiece);
+		aPiece = piece;
+	}
+
+	void assign(const DragonScan& ds) {
+		aPiece = ds.mGetPiece();
+	}
+
+	piece_t mGetPiece() const {
+		return aPiece;
+	}
+
+private:
+	struct limit_data *aChunks;
+	piece_t aPiece;
+};
+
 class DragonDraw {
 public:
 	DragonDraw(struct draw_data *draw) {
@@ -58,13 +223,20 @@ public:
 	}
 
 
-	void operator()(const blocked_range<uint64_t>& range) const {
-		printf("DragonDraw id :=  %i, tid := %i , begin := %lu, end := %lu\n",
-				aDrawData->id, aTidMap->getIdFromTid(gettid()), range.begin(),
-				range.end());
-		dragon_draw_raw(range.begin(), range.end(), aDrawData->dragon,
-				aDrawData->dragon_width, aDrawData->dragon_height,
-				aDrawData->limits, aDrawData->id);
+	void operator()(const blocked_range<int>& range) const {
+		for (int i = range.begin(); i != range.end(); ++i) {
+			struct limit_data *chunk = &aDrawData->chunks[i];
+			piece_t start = chunk->piece;
+#ifdef DEBUG
+			printf("DragonDraw id :=  %i, tid := %i , begin := %lu, end := %lu\n",
+					i, aTidMap->getIdFromTid(gettid()), chunk->start,
+					chunk->end);
+#endif
+			dragon_draw_colors(chunk->start, chunk->end, &start,
+					aDrawData->dragon, aDrawData->dragon_width,
+					aDrawData->dragon_height, aDrawData->limits,
+					aDrawData->size, aDrawData->nb_thread);
+		}
 	}
 
 	struct draw_data* mGetDrawData() const {
@@ -126,6 +298,7 @@ private:
 int dragon_draw_tbb(char **canvas, struct rgb *image, int width, int height,
 		uint64_t size, int nb_thread) {
 	struct draw_data data;
+	struct limit_data *chunks = NULL;
 	limits_t limits;
 	char *dragon = NULL;
 	int dragon_width;
@@ -137,12 +310,41 @@ int dragon_draw_tbb(char **canvas, struct rgb *image, int width, int height,
 	int deltaJ;
 	int deltaI;
 
+	if (nb_thread <= 0)
+		return -1;
+
 	struct palette *palette = init_palette(nb_thread);
 	if (palette == NULL)
 		return -1;
 
-	/* 1. Calculer les limites du dragon */
-	dragon_limits_tbb(&limits, size, nb_thread);
+	lock_guard<mutex> guard(tbb_lock);
+	TbbContext *ctx = tbb_get_context(nb_thread);
+
+	/*
+	 * 1. Calculer les limites du dragon : DragonPieces, puis DragonScan.
+	 * Les morceaux sont gardes, chacun devient l'etat du dragon au debut
+	 * de son intervalle pour le dessin.
+	 */
+	int nb_chunk = tuning_chunks("tbb", TUNING_DRAW, size, width, height,
+			nb_thread, nb_thread);
+	chunks = (struct limit_data *) calloc(nb_chunk, sizeof(struct limit_data));
+	if (chunks == NULL) {
+		free_palette(palette);
+		*canvas = NULL;
+		return -1;
+	}
+	for (int i = 0; i < nb_chunk; ++i) {
+		chunks[i].id = i;
+		chunks[i].start = i * size / nb_chunk;
+		chunks[i].end = (i + 1) * size / nb_chunk;
+	}
+	DragonScan ds(chunks);
+	ctx->arena.execute([&] {
+		parallel_for(blocked_range<int>(0, nb_chunk, 1), DragonPieces(chunks),
+				ctx->chunks);
+		parallel_scan(blocked_range<int>(0, nb_chunk, 1), ds);
+	});
+	limits = ds.mGetPiece().limits;
 
 	dragon_width = limits.maximums.x - limits.minimums.x;
 	dragon_height = limits.maximums.y - limits.minimums.y;
@@ -153,8 +355,9 @@ int dragon_draw_tbb(char **canvas, struct rgb *image, int width, int height,
 	deltaJ = (scale * width - dragon_width) / 2;
 	deltaI = (scale * height - dragon_height) / 2;
 
-	dragon = (char *) malloc(dragon_surface);
+	dragon = (char *) canvas_alloc(dragon_surface);
 	if (dragon == NULL) {
+		FREE(chunks);
 		free_palette(palette);
 		*canvas = NULL;
 		return -1;
@@ -173,30 +376,33 @@ int dragon_draw_tbb(char **canvas, struct rgb *image, int width, int height,
 	data.deltaI = deltaI;
 	data.deltaJ = deltaJ;
 	data.palette = palette;
-
-	task_scheduler_init init(nb_thread);
-
-	/* 2. Initialiser la surface : DragonClear */
-	size_t grainsize = dragon_surface / nb_thread;
-	DragonClear dc(&data);
-	parallel_for(blocked_range<int>(0, dragon_surface, grainsize), dc);
-
-	/* 3. Dessiner le dragon : DragonDraw */
-	grainsize = data.size / (nb_thread * nb_thread);
-	DragonDraw dd(&data);
-	for (int i = 0; i < nb_thread; ++i) {
-		data.id = i;
-		uint64_t start = i * data.size / nb_thread;
-		uint64_t end = (i + 1) * data.size / nb_thread;
-		parallel_for(blocked_range<uint64_t>(start, end, grainsize), dd);
-	}
-
-	/* 4. Effectuer le rendu final : DragonRender */
-	grainsize = data.image_height / nb_thread;
-	DragonRender dr(&data);
-	parallel_for(blocked_range<int>(0, data.image_height, grainsize), dr);
-
-	init.terminate();
+	data.chunks = chunks;
+	data.nb_chunk = nb_chunk;
+
+	ctx->arena.execute([&] {
+		/* 2. Initialiser la surface : DragonClear */
+		size_t grainsize = tbb_grainsize(dragon_surface, tuning_chunks("tbb",
+				TUNING_CLEAR, size, width, height, nb_thread, 1));
+		DragonClear dc(&data);
+		parallel_for(blocked_range<int>(0, dragon_surface, grainsize), dc,
+				ctx->clear);
+
+		/*
+		 * 3. Dessiner le dragon : DragonDraw, chaque morceau sur le fil qui
+		 * a calcule ses limites
+		 */
+		DragonDraw dd(&data);
+		parallel_for(blocked_range<int>(0, nb_chunk, 1), dd, ctx->chunks);
+
+		/* 4. Effectuer le rendu final : DragonRender */
+		grainsize = tbb_grainsize(data.image_height, tuning_chunks("tbb",
+				TUNING_RENDER, size, width, height, nb_thread, 1));
+		DragonRender dr(&data);
+		parallel_for(blocked_range<int>(0, data.image_height, grainsize), dr,
+				ctx->render);
+	});
+
+	FREE(chunks);
 	free_palette(palette);
 	*canvas = dragon;
 	return 0;
@@ -208,8 +414,16 @@ int dragon_draw_tbb(char **canvas, struct rgb *image, int width, int height,
  */
 int dragon_limits_tbb(limits_t *limits, uint64_t size, int nb_thread) {
 	DragonLimits lim;
-	size_t grainsize = size / nb_thread;
-	parallel_reduce(blocked_range<uint64_t>(0, size, grainsize), lim);
+	if (nb_thread <= 0)
+		return -1;
+	lock_guard<mutex> guard(tbb_lock);
+	TbbContext *ctx = tbb_get_context(nb_thread);
+	size_t grainsize = tbb_grainsize(size, tuning_chunks("tbb", TUNING_LIMITS,
+			size, 0, 0, nb_thread, 1));
+	ctx->arena.execute([&] {
+		parallel_reduce(blocked_range<uint64_t>(0, size, grainsize), lim,
+				ctx->limits);
+	});
 	piece_t piece = lim.mGetPiece();
 	*limits = piece.limits;
 	return 0;
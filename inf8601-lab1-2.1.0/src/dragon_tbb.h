@@ -15,6 +15,7 @@ extern "C" {
 #endif
 int dragon_draw_tbb(char **canvas, struct rgb *image, int width, int height, uint64_t size, int nb_thread);
 int dragon_limits_tbb(limits_t *limits, uint64_t size, int nb_thread);
+void dragon_tbb_pin(int enable);
 #ifdef __cplusplus
 }
 #endif
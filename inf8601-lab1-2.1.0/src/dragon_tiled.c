@@ -0,0 +1,371 @@
+/*
+ * dragon_tiled.c
+ *
+ * Owner-computes draw. The canvas is split in tiles made of whole cache
+ * lines and each tile is written by a single thread. A segment landing in
+ * a tile owned by another thread is queued in the outbox of its source,
+ * which is grouped by owner at the end of the round, and each owner applies
+ * its part of every outbox between rounds. An outbox holds TILE_QUEUE_LEN
+ * writes whatever the number of threads.
+ *
+ * Colors are given in increasing order along the curve, so the last
+ * segment drawn on a pixel by the serial version is also the one with the
+ * highest color. Keeping the maximum color makes the result independent
+ * of the order in which the writes are applied, and equal to serial.
+ *
+ *  Created on: 2026-10-19
+ *      Author: francis
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include <limits.h>
+
+#include "color.h"
+#include "dragon.h"
+#include "dragon_pthread.h"
+#include "dragon_tiled.h"
+#include "tuning.h"
+
+#define TILE_ALIGN			64
+#define TILES_PER_THREAD	16
+#define TILE_QUEUE_LEN		16384
+#define TILE_ROUND			65536
+
+struct tile_write {
+	int index;
+	/* fills the padding, no division by the tile size in tiled_sort */
+	short owner;
+	char id;
+};
+
+/*
+ * Written by its source during a round, then grouped by owner in sorted:
+ * the writes for the thread o are sorted[start[o]] to sorted[start[o + 1]].
+ */
+struct tile_outbox {
+	int len;
+	struct tile_write *writes;
+	struct tile_write *sorted;
+	int *start;
+} __attribute__((aligned(128)));
+
+struct tiled_shared {
+	int nb_thread;
+	int nb_chunk;
+	int tile_size;
+	int remaining;
+	/* set by a thread that left the canvas, the draw fails */
+	int error;
+	struct tile_outbox *outboxes;
+};
+
+struct tiled_data {
+	struct draw_data draw;
+	struct tiled_shared *shared;
+} __attribute__((aligned(128)));
+
+/* position of a thread along its chunks of the curve */
+struct tiled_cursor {
+	int chunk;
+	char id;
+	uint64_t n;
+	uint64_t end;
+	xy_t position;
+	xy_t orientation;
+};
+
+static inline int tile_owner(struct tiled_shared *shared, int index)
+{
+	return (index / shared->tile_size) % shared->nb_thread;
+}
+
+static inline void tile_apply(char *dragon, int index, char id)
+{
+	if (dragon[index] < id)
+		dragon[index] = id;
+}
+
+/*
+ * move the cursor to the start of chunk, return -1 when the thread has
+ * no chunk left
+ */
+static int tiled_seek(struct tiled_data *data, struct tiled_cursor *cur, int chunk)
+{
+	struct tiled_shared *shared = data->shared;
+	uint64_t size = data->draw.size;
+	uint64_t start;
+
+	if (chunk >= shared->nb_chunk)
+		return -1;
+	start = chunk * size / shared->nb_chunk;
+	cur->chunk = chunk;
+	cur->id = chunk / (shared->nb_chunk / shared->nb_thread);
+	cur->n = start + 1;
+	cur->end = (chunk + 1) * size / shared->nb_chunk;
+	cur->position = compute_position(start);
+	cur->orientation = compute_orientation(start);
+	cur->position.x -= data->draw.limits.minimums.x;
+	cur->position.y -= data->draw.limits.minimums.y;
+	return 0;
+}
+
+/*
+ * Walk at most TILE_ROUND segments, or until the outbox is full.
+ * Return 1 when all the chunks of the thread are drawn.
+ */
+static int tiled_route(struct tiled_data *data, struct tiled_cursor *cur)
+{
+	struct tiled_shared *shared = data->shared;
+	struct tile_outbox *out = &shared->outboxes[data->draw.id];
+	char *dragon = data->draw.dragon;
+	int width = data->draw.dragon_width;
+	int area = width * data->draw.dragon_height;
+	int budget;
+
+	for (budget = 0; budget < TILE_ROUND; budget++) {
+		if (cur->n > cur->end) {
+			if (tiled_seek(data, cur, cur->chunk + shared->nb_thread) < 0)
+				return 1;
+			continue;
+		}
+
+		int j = (cur->position.x + (cur->position.x + cur->orientation.x)) >> 1;
+		int i = (cur->position.y + (cur->position.y + cur->orientation.y)) >> 1;
+		int index = i * width + j;
+		if (index < 0 || index >= area) {
+			printf("index is out of range\n");
+			__sync_fetch_and_or(&shared->error, 1);
+			return 1;
+		}
+
+		int owner = tile_owner(shared, index);
+		if (owner == data->draw.id) {
+			tile_apply(dragon, index, cur->id);
+		} else {
+			out->writes[out->len].index = index;
+			out->writes[out->len].owner = owner;
+			out->writes[out->len].id = cur->id;
+			out->len++;
+		}
+
+		cur->position.x += cur->orientation.x;
+		cur->position.y += cur->orientation.y;
+		if (((cur->n & -cur->n) << 1) & cur->n)
+			rotate_left(&cur->orientation);
+		else
+			rotate_right(&cur->orientation);
+		cur->n++;
+
+		if (out->len == TILE_QUEUE_LEN)
+			break;
+	}
+	return 0;
+}
+
+/*
+ * Group the writes of the round by owner, counting sort in two passes.
+ * The outbox is empty for the next round.
+ */
+static void tiled_sort(struct tiled_shared *shared, struct tile_outbox *out)
+{
+	int o, k;
+
+	memset(out->start, 0, (shared->nb_thread + 2) * sizeof(int));
+	for (k = 0; k < out->len; k++)
+		out->start[out->writes[k].owner + 2]++;
+	for (o = 2; o <= shared->nb_thread + 1; o++)
+		out->start[o] += out->start[o - 1];
+	/* start[o + 1] goes from the first write of o to the first of o + 1 */
+	for (k = 0; k < out->len; k++) {
+		o = out->writes[k].owner;
+		out->sorted[out->start[o + 1]++] = out->writes[k];
+	}
+	out->len = 0;
+}
+
+/* apply the writes queued for this thread by all the threads */
+static void tiled_drain(struct tiled_data *data)
+{
+	struct tiled_shared *shared = data->shared;
+	char *dragon = data->draw.dragon;
+	int id = data->draw.id;
+	int src, k;
+
+	for (src = 0; src < shared->nb_thread; src++) {
+		struct tile_outbox *out = &shared->outboxes[src];
+		for (k = out->start[id]; k < out->start[id + 1]; k++)
+			tile_apply(dragon, out->sorted[k].index, out->sorted[k].id);
+	}
+}
+
+void *dragon_tiled_worker(void *arg)
+{
+	struct tiled_data *data = (struct tiled_data *) arg;
+	struct draw_data *lData = &data->draw;
+	struct tiled_shared *shared = data->shared;
+	struct tiled_cursor cur;
+	int area = lData->dragon_width * lData->dragon_height;
+	int done;
+	int i;
+
+	/* 1. Initialiser les tuiles possedees par le fil */
+	for (i = lData->id; i * shared->tile_size < area; i += shared->nb_thread) {
+		int end = (i + 1) * shared->tile_size;
+		init_canvas(i * shared->tile_size, end < area ? end : area, lData->dragon, -1);
+	}
+
+	pthread_barrier_wait(lData->barrier);
+
+	/* 2. Dessiner le dragon par rondes : aiguillage, puis application */
+	done = tiled_seek(data, &cur, lData->id) < 0;
+	if (done)
+		__sync_fetch_and_sub(&shared->remaining, 1);
+	while (1) {
+		if (!done && tiled_route(data, &cur)) {
+			done = 1;
+			__sync_fetch_and_sub(&shared->remaining, 1);
+		}
+		tiled_sort(shared, &shared->outboxes[lData->id]);
+		pthread_barrier_wait(lData->barrier);
+		/* only modified before the first barrier of a round */
+		int remaining = __sync_fetch_and_add(&shared->remaining, 0);
+		tiled_drain(data);
+		pthread_barrier_wait(lData->barrier);
+		if (remaining == 0)
+			break;
+	}
+
+	/* 3. Effectuer le rendu final */
+	int lChunks = tuning_chunks("tiled", TUNING_RENDER, lData->size,
+			lData->image_width, lData->image_height, lData->nb_thread, 1);
+	for (i = lData->id; i < lChunks; i += lData->nb_thread) {
+		int lStartImage = i * lData->image_height / lChunks;
+		int lEndImage = (i + 1) * lData->image_height / lChunks;
+		scale_dragon(lStartImage, lEndImage, lData->image, lData->image_width,
+				lData->image_height, lData->dragon, lData->dragon_width,
+				lData->dragon_height, lData->palette);
+	}
+
+	return NULL;
+}
+
+int dragon_draw_tiled(char **canvas, struct rgb *image, int width, int height, uint64_t size, int nb_thread)
+{
+	pthread_t *threads = NULL;
+	pthread_barrier_t barrier;
+	limits_t limits;
+	struct tiled_shared shared;
+	struct tiled_data *data = NULL;
+	struct palette *palette = NULL;
+	char *dragon = NULL;
+	int barrier_init = 0;
+	int area;
+	int i;
+	int ret = 0;
+
+	memset(&shared, 0, sizeof(shared));
+
+	/* the owner of a write is a short */
+	if (nb_thread <= 0 || nb_thread > SHRT_MAX)
+		goto err;
+
+	palette = init_palette(nb_thread);
+	if (palette == NULL)
+		goto err;
+
+	if (pthread_barrier_init(&barrier, NULL, nb_thread) != 0) {
+		printf("barrier init error\n");
+		goto err;
+	}
+	barrier_init = 1;
+
+	/* 1. Calculer les limites du dragon */
+	if (dragon_limits_pthread(&limits, size, nb_thread) < 0)
+		goto err;
+
+	int dragon_width = limits.maximums.x - limits.minimums.x;
+	int dragon_height = limits.maximums.y - limits.minimums.y;
+	area = dragon_width * dragon_height;
+
+	/* tiles start on a cache line, canvas_alloc aligns on huge pages */
+	if ((dragon = (char *) canvas_alloc(area)) == NULL) {
+		printf("malloc error dragon\n");
+		goto err;
+	}
+
+	shared.nb_thread = nb_thread;
+	shared.nb_chunk = tuning_chunks("tiled", TUNING_DRAW, size, width, height, nb_thread, 1);
+	shared.remaining = nb_thread;
+	shared.tile_size = area / (nb_thread * TILES_PER_THREAD);
+	shared.tile_size = (shared.tile_size / TILE_ALIGN + 1) * TILE_ALIGN;
+
+	if ((shared.outboxes = calloc(nb_thread, sizeof(struct tile_outbox))) == NULL)
+		goto err;
+	for (i = 0; i < nb_thread; i++) {
+		struct tile_outbox *out = &shared.outboxes[i];
+		out->writes = malloc(TILE_QUEUE_LEN * sizeof(struct tile_write));
+		out->sorted = malloc(TILE_QUEUE_LEN * sizeof(struct tile_write));
+		out->start = malloc((nb_thread + 2) * sizeof(int));
+		if (out->writes == NULL || out->sorted == NULL || out->start == NULL)
+			goto err;
+	}
+
+	if ((data = calloc(nb_thread, sizeof(struct tiled_data))) == NULL)
+		goto err;
+
+	if ((threads = malloc(sizeof(pthread_t) * nb_thread)) == NULL)
+		goto err;
+
+	/* 2. Lancement du calcul parallèle avec dragon_tiled_worker */
+	for (i = 0; i < nb_thread; ++i) {
+		struct draw_data *d = &data[i].draw;
+		d->id = i;
+		d->nb_thread = nb_thread;
+		d->dragon_width = dragon_width;
+		d->dragon_height = dragon_height;
+		d->image_width = width;
+		d->image_height = height;
+		d->image = image;
+		d->palette = palette;
+		d->dragon = dragon;
+		d->size = size;
+		d->limits = limits;
+		d->barrier = &barrier;
+		data[i].shared = &shared;
+		if (pthread_create(&threads[i], 0, &dragon_tiled_worker, &data[i]) != 0)
+			goto err;
+	}
+
+	/* 3. Attendre la fin du traitement */
+	for (i = 0; i < nb_thread; ++i) {
+		if (pthread_join(threads[i], 0) != 0)
+			goto err;
+	}
+	if (shared.error)
+		goto err;
+
+done:
+	if (barrier_init)
+		pthread_barrier_destroy(&barrier);
+	if (shared.outboxes != NULL) {
+		for (i = 0; i < nb_thread; i++) {
+			FREE(shared.outboxes[i].writes);
+			FREE(shared.outboxes[i].sorted);
+			FREE(shared.outboxes[i].start);
+		}
+		FREE(shared.outboxes);
+	}
+	FREE(data);
+	FREE(threads);
+	free_palette(palette);
+	*canvas = dragon;
+	return ret;
+
+err:
+	CANVAS_FREE(dragon);
+	ret = -1;
+	goto done;
+}
@@ -0,0 +1,15 @@
+/*
+ * dragon_tiled.h
+ *
+ *  Created on: 2026-10-19
+ *      Author: francis
+ */
+
+#ifndef DRAGON_TILED_H_
+#define DRAGON_TILED_H_
+
+#include "dragon.h"
+
+int dragon_draw_tiled(char **canvas, struct rgb *image, int width, int height, uint64_t size, int nb_thread);
+
+#endif /* DRAGON_TILED_H_ */
@@ -19,11 +19,32 @@
 #include <error.h>
 #include <getopt.h>
 #include <inttypes.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #include "config.h"
 #include "dragon.h"
 #include "dragon_pthread.h"
 #include "dragon_tbb.h"
+#include "dragon_stl.h"
+#include "dragon_tiled.h"
+#include "dragon_onepass.h"
+#include "dragon_curve.h"
+#include "dragon_renderer.h"
+#ifdef HAVE_MPI
+#include "dragon_mpi.h"
+#endif
+#ifdef HAVE_OPENCL
+#include "dragon_opencl.h"
+#endif
+#include "tuning.h"
+#include "golden.h"
+#include "render_cache.h"
+#include "snapshot.h"
 
 /* Globals and defaults */
 #define PROGNAME "dragonizer"
@@ -33,10 +54,17 @@
 #define DEFAULT_NB_THREAD 2
 #define DEFAULT_LIB_NAME "serial"
 #define DEFAULT_IMG_PATH "dragon.ppm"
+#define DEFAULT_GOLDEN_DIR "results/golden"
 #define POWER_MAX 		30
 #define CHECK_POWER 	20
 #define CHECK_NB_THREAD	8
+#define AUTOTUNE_REPEAT	3
+#define DEFAULT_CACHE_LEN	32
+#define SERVE_LINE		256
+#define SERVE_MAX_RES	16384
+#define SERVE_MAX_THREAD	1024
 static const struct command_def const *commands[];
+static const struct lib_def *lookup_lib(const char *name);
 int verbose = 0;
 
 /*
@@ -49,18 +77,36 @@ enum thread_lib {
 	THREAD_LIB_SERIAL,
 	THREAD_LIB_PTHREAD,
 	THREAD_LIB_TBB,
+	THREAD_LIB_STL,
+	THREAD_LIB_TILED,
+	THREAD_LIB_ONEPASS,
+	THREAD_LIB_ASYNC,
+	THREAD_LIB_CURVE,
+	THREAD_LIB_MPI,
+	THREAD_LIB_OPENCL,
 };
 
 struct command_opts {
 	const struct command_def *cmd;
 	const struct lib_def *lib;
 	char *pgm_path;
+	char *tuning_path;
+	char *golden_dir;
+	char *socket_path;
+	int cache_len;
 	int nb_thread;
+	int auto_thread;
 	int height;
 	int width;
 	int power;
 	int power_max;
 	int verbose;
+	int fast;
+	int pin;
+	char *save_canvas;
+	char *canvas_path;
+	int palette_len;
+	int rle;
 	uint64_t size;
 };
 
@@ -72,8 +118,15 @@ struct lib_def {
 	enum thread_lib lib;
 	draw_handler draw_handler;
 	limits_handler limits_handler;
+	int exact;	/* draw must match serial pixel for pixel */
+	int other_curve;	/* not the Heighway dragon, checked by check_curves */
+	int reentrant;	/* draws run concurrently in the server */
+	int phases;	/* TUNE() of the phases read with tuning_chunks() */
 };
 
+#define TUNE(phase)	(1 << (phase))
+#define TUNE_ALL	((1 << TUNING_PHASES) - 1)
+
 static const struct lib_def libs[] = {
 		{ .name = "serial",
 				.lib = THREAD_LIB_SERIAL,
@@ -82,11 +135,75 @@ static const struct lib_def libs[] = {
 		{ .name = "pthread",
 				.lib = THREAD_LIB_PTHREAD,
 				.draw_handler = dragon_draw_pthread,
-				.limits_handler = dragon_limits_pthread },
+				.limits_handler = dragon_limits_pthread,
+				.exact = 1,
+				.phases = TUNE_ALL },
 		{ .name = "tbb",
 				.lib = THREAD_LIB_TBB,
 				.draw_handler = dragon_draw_tbb,
-				.limits_handler = dragon_limits_tbb },
+				.limits_handler = dragon_limits_tbb,
+				.exact = 1,
+				.phases = TUNE_ALL },
+		{ .name = "stl",
+				.lib = THREAD_LIB_STL,
+				.draw_handler = dragon_draw_stl,
+				.limits_handler = dragon_limits_stl,
+				.phases = TUNE(TUNING_LIMITS) | TUNE(TUNING_DRAW) | TUNE(TUNING_RENDER) },
+		{ .name = "tiled",
+				.lib = THREAD_LIB_TILED,
+				.draw_handler = dragon_draw_tiled,
+				.limits_handler = dragon_limits_pthread,
+				.exact = 1,
+				.phases = TUNE(TUNING_DRAW) | TUNE(TUNING_RENDER) },
+		{ .name = "onepass",
+				.lib = THREAD_LIB_ONEPASS,
+				.draw_handler = dragon_draw_onepass,
+				.limits_handler = dragon_limits_pthread,
+				.exact = 1,
+				.phases = TUNE(TUNING_CLEAR) | TUNE(TUNING_DRAW) | TUNE(TUNING_RENDER) },
+		{ .name = "async",
+				.lib = THREAD_LIB_ASYNC,
+				.draw_handler = dragon_draw_async,
+				.limits_handler = dragon_limits_tbb,
+				.exact = 1,
+				.reentrant = 1 },
+		{ .name = "heighway",
+				.lib = THREAD_LIB_CURVE,
+				.draw_handler = dragon_draw_heighway,
+				.limits_handler = dragon_limits_heighway,
+				.phases = TUNE_ALL },
+		{ .name = "twindragon",
+				.lib = THREAD_LIB_CURVE,
+				.draw_handler = dragon_draw_twindragon,
+				.limits_handler = dragon_limits_twindragon,
+				.other_curve = 1,
+				.phases = TUNE_ALL },
+		{ .name = "terdragon",
+				.lib = THREAD_LIB_CURVE,
+				.draw_handler = dragon_draw_terdragon,
+				.limits_handler = dragon_limits_terdragon,
+				.other_curve = 1,
+				.phases = TUNE_ALL },
+		{ .name = "paperfold",
+				.lib = THREAD_LIB_CURVE,
+				.draw_handler = dragon_draw_paperfold,
+				.limits_handler = dragon_limits_paperfold,
+				.other_curve = 1,
+				.phases = TUNE_ALL },
+#ifdef HAVE_MPI
+		{ .name = "mpi",
+				.lib = THREAD_LIB_MPI,
+				.draw_handler = dragon_draw_mpi,
+				.limits_handler = dragon_limits_mpi,
+				.exact = 1 },
+#endif
+#ifdef HAVE_OPENCL
+		{ .name = "opencl",
+				.lib = THREAD_LIB_OPENCL,
+				.draw_handler = dragon_draw_opencl,
+				.limits_handler = dragon_limits_opencl,
+				.exact = 1 },
+#endif
 		{ .name = NULL,
 				.lib = THREAD_LIB_NONE,
 				.draw_handler = NULL,
@@ -103,24 +220,95 @@ struct command_def {
 __attribute__((noreturn))
 static void usage(void)
 {
+	const char *sep;
+	int i;
+
 	fprintf(stderr, PROGNAME " " VERSION " " PACKAGE_NAME "\n");
 	fprintf(stderr, "Usage: " PROGNAME " [OPTIONS] [COMMAND]\n");
 	fprintf(stderr, "\nOptions:\n");
 	fprintf(stderr, "  --help	this help\n");
-	fprintf(stderr, "  --cmd		command [ draw | limits | check ]\n");
+	fprintf(stderr, "  --cmd		command [ draw | limits | check | autotune | serve | rerender ]\n");
 	fprintf(stderr, "  --thread	set number of threads\n");
-	fprintf(stderr, "  --lib		set the threading library to use "\
-			"[ serial | pthread | tbb ]\n");
+	/* only the libraries compiled in, mpi and opencl are optional */
+	for (sep = "  --lib		set the threading library to use [ ", i = 0;
+			libs[i].lib != THREAD_LIB_NONE; i++) {
+		if (libs[i].lib == THREAD_LIB_CURVE)
+			continue;
+		fprintf(stderr, "%s%s", sep, libs[i].name);
+		sep = " | ";
+	}
+	for (sep = " ]\n		or the curve to draw [ ", i = 0;
+			libs[i].lib != THREAD_LIB_NONE; i++) {
+		if (libs[i].lib != THREAD_LIB_CURVE)
+			continue;
+		fprintf(stderr, "%s%s", sep, libs[i].name);
+		sep = " | ";
+	}
+	fprintf(stderr, " ]\n");
 	fprintf(stderr, "  --output set image path output\n");
 	fprintf(stderr, "  --height	set dragon height\n");
 	fprintf(stderr, "  --width	set dragon width\n");
 	fprintf(stderr, "  --size	set dragon size\n");
 	fprintf(stderr, "  --power  set dragon size by power\n");
 	fprintf(stderr, "  --max    compute all dragon to max power\n");
+	fprintf(stderr, "  --autotune	same as --cmd autotune\n");
+	fprintf(stderr, "  --tuning	set tuning profiles path\n");
+	fprintf(stderr, "  --fast	check against cached serial digests\n");
+	fprintf(stderr, "  --golden	set serial digests directory (default %s)\n", DEFAULT_GOLDEN_DIR);
+	fprintf(stderr, "  --serve	serve render and limits requests on a unix socket\n");
+	fprintf(stderr, "  --cache	number of results kept by the server\n");
+	fprintf(stderr, "  --pin	pin the tbb threads on the cores\n");
+	fprintf(stderr, "  --save-canvas	save the canvas of the dragon drawn\n");
+	fprintf(stderr, "  --rle	run-length encode the saved canvas\n");
+	fprintf(stderr, "  --canvas	canvas to render again with rerender\n");
+	fprintf(stderr, "  --palette	render again with a new palette of this many colors\n");
 	fprintf(stderr, "\n");
 	exit(EXIT_FAILURE);
 }
 
+static int is_root(void)
+{
+#ifdef HAVE_MPI
+	return dragon_mpi_rank() == 0;
+#else
+	return 1;
+#endif
+}
+
+/*
+ * Save the canvas with its limits, the libraries do not return them and
+ * they are computed again.
+ */
+static int save_canvas(struct command_opts *opts, char *dragon, uint64_t size)
+{
+	struct palette *palette = NULL;
+	limits_t limits;
+	int ret = 0;
+
+	if (!is_root())
+		return 0;
+	if (dragon == NULL) {
+		printf("Error: the %s library does not keep its canvas\n", opts->lib->name);
+		return -1;
+	}
+	if (opts->lib->limits_handler(&limits, size, opts->nb_thread) < 0)
+		goto err;
+	if ((palette = init_palette(opts->nb_thread)) == NULL)
+		goto err;
+	if (snapshot_save(opts->save_canvas, dragon, limits, size, palette,
+			opts->rle ? SNAPSHOT_RLE : 0, opts->nb_thread) < 0) {
+		printf("Error: failed to save the canvas in %s\n", opts->save_canvas);
+		goto err;
+	}
+
+done:
+	free_palette(palette);
+	return ret;
+err:
+	ret = -1;
+	goto done;
+}
+
 static int cmd_draw(struct command_opts *opts)
 {
 	char *dragon = NULL;
@@ -135,6 +323,13 @@ static int cmd_draw(struct command_opts *opts)
 	case THREAD_LIB_SERIAL:
 	case THREAD_LIB_PTHREAD:
 	case THREAD_LIB_TBB:
+	case THREAD_LIB_STL:
+	case THREAD_LIB_TILED:
+	case THREAD_LIB_ONEPASS:
+	case THREAD_LIB_ASYNC:
+	case THREAD_LIB_CURVE:
+	case THREAD_LIB_MPI:
+	case THREAD_LIB_OPENCL:
 		if (opts->power > 0 && opts->power_max > 0) {
 			int i;
 			for (i = opts->power; i <= opts->power_max; i++) {
@@ -144,7 +339,7 @@ static int cmd_draw(struct command_opts *opts)
 				ret = opts->lib->draw_handler(&dragon, img, opts->width, opts->height,
 						size, opts->nb_thread);
 				if (i != opts->power_max)
-					FREE(dragon);
+					CANVAS_FREE(dragon);
 				if (ret < 0)
 					break;
 			}
@@ -163,10 +358,20 @@ static int cmd_draw(struct command_opts *opts)
 	if (ret < 0)
 		goto err;
 
-	write_img(img, opts->pgm_path, opts->width, opts->height);
+	/* with MPI, every rank gets the image but only the first writes it */
+	if (is_root())
+		write_img(img, opts->pgm_path, opts->width, opts->height);
+
+	if (opts->save_canvas != NULL) {
+		uint64_t size = opts->size;
+		if (opts->power > 0 && opts->power_max > 0)
+			size = 1LL << opts->power_max;
+		if (save_canvas(opts, dragon, size) < 0)
+			goto err;
+	}
 done:
-	FREE(dragon);
-	FREE(img);
+	CANVAS_FREE(dragon);
+	CANVAS_FREE(img);
 	return ret;
 err:
 	ret = -1;
@@ -176,6 +381,81 @@ err:
 static const struct command_def cmd_draw_def =
 { .name = "draw", .handler = cmd_draw };
 
+/*
+ * Palette of len colors taken from a new palette of num colors, the
+ * segment color m of the canvas becomes the color m * num / len.
+ */
+static struct palette *spread_palette(int num, int len)
+{
+	struct palette *fresh = NULL;
+	struct palette *palette = NULL;
+	int m;
+
+	if ((fresh = init_palette(num)) == NULL)
+		return NULL;
+	if ((palette = init_palette(len)) == NULL)
+		goto done;
+	for (m = 0; m < len; m++)
+		palette->colors[m] = fresh->colors[(int64_t) m * num / len];
+done:
+	free_palette(fresh);
+	return palette;
+}
+
+/*
+ * Render the saved canvas at the width and height of the options, the
+ * dragon is not drawn again. The palette of the snapshot is used, unless
+ * --palette asks for a new one.
+ */
+static int cmd_rerender(struct command_opts *opts)
+{
+	struct snapshot *snapshot = NULL;
+	struct palette *palette = NULL;
+	struct rgb *img = NULL;
+	int ret = 0;
+	int y;
+
+	if (opts->canvas_path == NULL) {
+		printf("Select a canvas to render with --canvas\n");
+		goto err;
+	}
+
+	/* 1. Projeter la surface en memoire */
+	snapshot = snapshot_load(opts->canvas_path, opts->nb_thread);
+	if (snapshot == NULL)
+		goto err;
+	img = make_canvas(opts->width, opts->height);
+	if (img == NULL)
+		goto err;
+
+	/* 2. Choisir la palette */
+	if (opts->palette_len > 0) {
+		palette = spread_palette(opts->palette_len, snapshot->palette->len);
+		if (palette == NULL)
+			goto err;
+	}
+
+	/* 3. Effectuer le rendu final, une rangee de l'image par tour */
+	#pragma omp parallel for schedule(dynamic) num_threads(opts->nb_thread)
+	for (y = 0; y < opts->height; y++)
+		scale_dragon(y, y + 1, img, opts->width, opts->height,
+				snapshot->dragon, snapshot->dragon_width, snapshot->dragon_height,
+				palette != NULL ? palette : snapshot->palette);
+
+	write_img(img, opts->pgm_path, opts->width, opts->height);
+done:
+	CANVAS_FREE(img);
+	free_palette(palette);
+	free_snapshot(snapshot);
+	return ret;
+err:
+	ret = -1;
+	goto done;
+}
+
+static const struct command_def cmd_rerender_def =
+{ .name = "rerender", .handler = cmd_rerender };
+
 static int cmd_limits(struct command_opts *opts)
 {
 	int ret = 0;
@@ -186,6 +466,13 @@ static int cmd_limits(struct command_opts *opts)
 	case THREAD_LIB_SERIAL:
 	case THREAD_LIB_PTHREAD:
 	case THREAD_LIB_TBB:
+	case THREAD_LIB_STL:
+	case THREAD_LIB_TILED:
+	case THREAD_LIB_ONEPASS:
+	case THREAD_LIB_ASYNC:
+	case THREAD_LIB_CURVE:
+	case THREAD_LIB_MPI:
+	case THREAD_LIB_OPENCL:
 		if (opts->power > 0 && opts->power_max > 0) {
 			int i;
 			for (i = opts->power; i <= opts->power_max; i++) {
@@ -221,25 +508,31 @@ err:
 static const struct command_def cmd_limit_def =
 { .name = "limits", .handler = cmd_limits };
 
-static int check_limits(struct command_opts *opts)
+static int check_limits(struct command_opts *opts, struct golden *golden)
 {
 	int ret = 0;
 	int i;
 	limits_t lim_expected, lim_actual;
 	memset(&lim_expected, 0, sizeof(limits_t));
 
-	if (dragon_limits_serial(&lim_expected, opts->size, opts->nb_thread) < 0) {
+	if (golden != NULL) {
+		lim_expected = golden->limits;
+	} else if (dragon_limits_serial(&lim_expected, opts->size, opts->nb_thread) < 0) {
 		printf("Error: limits serial failed\n");
 		return -1;
 	}
 
 	for (i = 1; libs[i].lib != THREAD_LIB_NONE; i++) {
+		if (libs[i].other_curve)
+			continue;
 		memset(&lim_actual, 0, sizeof(limits_t));
 		const char *name = libs[i].name;
-		ret = libs[i].limits_handler(&lim_actual, opts->size, opts->nb_thread);
-		if (ret < 0) {
+		if (libs[i].limits_handler(&lim_actual, opts->size, opts->nb_thread) < 0) {
+			/* the other libraries are still checked */
+			ret = -1;
 			printf("Error executing limits with %s\n", name);
-			return -1;
+			printf("FAIL %10s %10s\n", "limits", name);
+			continue;
 		}
 		if (cmp_limits(&lim_expected, &lim_actual) == 0) {
 			printf("PASS %10s %10s\n", "limits", name);
@@ -253,7 +546,77 @@ static int check_limits(struct command_opts *opts)
 	return ret;
 }
 
-static int check_draw(struct command_opts *opts)
+/*
+ * Libraries that do not assemble the canvas (mpi) are compared on the
+ * image, the number of pixels that differ is returned.
+ */
+static int check_image_gap(struct command_opts *opts, char **drg_exp,
+		struct rgb *img_exp, struct rgb *img_act)
+{
+	int gap = 0;
+	int i;
+
+	if (*drg_exp == NULL && dragon_draw_serial(drg_exp, img_exp,
+			opts->width, opts->height, opts->size, opts->nb_thread) < 0) {
+		printf("Error: draw serial failed\n");
+		return -1;
+	}
+	for (i = 0; i < opts->width * opts->height; i++) {
+		if (memcmp(&img_exp[i], &img_act[i], sizeof(struct rgb)) != 0)
+			gap++;
+	}
+	return gap;
+}
+
+/*
+ * Number of pixels of act that differ from the serial dragon, counted up
+ * to threshold unless verbose. With the golden digests, only the tiles
+ * whose digest differs are compared, and the serial dragon is drawn the
+ * first time such a tile is found. -1 when act is not a canvas of the
+ * serial size.
+ */
+static int check_gap(struct command_opts *opts, struct golden *golden,
+		char **drg_exp, struct rgb *img_exp, char *drg_act, struct rgb *img_act,
+		int dragon_width, int dragon_height, uint64_t *digests, int threshold)
+{
+	size_t area = (size_t) dragon_width * dragon_height;
+	size_t act_area;
+	int gap = 0;
+	int tile;
+
+	if (drg_act == NULL)
+		return check_image_gap(opts, drg_exp, img_exp, img_act);
+
+	/* wrong limits give another canvas, never read past its end */
+	if ((act_area = canvas_size(drg_act)) != area) {
+		printf("Error: canvas of %zu bytes, expected %zu\n", act_area, area);
+		return -1;
+	}
+
+	if (golden == NULL)
+		return cmp_canvas(*drg_exp, drg_act, dragon_width, dragon_height,
+				opts->verbose, threshold);
+
+	golden_digests(drg_act, golden->area, digests);
+	for (tile = 0; tile < golden->nb_tiles; tile++) {
+		if (digests[tile] == golden->digests[tile])
+			continue;
+		if (!opts->verbose && gap >= threshold)
+			break;
+		if (*drg_exp == NULL && dragon_draw_serial(drg_exp, img_exp,
+				opts->width, opts->height, opts->size, opts->nb_thread) < 0) {
+			printf("Error: draw serial failed\n");
+			return -1;
+		}
+		int start = tile * GOLDEN_TILE;
+		int end = start + GOLDEN_TILE < golden->area ? start + GOLDEN_TILE : golden->area;
+		gap += cmp_canvas_range(*drg_exp, drg_act, dragon_width, start, end,
+				opts->verbose, threshold - gap);
+	}
+	return gap;
+}
+
+static int check_draw(struct command_opts *opts, struct golden **golden_ptr)
 {
 	int ret = 0;
 	int i;
@@ -264,6 +627,8 @@ static int check_draw(struct command_opts *opts)
 	int threshold;
 	char *drg_exp = NULL, *drg_act = NULL;
 	struct rgb *img_exp = NULL, *img_act = NULL;
+	struct golden *golden = *golden_ptr;
+	uint64_t *digests = NULL;
 	char *f1 = NULL, *f2 = NULL;
 
 	uint64_t min_size = 1LL << CHECK_POWER;
@@ -271,7 +636,9 @@ static int check_draw(struct command_opts *opts)
 		printf("For best results, check with power at " \
 				"least %d and thread at least %d\n", CHECK_POWER, CHECK_NB_THREAD);
 
-	if (dragon_limits_serial(&limits, opts->size, opts->nb_thread) < 0) {
+	if (golden != NULL) {
+		limits = golden->limits;
+	} else if (dragon_limits_serial(&limits, opts->size, opts->nb_thread) < 0) {
 		printf("Error: limits serial failed\n");
 		goto err;
 	}
@@ -279,33 +646,61 @@ static int check_draw(struct command_opts *opts)
 	dragon_width = limits.maximums.x - limits.minimums.x;
 	dragon_height = limits.maximums.y - limits.minimums.y;
 	area = dragon_width * dragon_height;
-	threshold = opts->nb_thread * 2;
 
 	img_exp = make_canvas(opts->width, opts->height);
 	img_act = make_canvas(opts->width, opts->height);
 	if (img_exp == NULL || img_act == NULL)
 		goto err;
 
-	if (dragon_draw_serial(&drg_exp, img_exp, opts->width, opts->height, opts->size, opts->nb_thread) < 0) {
-		printf("Error: draw serial failed\n");
-		goto err;
+	if (golden == NULL) {
+		if (dragon_draw_serial(&drg_exp, img_exp, opts->width, opts->height, opts->size, opts->nb_thread) < 0) {
+			printf("Error: draw serial failed\n");
+			goto err;
+		}
+		if (opts->fast) {
+			golden = golden_make(drg_exp, limits, opts->size, opts->width,
+					opts->height, opts->nb_thread);
+			if (golden == NULL || golden_save(opts->golden_dir, golden) < 0)
+				printf("Warning: failed to save golden digests in %s\n", opts->golden_dir);
+			*golden_ptr = golden;
+		}
+	}
+
+	if (golden != NULL) {
+		digests = (uint64_t *) calloc(golden->nb_tiles + 1, sizeof(uint64_t));
+		if (digests == NULL)
+			goto err;
 	}
 
 	char *fmt = "%s %10s %10s threshold=%d gap=%d (%.3f%%)\n";
 	for (i = 1; libs[i].lib != THREAD_LIB_NONE; i++) {
+		if (libs[i].other_curve)
+			continue;
 		const char *name = libs[i].name;
-		ret = libs[i].draw_handler(&drg_act, img_act, opts->width, opts->height, opts->size, opts->nb_thread);
-		if (ret < 0) {
+		threshold = libs[i].exact ? 1 : opts->nb_thread * 2;
+		if (libs[i].draw_handler(&drg_act, img_act, opts->width, opts->height, opts->size, opts->nb_thread) < 0) {
+			/* the other libraries are still checked */
+			ret = -1;
 			printf("Error executing draw with %s\n", name);
-			goto err;
+			printf("FAIL %10s %10s\n", "draw", name);
+			CANVAS_FREE(drg_act);
+			continue;
 		}
-		int gap = cmp_canvas(drg_exp, drg_act, dragon_width, dragon_height, opts->verbose);
+		int gap = check_gap(opts, golden, &drg_exp, img_exp, drg_act,
+				img_act, dragon_width, dragon_height, digests, threshold);
 		float gap_f = gap * 100 / ((float) area);
 		if (gap < threshold && gap >= 0) {
 			printf(fmt, "PASS", "draw", name, threshold, gap, gap_f);
 		} else {
 			ret = -1;
 			printf(fmt, "FAIL", "draw", name, threshold, gap, gap_f);
+			/* check_gap returns before drawing the serial dragon on a wrong size */
+			if (drg_exp == NULL && dragon_draw_serial(&drg_exp, img_exp,
+					opts->width, opts->height, opts->size, opts->nb_thread) < 0) {
+				printf("Error: draw serial failed\n");
+				CANVAS_FREE(drg_act);
+				continue;
+			}
 			if (asprintf(&f1, "dragon_check_failed_serial.ppm") < 0)
 				goto err;
 			if (asprintf(&f2, "dragon_check_failed_%s.ppm", name) < 0)
@@ -319,14 +714,15 @@ static int check_draw(struct command_opts *opts)
 			FREE(f1);
 			FREE(f2);
 		}
-		FREE(drg_act);
+		CANVAS_FREE(drg_act);
 	}
 
 done:
-	FREE(img_exp);
-	FREE(img_act);
-	FREE(drg_exp);
-	FREE(drg_act);
+	CANVAS_FREE(img_exp);
+	CANVAS_FREE(img_act);
+	CANVAS_FREE(drg_exp);
+	CANVAS_FREE(drg_act);
+	FREE(digests);
 	FREE(f1);
 	FREE(f2);
 	return ret;
@@ -335,19 +731,641 @@ err:
 	goto done;
 }
 
+/*
+ * Jobs of the async renderer cancelled in the middle of their draw: the
+ * progress must never go back.
+ */
+static int check_cancel(struct command_opts *opts)
+{
+	if (dragon_renderer_check(opts->size, opts->width, opts->height,
+			opts->nb_thread) < 0) {
+		printf("FAIL %10s %10s\n", "cancel", "async");
+		return -1;
+	}
+	printf("PASS %10s %10s\n", "cancel", "async");
+	return 0;
+}
+
+/*
+ * The other curves against the plain serial walk of
+ * dragon_curve_reference(): same limits, and the draw touches the same
+ * pixels with the colors of the threads.
+ */
+static int check_curves(struct command_opts *opts)
+{
+	struct rgb *img = NULL;
+	char *drg_exp = NULL, *drg_act = NULL;
+	limits_t lim_expected, lim_actual;
+	char *fmt = "%s %10s %10s threshold=%d gap=%d (%.3f%%)\n";
+	size_t area;
+	size_t k;
+	int gap;
+	int ret = 0;
+	int i;
+
+	img = make_canvas(opts->width, opts->height);
+	if (img == NULL)
+		return -1;
+
+	for (i = 1; libs[i].lib != THREAD_LIB_NONE; i++) {
+		if (!libs[i].other_curve)
+			continue;
+		const char *name = libs[i].name;
+		if (dragon_curve_reference(name, &lim_expected, &drg_exp, opts->size) < 0) {
+			printf("Error: reference of %s failed\n", name);
+			goto err;
+		}
+		area = (size_t) (lim_expected.maximums.x - lim_expected.minimums.x) *
+				(lim_expected.maximums.y - lim_expected.minimums.y);
+
+		/* 1. Limites */
+		memset(&lim_actual, 0, sizeof(limits_t));
+		if (libs[i].limits_handler(&lim_actual, opts->size, opts->nb_thread) < 0 ||
+				cmp_limits(&lim_expected, &lim_actual) != 0) {
+			ret = -1;
+			printf("FAIL %10s %10s\n", "limits", name);
+			printf("expected: "); dump_limits(&lim_expected);
+			printf("actual  : "); dump_limits(&lim_actual);
+		} else {
+			printf("PASS %10s %10s\n", "limits", name);
+		}
+
+		/* 2. Pixels touches, dans la palette des fils */
+		if (libs[i].draw_handler(&drg_act, img, opts->width, opts->height,
+				opts->size, opts->nb_thread) < 0 ||
+				canvas_size(drg_act) != area) {
+			ret = -1;
+			printf("Error executing draw with %s\n", name);
+			printf("FAIL %10s %10s\n", "draw", name);
+		} else {
+			gap = 0;
+			for (k = 0; k < area; k++) {
+				if ((drg_act[k] < 0) != (drg_exp[k] < 0) ||
+						drg_act[k] >= opts->nb_thread)
+					gap++;
+			}
+			if (gap != 0)
+				ret = -1;
+			printf(fmt, gap == 0 ? "PASS" : "FAIL", "draw", name, 1, gap,
+					area ? gap * 100 / (float) area : 0);
+		}
+		CANVAS_FREE(drg_exp);
+		CANVAS_FREE(drg_act);
+	}
+
+done:
+	CANVAS_FREE(drg_exp);
+	CANVAS_FREE(drg_act);
+	CANVAS_FREE(img);
+	return ret;
+err:
+	ret = -1;
+	goto done;
+}
+
 static int cmd_check(struct command_opts *opts)
 {
 	int ret = 0;
-	if (check_limits(opts) < 0)
+	struct golden *golden = NULL;
+
+	/* fast mode: limits and tile digests of serial from the cache */
+	if (opts->fast)
+		golden = golden_load(opts->golden_dir, opts->size, opts->width,
+				opts->height, opts->nb_thread);
+
+	if (check_limits(opts, golden) < 0)
+		ret = -1;
+	if (check_draw(opts, &golden) < 0)
 		ret = -1;
-	if (check_draw(opts) < 0)
+	if (check_cancel(opts) < 0)
 		ret = -1;
+	if (check_curves(opts) < 0)
+		ret = -1;
+	free_golden(golden);
 	return ret;
 }
 
 static const struct command_def cmd_check_def =
 { .name = "check", .handler = cmd_check };
 
+/* chunks per thread tried for each phase */
+static const int autotune_factors[] = { 1, 2, 4, 8, 16, 32, 64, 0 };
+
+static double autotune_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * best elapsed time over AUTOTUNE_REPEAT runs of limits or draw
+ */
+static double autotune_run(const struct lib_def *lib, struct command_opts *opts,
+		struct rgb *img, int nb_thread, int limits_only)
+{
+	double best = -1;
+	int i;
+
+	for (i = 0; i < AUTOTUNE_REPEAT; i++) {
+		char *dragon = NULL;
+		limits_t limits;
+		int ret;
+		double t1 = autotune_now();
+		if (limits_only)
+			ret = lib->limits_handler(&limits, opts->size, nb_thread);
+		else
+			ret = lib->draw_handler(&dragon, img, opts->width, opts->height,
+					opts->size, nb_thread);
+		double t2 = autotune_now();
+		CANVAS_FREE(dragon);
+		if (ret < 0)
+			return -1;
+		if (best < 0 || t2 - t1 < best)
+			best = t2 - t1;
+	}
+	return best;
+}
+
+/*
+ * For each thread count, tune the phases one after the other, keeping
+ * the best chunk count of the previous phases. The limits phase is timed
+ * alone, the other phases through a whole draw. The phases the lib does
+ * not read keep the default.
+ */
+static int autotune_lib(const struct lib_def *lib, struct command_opts *opts,
+		struct rgb *img)
+{
+	struct tuning best;
+	struct tuning *t;
+	double best_time = -1;
+	int nb_cpu = sysconf(_SC_NPROCESSORS_ONLN);
+	int nb_thread;
+	int phase;
+	int i;
+
+	t = tuning_get(lib->name, opts->size, opts->width, opts->height);
+	if (t == NULL)
+		return -1;
+
+	if (nb_cpu < 1)
+		nb_cpu = 1;
+	nb_thread = opts->auto_thread ? 1 : opts->nb_thread;
+	while (1) {
+		memset(t->factor, 0, sizeof(t->factor));
+		t->nb_thread = nb_thread;
+		for (phase = 0; phase < TUNING_PHASES; phase++) {
+			double phase_time = -1;
+			int phase_factor = 0;
+			if (!(lib->phases & TUNE(phase)))
+				continue;
+			for (i = 0; autotune_factors[i] != 0; i++) {
+				t->factor[phase] = autotune_factors[i];
+				double time = autotune_run(lib, opts, img, nb_thread,
+						phase == TUNING_LIMITS);
+				if (time < 0)
+					return -1;
+				if (opts->verbose)
+					printf("%10s thread=%-3d %6s=%-3d %.4f s\n", lib->name,
+							nb_thread, tuning_phase_name(phase),
+							autotune_factors[i], time);
+				if (phase_time < 0 || time < phase_time) {
+					phase_time = time;
+					phase_factor = autotune_factors[i];
+				}
+			}
+			t->factor[phase] = phase_factor;
+		}
+
+		double time = autotune_run(lib, opts, img, nb_thread, 0);
+		if (time < 0)
+			return -1;
+		printf("%10s size=%-10"PRId64" thread=%-3d limits=%-3d clear=%-3d "
+				"draw=%-3d render=%-3d time=%.4f s\n", lib->name, opts->size,
+				nb_thread, t->factor[TUNING_LIMITS], t->factor[TUNING_CLEAR],
+				t->factor[TUNING_DRAW], t->factor[TUNING_RENDER], time);
+		if (best_time < 0 || time < best_time) {
+			best_time = time;
+			best = *t;
+		}
+
+		if (!opts->auto_thread || nb_thread >= nb_cpu)
+			break;
+		nb_thread *= 2;
+		if (nb_thread > nb_cpu)
+			nb_thread = nb_cpu;
+	}
+
+	*t = best;
+	return 0;
+}
+
+static int cmd_autotune(struct command_opts *opts)
+{
+	struct rgb *img = NULL;
+	uint64_t size = opts->size;
+	int ret = 0;
+	int p, i;
+
+	img = make_canvas(opts->width, opts->height);
+	if (img == NULL)
+		goto err;
+
+	int power_min = opts->power;
+	int power_max = opts->power_max > 0 ? opts->power_max : opts->power;
+	for (p = power_min; p <= power_max; p++) {
+		if (p > 0)
+			opts->size = 1LL << p;
+		for (i = 1; libs[i].lib != THREAD_LIB_NONE; i++) {
+			if (opts->lib->lib != THREAD_LIB_SERIAL && opts->lib != &libs[i])
+				continue;
+			if (libs[i].phases == 0) {
+				if (opts->lib == &libs[i])
+					printf("%s has no chunk count to tune\n", libs[i].name);
+				continue;
+			}
+			if (autotune_lib(&libs[i], opts, img) < 0) {
+				printf("Error while tuning %s\n", libs[i].name);
+				goto err;
+			}
+		}
+	}
+
+	if (tuning_save(opts->tuning_path) < 0)
+		goto err;
+	printf("tuning saved to %s\n", opts->tuning_path);
+
+done:
+	opts->size = size;
+	CANVAS_FREE(img);
+	return ret;
+err:
+	ret = -1;
+	goto done;
+}
+
+static const struct command_def cmd_autotune_def =
+{ .name = "autotune", .handler = cmd_autotune };
+
+/*
+ * Render server. Each line received on the socket is a request
+ *
+ *   render|limits [lib=NAME] [size=N|power=N] [width=N] [height=N] [thread=N]
+ *
+ * missing parameters take the values given on the command line. The reply
+ * is "ok <bytes>\n" followed by a PPM image for render, "ok minx miny maxx
+ * maxy\n" for limits, or "error <message>\n".
+ */
+struct serve_ctx {
+	struct command_opts *opts;
+	struct render_cache *cache;
+	pthread_mutex_t render_lock;
+};
+
+struct serve_client {
+	struct serve_ctx *ctx;
+	int fd;
+};
+
+static volatile sig_atomic_t serve_stop = 0;
+/* self-pipe: any thread may take the signal, the main thread polls it */
+static int serve_pipe[2] = { -1, -1 };
+
+static void serve_signal(__attribute__((unused)) int sig)
+{
+	int saved = errno;
+	serve_stop = 1;
+	if (write(serve_pipe[1], "", 1) < 0) {
+		/* the pipe is full, a wakeup is already pending */
+	}
+	errno = saved;
+}
+
+static int serve_write(int fd, const void *buf, size_t len)
+{
+	const char *ptr = (const char *) buf;
+	while (len > 0) {
+		ssize_t n = write(fd, ptr, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		ptr += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int serve_error(int fd, const char *msg)
+{
+	char *line = NULL;
+	int ret;
+	if (asprintf(&line, "error %s\n", msg) < 0)
+		return -1;
+	ret = serve_write(fd, line, strlen(line));
+	FREE(line);
+	return ret;
+}
+
+static const char *serve_parse(struct serve_ctx *ctx, char *line, struct render_key *key)
+{
+	struct command_opts *opts = ctx->opts;
+	char *save = NULL;
+	char *tok;
+
+	memset(key, 0, sizeof(struct render_key));
+	snprintf(key->lib, RENDER_LIB_LEN, "%s", opts->lib->name);
+	key->size = opts->size;
+	key->width = opts->width;
+	key->height = opts->height;
+	key->nb_thread = opts->nb_thread;
+
+	tok = strtok_r(line, " \t\r\n", &save);
+	if (tok == NULL)
+		return "empty request";
+	if (strcmp(tok, "render") == 0)
+		key->cmd = RENDER_DRAW;
+	else if (strcmp(tok, "limits") == 0)
+		key->cmd = RENDER_LIMITS;
+	else
+		return "unknown request";
+
+	while ((tok = strtok_r(NULL, " \t\r\n", &save)) != NULL) {
+		char *val = strchr(tok, '=');
+		if (val == NULL)
+			return "malformed parameter";
+		*val++ = '\0';
+		if (strcmp(tok, "lib") == 0) {
+			if (lookup_lib(val) == NULL)
+				return "unknown lib";
+			snprintf(key->lib, RENDER_LIB_LEN, "%s", val);
+		} else if (strcmp(tok, "size") == 0) {
+			key->size = strtoull(val, NULL, 10);
+		} else if (strcmp(tok, "power") == 0) {
+			int power = atoi(val);
+			if (power < 0 || power >= POWER_MAX)
+				return "power out of range";
+			key->size = 1LL << power;
+		} else if (strcmp(tok, "width") == 0) {
+			key->width = atoi(val);
+		} else if (strcmp(tok, "height") == 0) {
+			key->height = atoi(val);
+		} else if (strcmp(tok, "thread") == 0) {
+			key->nb_thread = atoi(val);
+		} else {
+			return "unknown parameter";
+		}
+	}
+
+	if (key->size == 0 || key->size > (1LL << POWER_MAX))
+		return "size out of range";
+	if (key->width <= 0 || key->height <= 0 ||
+			key->width > SERVE_MAX_RES || key->height > SERVE_MAX_RES)
+		return "resolution out of range";
+	if (key->nb_thread <= 0 || key->nb_thread > SERVE_MAX_THREAD)
+		return "thread out of range";
+	return NULL;
+}
+
+/*
+ * result for key, from the cache or computed. Renders are serialized,
+ * the backends already use all the cores.
+ */
+static struct render_entry *serve_compute(struct serve_ctx *ctx, struct render_key *key)
+{
+	struct render_entry *entry;
+	const struct lib_def *lib = lookup_lib(key->lib);
+	limits_t limits;
+	struct rgb *image = NULL;
+	char *dragon = NULL;
+
+	if ((entry = render_cache_get(ctx->cache, key)) != NULL)
+		return entry;
+
+	/* draws of a reentrant library share its threads instead of waiting */
+	if (!lib->reentrant || key->cmd == RENDER_LIMITS)
+		pthread_mutex_lock(&ctx->render_lock);
+	/* another client may have computed it meanwhile */
+	if ((entry = render_cache_get(ctx->cache, key)) != NULL)
+		goto done;
+
+	memset(&limits, 0, sizeof(limits_t));
+	if (key->cmd == RENDER_LIMITS) {
+		if (lib->limits_handler(&limits, key->size, key->nb_thread) < 0)
+			goto done;
+	} else {
+		image = (struct rgb *) malloc(sizeof(struct rgb) * key->width * key->height);
+		if (image == NULL)
+			goto done;
+		if (lib->draw_handler(&dragon, image, key->width, key->height,
+				key->size, key->nb_thread) < 0) {
+			FREE(image);
+			goto done;
+		}
+		CANVAS_FREE(dragon);
+	}
+	entry = render_cache_add(ctx->cache, key, limits, image);
+
+done:
+	if (!lib->reentrant || key->cmd == RENDER_LIMITS)
+		pthread_mutex_unlock(&ctx->render_lock);
+	return entry;
+}
+
+static int serve_reply(int fd, struct render_entry *entry)
+{
+	struct render_key *key = &entry->key;
+	char *header = NULL;
+	char *line = NULL;
+	int ret = 0;
+
+	if (key->cmd == RENDER_LIMITS) {
+		limits_t *l = &entry->limits;
+		if (asprintf(&line, "ok %"PRId64" %"PRId64" %"PRId64" %"PRId64"\n",
+				l->minimums.x, l->minimums.y, l->maximums.x, l->maximums.y) < 0)
+			return -1;
+		ret = serve_write(fd, line, strlen(line));
+		FREE(line);
+		return ret;
+	}
+
+	size_t data = sizeof(struct rgb) * key->width * key->height;
+	if (asprintf(&header, "P6\n%d %d\n%d\n", key->width, key->height, 255) < 0)
+		return -1;
+	if (asprintf(&line, "ok %zu\n", strlen(header) + data) < 0)
+		goto err;
+	if (serve_write(fd, line, strlen(line)) < 0 ||
+			serve_write(fd, header, strlen(header)) < 0 ||
+			serve_write(fd, entry->image, data) < 0)
+		goto err;
+
+done:
+	FREE(header);
+	FREE(line);
+	return ret;
+err:
+	ret = -1;
+	goto done;
+}
+
+static void *serve_client_worker(void *arg)
+{
+	struct serve_client *client = (struct serve_client *) arg;
+	struct serve_ctx *ctx = client->ctx;
+	char line[SERVE_LINE];
+	FILE *in;
+
+	if ((in = fdopen(client->fd, "r")) == NULL) {
+		close(client->fd);
+		FREE(client);
+		return NULL;
+	}
+
+	while (fgets(line, sizeof(line), in) != NULL) {
+		struct render_key key;
+		struct render_entry *entry;
+		const char *msg = serve_parse(ctx, line, &key);
+		int ret;
+
+		if (msg != NULL) {
+			ret = serve_error(client->fd, msg);
+		} else if ((entry = serve_compute(ctx, &key)) == NULL) {
+			ret = serve_error(client->fd, "render failed");
+		} else {
+			ret = serve_reply(client->fd, entry);
+			render_cache_put(ctx->cache, entry);
+		}
+		if (ret < 0)
+			break;
+	}
+
+	fclose(in);
+	FREE(client);
+	return NULL;
+}
+
+static int cmd_serve(struct command_opts *opts)
+{
+	struct sockaddr_un addr;
+	struct sigaction sa;
+	struct pollfd fds[2];
+	struct serve_ctx ctx;
+	pthread_attr_t attr;
+	int sock = -1;
+	int ret = 0;
+
+	if (opts->socket_path == NULL) {
+		printf("Error: --serve requires a socket path\n");
+		return -1;
+	}
+	if (strlen(opts->socket_path) >= sizeof(addr.sun_path)) {
+		printf("Error: socket path too long %s\n", opts->socket_path);
+		return -1;
+	}
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.opts = opts;
+	ctx.cache = render_cache_new(opts->cache_len);
+	if (ctx.cache == NULL)
+		return -1;
+	pthread_mutex_init(&ctx.render_lock, NULL);
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	/*
+	 * SIGINT and SIGTERM must stop the server to remove the socket. The
+	 * signal may land on a client or library thread, so accept() is not
+	 * interrupted: the handler writes to a pipe polled with the socket.
+	 */
+	if (pipe2(serve_pipe, O_NONBLOCK | O_CLOEXEC) < 0) {
+		perror("pipe");
+		goto err;
+	}
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = serve_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	if ((sock = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) {
+		perror("socket");
+		goto err;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, opts->socket_path);
+	unlink(opts->socket_path);
+	if (bind(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		perror(opts->socket_path);
+		goto err;
+	}
+	if (listen(sock, SOMAXCONN) < 0) {
+		perror("listen");
+		goto err;
+	}
+	printf("serving on %s\n", opts->socket_path);
+	fflush(stdout);
+
+	fds[0].fd = sock;
+	fds[0].events = POLLIN;
+	fds[1].fd = serve_pipe[0];
+	fds[1].events = POLLIN;
+	while (!serve_stop) {
+		pthread_t thread;
+		struct serve_client *client;
+		if (poll(fds, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("poll");
+			goto err;
+		}
+		if (fds[1].revents != 0)
+			break;
+		/* the clients are blocking, only the listening socket is not */
+		int fd = accept4(sock, NULL, NULL, SOCK_CLOEXEC);
+		if (fd < 0) {
+			if (errno == EINTR || errno == EAGAIN ||
+					errno == EWOULDBLOCK || errno == ECONNABORTED)
+				continue;
+			perror("accept");
+			goto err;
+		}
+		client = (struct serve_client *) malloc(sizeof(struct serve_client));
+		if (client == NULL) {
+			close(fd);
+			continue;
+		}
+		client->ctx = &ctx;
+		client->fd = fd;
+		if (pthread_create(&thread, &attr, serve_client_worker, client) != 0) {
+			close(fd);
+			FREE(client);
+		}
+	}
+
+done:
+	if (sock >= 0) {
+		close(sock);
+		unlink(opts->socket_path);
+	}
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+	if (serve_pipe[0] >= 0) {
+		close(serve_pipe[0]);
+		close(serve_pipe[1]);
+		serve_pipe[0] = serve_pipe[1] = -1;
+	}
+	pthread_attr_destroy(&attr);
+	/* the cache and the lock are still used by detached clients */
+	return ret;
+err:
+	ret = -1;
+	goto done;
+}
+
+static const struct command_def cmd_serve_def =
+{ .name = "serve", .handler = cmd_serve };
+
 static const struct command_def cmd_def_last =
 { .name = NULL, .handler = NULL };
 
@@ -355,6 +1373,9 @@ static const struct command_def const *commands[] = {
 		&cmd_draw_def,
 		&cmd_limit_def,
 		&cmd_check_def,
+		&cmd_autotune_def,
+		&cmd_serve_def,
+		&cmd_rerender_def,
 		&cmd_def_last
 };
 
@@ -384,6 +1405,7 @@ static void dump_opts(struct command_opts *opts)
 	printf("%10s %s\n", "cmd", opts->cmd->name);
 	printf("%10s %s\n", "lib", opts->lib->name);
 	printf("%10s %s\n", "output", opts->pgm_path);
+	printf("%10s %s\n", "tuning", opts->tuning_path);
 	printf("%10s %d\n", "thread", opts->nb_thread);
 	printf("%10s %d\n", "height", opts->height);
 	printf("%10s %d\n", "width", opts->width);
@@ -416,12 +1438,23 @@ static int parse_opts(int argc, char **argv, struct command_opts *opts)
 			{ "power",	 1, 0, 'p' },
 			{ "max",	 1, 0, 'm' },
 			{ "verbose", 0, 0, 'v' },
+			{ "autotune", 0, 0, 'a' },
+			{ "tuning",	 1, 0, 'u' },
+			{ "fast",	 0, 0, 'f' },
+			{ "golden",	 1, 0, 'g' },
+			{ "serve",	 1, 0, 'S' },
+			{ "cache",	 1, 0, 'C' },
+			{ "pin",	 0, 0, 'P' },
+			{ "save-canvas", 1, 0, 'W' },
+			{ "rle",	 0, 0, 'R' },
+			{ "canvas",	 1, 0, 'K' },
+			{ "palette", 1, 0, 'N' },
 			{ 0, 0, 0, 0}
 	};
 
 	memset(opts, 0, sizeof(struct command_opts));
 
-	while ((opt = getopt_long(argc, argv, "hvx:y:s:c:t:l:p:o:m:", options, &idx)) != -1) {
+	while ((opt = getopt_long(argc, argv, "hvafPRx:y:s:c:t:l:p:o:m:u:g:S:C:W:K:N:", options, &idx)) != -1) {
 		switch(opt) {
 		case 'c':
 			opts->cmd = lookup_cmd(optarg);
@@ -461,6 +1494,45 @@ static int parse_opts(int argc, char **argv, struct command_opts *opts)
 		case 'v':
 			opts->verbose = 1;
 			break;
+		case 'a':
+			opts->cmd = lookup_cmd("autotune");
+			break;
+		case 'u':
+			if (asprintf(&opts->tuning_path, "%s", optarg) < 0)
+				goto err;
+			break;
+		case 'f':
+			opts->fast = 1;
+			break;
+		case 'g':
+			if (asprintf(&opts->golden_dir, "%s", optarg) < 0)
+				goto err;
+			break;
+		case 'S':
+			opts->cmd = lookup_cmd("serve");
+			if (asprintf(&opts->socket_path, "%s", optarg) < 0)
+				goto err;
+			break;
+		case 'C':
+			opts->cache_len = atoi(optarg);
+			break;
+		case 'P':
+			opts->pin = 1;
+			break;
+		case 'W':
+			if (asprintf(&opts->save_canvas, "%s", optarg) < 0)
+				goto err;
+			break;
+		case 'R':
+			opts->rle = 1;
+			break;
+		case 'K':
+			if (asprintf(&opts->canvas_path, "%s", optarg) < 0)
+				goto err;
+			break;
+		case 'N':
+			opts->palette_len = atoi(optarg);
+			break;
 		default:
 			printf("unknown option %c\n", opt);
 			ret = -1;
@@ -475,6 +1547,9 @@ static int parse_opts(int argc, char **argv, struct command_opts *opts)
 	if (opts->pgm_path == NULL)
 		opts->pgm_path = DEFAULT_IMG_PATH;
 
+	if (opts->golden_dir == NULL)
+		opts->golden_dir = DEFAULT_GOLDEN_DIR;
+
 	if (opts->size > (1LL << POWER_MAX)) {
 		printf("Error: size must be lower or equals to %"PRId64"\n", opts->size);
 		ret = -1;
@@ -489,6 +1564,11 @@ static int parse_opts(int argc, char **argv, struct command_opts *opts)
 		ret = -1;
 	}
 
+	if (opts->palette_len < 0) {
+		printf("Error: palette must be positive\n");
+		ret = -1;
+	}
+
 	if (opts->power > 0 && opts->power_max > 0) {
 		if (opts->power > opts->power_max) {
 			printf("Error: max must be greater than or equals to power\n");
@@ -504,6 +1584,21 @@ static int parse_opts(int argc, char **argv, struct command_opts *opts)
 
 	default_int_value(&opts->height, DEFAULT_HEIGHT);
 	default_int_value(&opts->width, DEFAULT_WIDTH);
+	default_int_value(&opts->cache_len, DEFAULT_CACHE_LEN);
+
+	/* profiles from a previous autotune, the thread count is
+	 * only taken from the profile when --thread is not set */
+	if (opts->tuning_path == NULL)
+		opts->tuning_path = tuning_default_path();
+	if (tuning_load(opts->tuning_path) < 0)
+		printf("Warning: failed to load tuning %s\n", opts->tuning_path);
+	opts->auto_thread = (opts->nb_thread == 0);
+	if (opts->auto_thread) {
+		struct tuning *t = tuning_lookup(opts->lib->name, opts->size,
+				opts->width, opts->height);
+		if (t != NULL && t->nb_thread > 0)
+			opts->nb_thread = t->nb_thread;
+	}
 	default_int_value(&opts->nb_thread, DEFAULT_NB_THREAD);
 
 	if (opts->width == 0 || opts->height == 0) {
@@ -524,6 +1619,19 @@ err:
 int main(int argc, char **argv)
 {
 	struct command_opts opts;
+	int ret;
+
+#ifdef HAVE_MPI
+	/* all the ranks run the command, only the first one prints */
+	if (dragon_mpi_init(&argc, &argv) < 0) {
+		printf("Error: MPI initialization failed\n");
+		exit(EXIT_FAILURE);
+	}
+	atexit(dragon_mpi_finalize);
+	if (dragon_mpi_rank() != 0 && freopen("/dev/null", "w", stdout) == NULL)
+		exit(EXIT_FAILURE);
+#endif
+
 	if (parse_opts(argc, argv, &opts) < 0) {
 		printf("Error while parsing arguments\n");
 		usage();
@@ -534,7 +1642,11 @@ int main(int argc, char **argv)
 		usage();
 	}
 
-	if ((opts.cmd->handler(&opts)) < 0) {
+	dragon_tbb_pin(opts.pin);
+
+	ret = opts.cmd->handler(&opts);
+	dragon_renderer_free();
+	if (ret < 0) {
 		printf("Error while executing command %s\n", opts.cmd->name);
 		goto err;
 	}
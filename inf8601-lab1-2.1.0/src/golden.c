@@ -0,0 +1,214 @@
+/*
+ * golden.c
+ *
+ * The cache is a text file per (size, width, height, nb_colors): a header
+ * with the key, the limits and the number of tiles, then one digest per
+ * tile in hexadecimal.
+ *
+ *  Created on: 2026-10-19
+ *      Author: francis
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "dragon.h"
+#include "golden.h"
+
+#define GOLDEN_MAGIC "dragon-golden"
+
+static uint64_t digest_tile(const char *buf, int len)
+{
+	uint64_t h = 0xcbf29ce484222325ULL ^ (uint64_t) len;
+	int i;
+
+	for (i = 0; i + 8 <= len; i += 8) {
+		uint64_t word;
+		memcpy(&word, buf + i, sizeof(word));
+		h = (h ^ word) * 0x100000001b3ULL;
+		h ^= h >> 29;
+	}
+	for (; i < len; i++)
+		h = (h ^ (unsigned char) buf[i]) * 0x100000001b3ULL;
+	return h;
+}
+
+static int golden_nb_tiles(int area)
+{
+	return (area + GOLDEN_TILE - 1) / GOLDEN_TILE;
+}
+
+static char *golden_path(const char *dir, uint64_t size, int width, int height, int nb_colors)
+{
+	char *path = NULL;
+	if (asprintf(&path, "%s/golden-%"PRIu64"-%dx%d-%d.digest", dir, size,
+			width, height, nb_colors) < 0)
+		return NULL;
+	return path;
+}
+
+/*
+ * digests of all the tiles of the canvas, in parallel
+ */
+void golden_digests(char *canvas, int area, uint64_t *digests)
+{
+	int nb_tiles = golden_nb_tiles(area);
+	int tile;
+
+	#pragma omp parallel for schedule(static)
+	for (tile = 0; tile < nb_tiles; tile++) {
+		int start = tile * GOLDEN_TILE;
+		int len = area - start < GOLDEN_TILE ? area - start : GOLDEN_TILE;
+		digests[tile] = digest_tile(canvas + start, len);
+	}
+}
+
+static struct golden *golden_alloc(limits_t limits, uint64_t size, int width,
+		int height, int nb_colors)
+{
+	struct golden *golden = (struct golden *) calloc(1, sizeof(struct golden));
+	if (golden == NULL)
+		return NULL;
+	golden->size = size;
+	golden->width = width;
+	golden->height = height;
+	golden->nb_colors = nb_colors;
+	golden->limits = limits;
+	golden->area = (limits.maximums.x - limits.minimums.x) *
+			(limits.maximums.y - limits.minimums.y);
+	golden->nb_tiles = golden_nb_tiles(golden->area);
+	golden->digests = (uint64_t *) calloc(golden->nb_tiles + 1, sizeof(uint64_t));
+	if (golden->digests == NULL) {
+		FREE(golden);
+		return NULL;
+	}
+	return golden;
+}
+
+struct golden *golden_make(char *canvas, limits_t limits, uint64_t size,
+		int width, int height, int nb_colors)
+{
+	struct golden *golden = golden_alloc(limits, size, width, height, nb_colors);
+	if (golden == NULL)
+		return NULL;
+	golden_digests(canvas, golden->area, golden->digests);
+	return golden;
+}
+
+/*
+ * return NULL when the digests are not in the cache
+ */
+struct golden *golden_load(const char *dir, uint64_t size, int width, int height, int nb_colors)
+{
+	struct golden *golden = NULL;
+	char *path = NULL;
+	FILE *f = NULL;
+	limits_t limits;
+	int nb_tiles;
+	int i;
+
+	if ((path = golden_path(dir, size, width, height, nb_colors)) == NULL)
+		return NULL;
+	if ((f = fopen(path, "r")) == NULL)
+		goto err;
+
+	if (fscanf(f, GOLDEN_MAGIC " %"SCNd64" %"SCNd64" %"SCNd64" %"SCNd64" %d",
+			&limits.minimums.x, &limits.minimums.y,
+			&limits.maximums.x, &limits.maximums.y, &nb_tiles) != 5)
+		goto err;
+
+	golden = golden_alloc(limits, size, width, height, nb_colors);
+	if (golden == NULL || golden->nb_tiles != nb_tiles)
+		goto err;
+	for (i = 0; i < nb_tiles; i++) {
+		if (fscanf(f, "%"SCNx64, &golden->digests[i]) != 1)
+			goto err;
+	}
+
+done:
+	if (f != NULL)
+		fclose(f);
+	FREE(path);
+	return golden;
+err:
+	if (f != NULL)
+		fprintf(stderr, "%s: corrupted golden digests, ignored\n", path);
+	free_golden(golden);
+	golden = NULL;
+	goto done;
+}
+
+/* mkdir -p */
+static int make_dirs(const char *dir)
+{
+	char *path = strdup(dir);
+	char *p;
+	int ret = 0;
+
+	if (path == NULL)
+		return -1;
+	for (p = path + 1; *p != '\0'; p++) {
+		if (*p != '/')
+			continue;
+		*p = '\0';
+		if (mkdir(path, 0755) < 0 && errno != EEXIST)
+			ret = -1;
+		*p = '/';
+	}
+	if (ret == 0 && mkdir(path, 0755) < 0 && errno != EEXIST)
+		ret = -1;
+	free(path);
+	return ret;
+}
+
+int golden_save(const char *dir, struct golden *golden)
+{
+	char *path = NULL;
+	FILE *f = NULL;
+	int ret = 0;
+	int i;
+
+	if (golden == NULL)
+		return -1;
+	if (make_dirs(dir) < 0) {
+		perror(dir);
+		return -1;
+	}
+	if ((path = golden_path(dir, golden->size, golden->width, golden->height,
+			golden->nb_colors)) == NULL)
+		return -1;
+	if ((f = fopen(path, "w")) == NULL) {
+		perror(path);
+		goto err;
+	}
+
+	fprintf(f, GOLDEN_MAGIC " %"PRId64" %"PRId64" %"PRId64" %"PRId64" %d\n",
+			golden->limits.minimums.x, golden->limits.minimums.y,
+			golden->limits.maximums.x, golden->limits.maximums.y,
+			golden->nb_tiles);
+	for (i = 0; i < golden->nb_tiles; i++)
+		fprintf(f, "%016"PRIx64"\n", golden->digests[i]);
+	if (fclose(f) != 0)
+		goto err;
+
+done:
+	FREE(path);
+	return ret;
+err:
+	ret = -1;
+	goto done;
+}
+
+void free_golden(struct golden *golden)
+{
+	if (golden == NULL)
+		return;
+	FREE(golden->digests);
+	free(golden);
+}
@@ -0,0 +1,36 @@
+/*
+ * golden.h
+ *
+ * Digests of the serial dragon, one per tile of the canvas, cached on
+ * disk so that a check does not need to draw the serial dragon again.
+ *
+ *  Created on: 2026-10-19
+ *      Author: francis
+ */
+
+#ifndef GOLDEN_H_
+#define GOLDEN_H_
+
+#include "dragon.h"
+
+#define GOLDEN_TILE (64 * 1024)
+
+struct golden {
+	uint64_t size;
+	int width;
+	int height;
+	int nb_colors;
+	limits_t limits;
+	int area;
+	int nb_tiles;
+	uint64_t *digests;
+};
+
+struct golden *golden_make(char *canvas, limits_t limits, uint64_t size,
+		int width, int height, int nb_colors);
+struct golden *golden_load(const char *dir, uint64_t size, int width, int height, int nb_colors);
+int golden_save(const char *dir, struct golden *golden);
+void golden_digests(char *canvas, int area, uint64_t *digests);
+void free_golden(struct golden *golden);
+
+#endif /* GOLDEN_H_ */
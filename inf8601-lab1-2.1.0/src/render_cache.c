@@ -0,0 +1,150 @@
+/*
+ * render_cache.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: francis
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "dragon.h"
+#include "render_cache.h"
+
+struct render_cache {
+	pthread_mutex_t lock;
+	int len;
+	int nb_entries;
+	unsigned long clock;
+	struct render_entry **entries;
+};
+
+static int key_equal(struct render_key *k1, struct render_key *k2)
+{
+	return k1->cmd == k2->cmd && k1->size == k2->size &&
+			k1->width == k2->width && k1->height == k2->height &&
+			k1->nb_thread == k2->nb_thread &&
+			strncmp(k1->lib, k2->lib, RENDER_LIB_LEN) == 0;
+}
+
+static void entry_free(struct render_entry *entry)
+{
+	FREE(entry->image);
+	free(entry);
+}
+
+/* remove entry i from the cache, the lock is held */
+static void cache_unlink(struct render_cache *cache, int i)
+{
+	struct render_entry *entry = cache->entries[i];
+	cache->entries[i] = cache->entries[--cache->nb_entries];
+	entry->cached = 0;
+	if (entry->refs == 0)
+		entry_free(entry);
+}
+
+struct render_cache *render_cache_new(int len)
+{
+	struct render_cache *cache;
+
+	if (len <= 0)
+		return NULL;
+	cache = (struct render_cache *) calloc(1, sizeof(struct render_cache));
+	if (cache == NULL)
+		return NULL;
+	cache->entries = (struct render_entry **) calloc(len, sizeof(struct render_entry *));
+	if (cache->entries == NULL) {
+		FREE(cache);
+		return NULL;
+	}
+	cache->len = len;
+	pthread_mutex_init(&cache->lock, NULL);
+	return cache;
+}
+
+void render_cache_free(struct render_cache *cache)
+{
+	if (cache == NULL)
+		return;
+	while (cache->nb_entries > 0)
+		cache_unlink(cache, 0);
+	pthread_mutex_destroy(&cache->lock);
+	FREE(cache->entries);
+	free(cache);
+}
+
+/*
+ * return the entry with a reference held, or NULL on a miss
+ */
+struct render_entry *render_cache_get(struct render_cache *cache, struct render_key *key)
+{
+	struct render_entry *entry = NULL;
+	int i;
+
+	pthread_mutex_lock(&cache->lock);
+	for (i = 0; i < cache->nb_entries; i++) {
+		if (key_equal(&cache->entries[i]->key, key)) {
+			entry = cache->entries[i];
+			entry->refs++;
+			entry->last_use = ++cache->clock;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&cache->lock);
+	return entry;
+}
+
+/*
+ * Insert a result, the cache takes ownership of image. The least recently
+ * used entry is evicted when the cache is full. The new entry is returned
+ * with a reference held, NULL if it could not be allocated.
+ */
+struct render_entry *render_cache_add(struct render_cache *cache, struct render_key *key,
+		limits_t limits, struct rgb *image)
+{
+	struct render_entry *entry;
+	int i;
+
+	entry = (struct render_entry *) calloc(1, sizeof(struct render_entry));
+	if (entry == NULL) {
+		FREE(image);
+		return NULL;
+	}
+	entry->key = *key;
+	entry->limits = limits;
+	entry->image = image;
+	entry->refs = 1;
+	entry->cached = 1;
+
+	pthread_mutex_lock(&cache->lock);
+	for (i = 0; i < cache->nb_entries; i++) {
+		if (key_equal(&cache->entries[i]->key, key)) {
+			cache_unlink(cache, i);
+			break;
+		}
+	}
+	if (cache->nb_entries == cache->len) {
+		int lru = 0;
+		for (i = 1; i < cache->nb_entries; i++) {
+			if (cache->entries[i]->last_use < cache->entries[lru]->last_use)
+				lru = i;
+		}
+		cache_unlink(cache, lru);
+	}
+	entry->last_use = ++cache->clock;
+	cache->entries[cache->nb_entries++] = entry;
+	pthread_mutex_unlock(&cache->lock);
+	return entry;
+}
+
+void render_cache_put(struct render_cache *cache, struct render_entry *entry)
+{
+	if (entry == NULL)
+		return;
+	pthread_mutex_lock(&cache->lock);
+	entry->refs--;
+	if (entry->refs == 0 && !entry->cached)
+		entry_free(entry);
+	pthread_mutex_unlock(&cache->lock);
+}
@@ -0,0 +1,51 @@
+/*
+ * render_cache.h
+ *
+ * LRU cache of finished images and limits, shared by the threads of the
+ * render server. Entries are reference counted: an evicted entry stays
+ * valid until its last user puts it back.
+ *
+ *  Created on: 2026-10-19
+ *      Author: francis
+ */
+
+#ifndef RENDER_CACHE_H_
+#define RENDER_CACHE_H_
+
+#include "dragon.h"
+
+#define RENDER_LIB_LEN 16
+
+enum render_cmd {
+	RENDER_DRAW,
+	RENDER_LIMITS,
+};
+
+struct render_key {
+	enum render_cmd cmd;
+	char lib[RENDER_LIB_LEN];
+	uint64_t size;
+	int width;
+	int height;
+	int nb_thread;
+};
+
+struct render_entry {
+	struct render_key key;
+	limits_t limits;
+	struct rgb *image;
+	int refs;
+	int cached;
+	unsigned long last_use;
+};
+
+struct render_cache;
+
+struct render_cache *render_cache_new(int len);
+void render_cache_free(struct render_cache *cache);
+struct render_entry *render_cache_get(struct render_cache *cache, struct render_key *key);
+struct render_entry *render_cache_add(struct render_cache *cache, struct render_key *key,
+		limits_t limits, struct rgb *image);
+void render_cache_put(struct render_cache *cache, struct render_entry *entry);
+
+#endif /* RENDER_CACHE_H_ */
@@ -0,0 +1,324 @@
+/*
+ * snapshot.c
+ *
+ * The file is a header, the palette, then the canvas. A raw canvas starts
+ * on a page and is used in place from the mapping. A run-length encoded
+ * canvas has a table of the offsets of its rows, so that the rows are
+ * encoded and decoded in parallel. A run is a color followed by its
+ * length on 16 bits, longer runs are split.
+ *
+ *  Created on: 2026-10-19
+ *      Author: francis
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "dragon.h"
+#include "color.h"
+#include "snapshot.h"
+
+#define SNAPSHOT_MAGIC		"dragcnv"
+#define SNAPSHOT_VERSION	1
+#define SNAPSHOT_PAGE		4096
+#define SNAPSHOT_RUN		3
+#define SNAPSHOT_RUN_MAX	0xffff
+
+struct snapshot_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t flags;
+	uint64_t size;
+	limits_t limits;
+	int32_t dragon_width;
+	int32_t dragon_height;
+	int32_t nb_colors;
+	int32_t reserved;
+	/* offset of the canvas, or of the row offsets when encoded */
+	uint64_t data;
+};
+
+/*
+ * runs of the row, only counted when out is NULL, return their bytes
+ */
+static size_t rle_encode(const char *row, int width, char *out)
+{
+	size_t len = 0;
+	int j = 0;
+
+	while (j < width) {
+		char id = row[j];
+		int run = 1;
+		while (j + run < width && row[j + run] == id && run < SNAPSHOT_RUN_MAX)
+			run++;
+		if (out != NULL) {
+			uint16_t r = run;
+			out[len] = id;
+			memcpy(out + len + 1, &r, sizeof(r));
+		}
+		len += SNAPSHOT_RUN;
+		j += run;
+	}
+	return len;
+}
+
+/*
+ * negative ids are the background, the others index the palette
+ */
+static int ids_valid(const char *ids, size_t len, int nb_colors)
+{
+	size_t k;
+
+	for (k = 0; k < len; k++) {
+		if ((signed char) ids[k] >= nb_colors)
+			return 0;
+	}
+	return 1;
+}
+
+static int rle_decode(const char *in, size_t len, char *row, int width,
+		int nb_colors)
+{
+	size_t k;
+	int j = 0;
+
+	for (k = 0; k + SNAPSHOT_RUN <= len; k += SNAPSHOT_RUN) {
+		uint16_t run;
+		memcpy(&run, in + k + 1, sizeof(run));
+		if (j + run > width || !ids_valid(in + k, 1, nb_colors))
+			return -1;
+		memset(row + j, in[k], run);
+		j += run;
+	}
+	return j == width ? 0 : -1;
+}
+
+static uint64_t page_align(uint64_t offset)
+{
+	return (offset + SNAPSHOT_PAGE - 1) & ~((uint64_t) SNAPSHOT_PAGE - 1);
+}
+
+static int write_all(FILE *f, const void *buf, size_t len)
+{
+	return fwrite(buf, 1, len, f) == len ? 0 : -1;
+}
+
+int snapshot_save(const char *path, char *dragon, limits_t limits, uint64_t size,
+		struct palette *palette, int flags, int nb_thread)
+{
+	struct snapshot_header header;
+	uint64_t *offsets = NULL;
+	char *data = NULL;
+	FILE *f = NULL;
+	int width = limits.maximums.x - limits.minimums.x;
+	int height = limits.maximums.y - limits.minimums.y;
+	uint64_t pal_len = palette->len * sizeof(struct rgb);
+	uint64_t data_len;
+	int ret = 0;
+	int i;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+	header.version = SNAPSHOT_VERSION;
+	header.flags = flags;
+	header.size = size;
+	header.limits = limits;
+	header.dragon_width = width;
+	header.dragon_height = height;
+	header.nb_colors = palette->len;
+	header.data = page_align(sizeof(header) + pal_len);
+
+	if (flags & SNAPSHOT_RLE) {
+		/* 1. Longueur de chaque rangee, puis leur position */
+		offsets = (uint64_t *) calloc(height + 1, sizeof(uint64_t));
+		if (offsets == NULL)
+			goto err;
+		#pragma omp parallel for schedule(dynamic) num_threads(nb_thread)
+		for (i = 0; i < height; i++)
+			offsets[i + 1] = rle_encode(dragon + (int64_t) i * width, width, NULL);
+		for (i = 0; i < height; i++)
+			offsets[i + 1] += offsets[i];
+
+		/* 2. Encoder les rangees en parallele */
+		data_len = offsets[height];
+		data = (char *) malloc(data_len + 1);
+		if (data == NULL)
+			goto err;
+		#pragma omp parallel for schedule(dynamic) num_threads(nb_thread)
+		for (i = 0; i < height; i++)
+			rle_encode(dragon + (int64_t) i * width, width, data + offsets[i]);
+	} else {
+		data_len = (uint64_t) width * height;
+	}
+
+	if ((f = fopen(path, "w")) == NULL) {
+		perror(path);
+		goto err;
+	}
+	if (write_all(f, &header, sizeof(header)) < 0 ||
+			write_all(f, palette->colors, pal_len) < 0 ||
+			fseeko(f, header.data, SEEK_SET) < 0)
+		goto err;
+	if (flags & SNAPSHOT_RLE) {
+		if (write_all(f, offsets, (height + 1) * sizeof(uint64_t)) < 0 ||
+				write_all(f, data, data_len) < 0)
+			goto err;
+	} else {
+		if (write_all(f, dragon, data_len) < 0)
+			goto err;
+	}
+	if (fclose(f) != 0) {
+		f = NULL;
+		goto err;
+	}
+	f = NULL;
+
+done:
+	FREE(offsets);
+	FREE(data);
+	return ret;
+err:
+	if (f != NULL)
+		fclose(f);
+	ret = -1;
+	goto done;
+}
+
+static struct palette *snapshot_palette(struct rgb *colors, int len)
+{
+	struct palette *palette = (struct palette *) malloc(sizeof(struct palette));
+	if (palette == NULL)
+		return NULL;
+	palette->colors = (struct rgb *) malloc(len * sizeof(struct rgb));
+	if (palette->colors == NULL) {
+		FREE(palette);
+		return NULL;
+	}
+	memcpy(palette->colors, colors, len * sizeof(struct rgb));
+	palette->len = len;
+	return palette;
+}
+
+/*
+ * Map the snapshot. A raw canvas is not copied, an encoded canvas is
+ * decoded by nb_thread threads.
+ */
+struct snapshot *snapshot_load(const char *path, int nb_thread)
+{
+	struct snapshot *snapshot = NULL;
+	struct snapshot_header *header;
+	struct stat st;
+	char *map;
+	int fd = -1;
+	int error = 0;
+	int i;
+
+	if ((fd = open(path, O_RDONLY)) < 0) {
+		perror(path);
+		return NULL;
+	}
+	if ((snapshot = (struct snapshot *) calloc(1, sizeof(struct snapshot))) == NULL)
+		goto err;
+	if (fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(struct snapshot_header))
+		goto corrupted;
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED)
+		goto err;
+	snapshot->map = map;
+	snapshot->map_len = st.st_size;
+
+	/* 1. Valider l'entete avant de lire la palette et le canevas */
+	header = (struct snapshot_header *) map;
+	if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0 ||
+			header->version != SNAPSHOT_VERSION ||
+			header->nb_colors <= 0 ||
+			header->dragon_width <= 0 || header->dragon_height <= 0 ||
+			header->data > snapshot->map_len ||
+			header->data < sizeof(*header) + (uint64_t) header->nb_colors * sizeof(struct rgb))
+		goto corrupted;
+
+	snapshot->size = header->size;
+	snapshot->limits = header->limits;
+	snapshot->dragon_width = header->dragon_width;
+	snapshot->dragon_height = header->dragon_height;
+	snapshot->flags = header->flags;
+	snapshot->palette = snapshot_palette((struct rgb *) (map + sizeof(*header)),
+			header->nb_colors);
+	if (snapshot->palette == NULL)
+		goto err;
+
+	int width = snapshot->dragon_width;
+	int height = snapshot->dragon_height;
+	int nb_colors = header->nb_colors;
+	uint64_t left = snapshot->map_len - header->data;
+	if (!(snapshot->flags & SNAPSHOT_RLE)) {
+		if ((uint64_t) width * height > left)
+			goto corrupted;
+		snapshot->dragon = map + header->data;
+		madvise(snapshot->dragon, (size_t) width * height, MADV_WILLNEED);
+		#pragma omp parallel for schedule(dynamic) num_threads(nb_thread)
+		for (i = 0; i < height; i++) {
+			if (!ids_valid(snapshot->dragon + (int64_t) i * width, width, nb_colors))
+				error = 1;
+		}
+		if (error)
+			goto corrupted;
+		goto done;
+	}
+
+	if (header->data % sizeof(uint64_t) != 0 ||
+			(uint64_t) (height + 1) * sizeof(uint64_t) > left)
+		goto corrupted;
+	uint64_t *offsets = (uint64_t *) (map + header->data);
+	char *rows = (char *) (offsets + height + 1);
+	if (offsets[height] > snapshot->map_len - (uint64_t) (rows - map))
+		goto corrupted;
+	/*
+	 * 2. Les decalages ne decroissent jamais : chaque ligne est alors dans
+	 * [offsets[0], offsets[height]], verifie avant le decodage parallele
+	 */
+	for (i = 0; i < height; i++) {
+		if (offsets[i] > offsets[i + 1])
+			goto corrupted;
+	}
+	snapshot->dragon = (char *) canvas_alloc((size_t) width * height);
+	if (snapshot->dragon == NULL)
+		goto err;
+	/* 3. Decoder les rangees en parallele */
+	#pragma omp parallel for schedule(dynamic) num_threads(nb_thread)
+	for (i = 0; i < height; i++) {
+		if (rle_decode(rows + offsets[i], offsets[i + 1] - offsets[i],
+				snapshot->dragon + (int64_t) i * width, width, nb_colors) < 0)
+			error = 1;
+	}
+	if (error)
+		goto corrupted;
+
+done:
+	close(fd);
+	return snapshot;
+corrupted:
+	fprintf(stderr, "%s: corrupted canvas snapshot\n", path);
+err:
+	free_snapshot(snapshot);
+	snapshot = NULL;
+	goto done;
+}
+
+void free_snapshot(struct snapshot *snapshot)
+{
+	if (snapshot == NULL)
+		return;
+	if (snapshot->flags & SNAPSHOT_RLE)
+		CANVAS_FREE(snapshot->dragon);
+	if (snapshot->map != NULL)
+		munmap(snapshot->map, snapshot->map_len);
+	free_palette(snapshot->palette);
+	free(snapshot);
+}
@@ -0,0 +1,38 @@
+/*
+ * snapshot.h
+ *
+ * Canvas of a dragon saved on disk with its limits, size and palette, to
+ * render it again at another resolution without drawing it.
+ *
+ *  Created on: 2026-10-19
+ *      Author: francis
+ */
+
+#ifndef SNAPSHOT_H_
+#define SNAPSHOT_H_
+
+#include <stddef.h>
+#include "dragon.h"
+
+/* rows are run-length encoded */
+#define SNAPSHOT_RLE	1
+
+struct snapshot {
+	uint64_t size;
+	limits_t limits;
+	int dragon_width;
+	int dragon_height;
+	int flags;
+	struct palette *palette;
+	/* points in the mapping for a raw canvas, read only */
+	char *dragon;
+	void *map;
+	size_t map_len;
+};
+
+int snapshot_save(const char *path, char *dragon, limits_t limits, uint64_t size,
+		struct palette *palette, int flags, int nb_thread);
+struct snapshot *snapshot_load(const char *path, int nb_thread);
+void free_snapshot(struct snapshot *snapshot);
+
+#endif /* SNAPSHOT_H_ */
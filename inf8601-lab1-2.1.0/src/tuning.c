@@ -0,0 +1,188 @@
+/*
+ * tuning.c
+ *
+ * Grain size and thread count profiles
+ *
+ *  Created on: 2026-10-19
+ *      Author: francis
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include "dragon.h"
+#include "tuning.h"
+
+#define TUNING_HOST_LEN 256
+
+static const char *phase_names[TUNING_PHASES] = {
+		"limits", "clear", "draw", "render"
+};
+
+/* profiles are loaded once, then only read by the backends */
+static struct tuning *profiles = NULL;
+static int nb_profiles = 0;
+
+const char *tuning_phase_name(enum tuning_phase phase)
+{
+	if (phase < 0 || phase >= TUNING_PHASES)
+		return NULL;
+	return phase_names[phase];
+}
+
+/*
+ * $HOME/.dragonizer-<hostname>.tuning, the caller must free the path
+ */
+char *tuning_default_path(void)
+{
+	char host[TUNING_HOST_LEN];
+	char *home = getenv("HOME");
+	char *path = NULL;
+
+	if (gethostname(host, sizeof(host)) < 0)
+		strcpy(host, "localhost");
+	host[sizeof(host) - 1] = '\0';
+	if (home == NULL)
+		home = ".";
+	if (asprintf(&path, "%s/.dragonizer-%s.tuning", home, host) < 0)
+		return NULL;
+	return path;
+}
+
+void tuning_clear(void)
+{
+	FREE(profiles);
+	nb_profiles = 0;
+}
+
+/*
+ * A width or height of 0 matches any resolution, the limits phase does
+ * not depend on it.
+ */
+struct tuning *tuning_lookup(const char *lib, uint64_t size, int width, int height)
+{
+	int i;
+	if (lib == NULL)
+		return NULL;
+	for (i = 0; i < nb_profiles; i++) {
+		struct tuning *t = &profiles[i];
+		if (t->size == size &&
+				(width == 0 || t->width == width) &&
+				(height == 0 || t->height == height) &&
+				strncmp(t->lib, lib, TUNING_LIB_LEN) == 0)
+			return t;
+	}
+	return NULL;
+}
+
+/*
+ * lookup the profile, create an empty one if it does not exist
+ */
+struct tuning *tuning_get(const char *lib, uint64_t size, int width, int height)
+{
+	struct tuning *t = tuning_lookup(lib, size, width, height);
+	if (t != NULL)
+		return t;
+
+	t = (struct tuning *) realloc(profiles, sizeof(struct tuning) * (nb_profiles + 1));
+	if (t == NULL)
+		return NULL;
+	profiles = t;
+	t = &profiles[nb_profiles++];
+	memset(t, 0, sizeof(struct tuning));
+	snprintf(t->lib, TUNING_LIB_LEN, "%s", lib);
+	t->size = size;
+	t->width = width;
+	t->height = height;
+	return t;
+}
+
+/*
+ * Number of chunks to split a phase into. Without a profile, or when the
+ * profile does not set the phase, def chunks per thread are used.
+ */
+int tuning_chunks(const char *lib, enum tuning_phase phase, uint64_t size,
+		int width, int height, int nb_thread, int def)
+{
+	struct tuning *t = tuning_lookup(lib, size, width, height);
+	int factor = def;
+	if (t != NULL && t->factor[phase] > 0)
+		factor = t->factor[phase];
+	if (factor <= 0)
+		factor = 1;
+	return factor * nb_thread;
+}
+
+/*
+ * Load the profiles from path. A missing file is not an error, the
+ * backends then use their default grain sizes.
+ */
+int tuning_load(const char *path)
+{
+	FILE *f = NULL;
+	char line[512];
+	int ret = 0;
+
+	if (path == NULL)
+		return -1;
+	if ((f = fopen(path, "r")) == NULL)
+		return (errno == ENOENT) ? 0 : -1;
+
+	while (fgets(line, sizeof(line), f) != NULL) {
+		struct tuning t;
+		struct tuning *dst;
+		char lib[TUNING_LIB_LEN];
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+		memset(&t, 0, sizeof(t));
+		if (sscanf(line, "%15s %"SCNu64" %d %d %d %d %d %d %d", lib, &t.size,
+				&t.width, &t.height, &t.nb_thread,
+				&t.factor[TUNING_LIMITS], &t.factor[TUNING_CLEAR],
+				&t.factor[TUNING_DRAW], &t.factor[TUNING_RENDER]) != 9) {
+			fprintf(stderr, "%s: malformed tuning entry %s", path, line);
+			ret = -1;
+			continue;
+		}
+		dst = tuning_get(lib, t.size, t.width, t.height);
+		if (dst == NULL)
+			goto err;
+		memcpy(dst->factor, t.factor, sizeof(t.factor));
+		dst->nb_thread = t.nb_thread;
+	}
+
+done:
+	fclose(f);
+	return ret;
+err:
+	ret = -1;
+	goto done;
+}
+
+int tuning_save(const char *path)
+{
+	FILE *f = NULL;
+	int i;
+
+	if (path == NULL)
+		return -1;
+	if ((f = fopen(path, "w")) == NULL) {
+		perror(path);
+		return -1;
+	}
+
+	fprintf(f, "# lib size width height thread limits clear draw render\n");
+	for (i = 0; i < nb_profiles; i++) {
+		struct tuning *t = &profiles[i];
+		fprintf(f, "%s %"PRIu64" %d %d %d %d %d %d %d\n", t->lib, t->size,
+				t->width, t->height, t->nb_thread,
+				t->factor[TUNING_LIMITS], t->factor[TUNING_CLEAR],
+				t->factor[TUNING_DRAW], t->factor[TUNING_RENDER]);
+	}
+	fclose(f);
+	return 0;
+}
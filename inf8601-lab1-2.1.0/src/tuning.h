@@ -0,0 +1,47 @@
+/*
+ * tuning.h
+ *
+ * Grain size and thread count profiles. The profiles are measured by the
+ * autotune command and stored in a per-host file, one entry per
+ * (lib, size, width, height).
+ *
+ *  Created on: 2026-10-19
+ *      Author: francis
+ */
+
+#ifndef TUNING_H_
+#define TUNING_H_
+
+#include <stdint.h>
+
+#define TUNING_LIB_LEN 16
+
+enum tuning_phase {
+	TUNING_LIMITS,
+	TUNING_CLEAR,
+	TUNING_DRAW,
+	TUNING_RENDER,
+	TUNING_PHASES,
+};
+
+struct tuning {
+	char lib[TUNING_LIB_LEN];
+	uint64_t size;
+	int width;
+	int height;
+	int nb_thread;
+	/* chunks per thread for each phase, 0 selects the backend default */
+	int factor[TUNING_PHASES];
+};
+
+const char *tuning_phase_name(enum tuning_phase phase);
+char *tuning_default_path(void);
+int tuning_load(const char *path);
+int tuning_save(const char *path);
+void tuning_clear(void);
+struct tuning *tuning_lookup(const char *lib, uint64_t size, int width, int height);
+struct tuning *tuning_get(const char *lib, uint64_t size, int width, int height);
+int tuning_chunks(const char *lib, enum tuning_phase phase, uint64_t size,
+		int width, int height, int nb_thread, int def);
+
+#endif /* TUNING_H_ */
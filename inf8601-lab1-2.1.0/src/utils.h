@@ -10,4 +10,24 @@
 
 int gettid();
 
+#define ERR_THROW(val, err, msg)             \
+        do {                                                \
+            if (val != err) {                                     \
+                fprintf(stderr, "%s:%d %d != %d %s\n", __FILE__, __LINE__, val, err, msg); \
+                goto error;                                 \
+            }                                               \
+        } while(0)
+
+#define ERR_ASSERT(cond, msg)                                           \
+        if (!(cond)) {                                                   \
+            fprintf(stderr, "%s:%d %s\n", __FILE__, __LINE__, msg); \
+            goto error;                                                  \
+        }
+
+#define ERR_NOMEM(ptr)                             \
+        if (ptr == NULL) {                                          \
+            fprintf(stderr, "ENOMEM\n");    \
+            goto error;                                      \
+        }
+
 #endif /* UTILS_H_ */
@@ -1,4 +1,11 @@
 #!/bin/sh
 
-${abs_top_srcdir}/src/dragonizer --cmd check --power 22 --thread 10
+${abs_top_srcdir}/src/dragonizer --cmd check --power 22 --thread 10 || exit 1
 
+# fast check, the first run fills the digest cache, the second uses it
+GOLDEN=$(mktemp -d)
+for i in 1 2; do
+	${abs_top_srcdir}/src/dragonizer --cmd check --fast --golden $GOLDEN \
+		--power 22 --thread 10 || { rm -rf $GOLDEN; exit 1; }
+done
+rm -rf $GOLDEN
@@ -0,0 +1,131 @@
+/*
+ * adaptive.c
+ *
+ * The controller keeps a moving average of the frame time. Over budget, it
+ * goes down one scale. It goes back up when the average, scaled by the
+ * pixels of the larger frame, fits in the budget with some margin. A scale
+ * is kept for a few frames before any change, so that it does not
+ * oscillate between two scales.
+ *
+ *  Created on: 2026-10-19
+ *      Author: francis
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <stdatomic.h>
+
+#include "sinoscope.h"
+#include "adaptive.h"
+#include "memory.h"
+
+/* frames at a scale before it may change */
+#define ADAPTIVE_SETTLE 10
+/* weight of the last frame in the average */
+#define ADAPTIVE_ALPHA 0.2
+/* part of the budget a larger scale must fit in */
+#define ADAPTIVE_MARGIN 0.8
+
+static const float scales[] = { 1.0f, 0.85f, 0.7f, 0.5f, 0.35f, 0.25f };
+#define NB_SCALES (sizeof(scales) / sizeof(scales[0]))
+
+struct adaptive {
+	int width;
+	int height;
+	double budget_ms;
+	double average_ms;
+	int frames;
+	/* read by the display for the title */
+	atomic_int level;
+};
+
+struct adaptive *make_adaptive(int width, int height, float target_fps)
+{
+	struct adaptive *a = NULL;
+
+	if (target_fps <= 0)
+		return NULL;
+	if (ALLOC(a) < 0)
+		return NULL;
+	a->width = width;
+	a->height = height;
+	a->budget_ms = 1000.0 / target_fps;
+	atomic_init(&a->level, 0);
+	return a;
+}
+
+void free_adaptive(struct adaptive *a)
+{
+	FREE(a);
+}
+
+static int scaled(int size, int level)
+{
+	int s = lrintf(size * scales[level]);
+	return s < 3 ? 3 : s;
+}
+
+/*
+ * Resize the frame to the current scale, in its own buffer. The border is
+ * never drawn, it is cleared since it may hold a larger frame.
+ */
+void adaptive_apply(struct adaptive *a, sinoscope_t *frame)
+{
+	int level = atomic_load_explicit(&a->level, memory_order_relaxed);
+	int w = scaled(a->width, level);
+	int h = scaled(a->height, level);
+	int x;
+
+	frame->width = w;
+	frame->height = h;
+	frame->buf_size = w * h * 3;
+	frame->dx = 3 * M_PI / w;
+	frame->dy = 3 * M_PI / h;
+
+	memset(frame->buf, 0, w * 3);
+	memset(frame->buf + (h - 1) * w * 3, 0, w * 3);
+	for (x = 1; x < h - 1; x++) {
+		memset(frame->buf + x * w * 3, 0, 3);
+		memset(frame->buf + (x * w + w - 1) * 3, 0, 3);
+	}
+}
+
+void adaptive_update(struct adaptive *a, double frame_ms)
+{
+	int level = atomic_load_explicit(&a->level, memory_order_relaxed);
+	double up;
+
+	if (a->frames == 0)
+		a->average_ms = frame_ms;
+	else
+		a->average_ms += ADAPTIVE_ALPHA * (frame_ms - a->average_ms);
+	if (++a->frames < ADAPTIVE_SETTLE)
+		return;
+
+	if (a->average_ms > a->budget_ms && level < (int) NB_SCALES - 1) {
+		level++;
+	} else if (level > 0) {
+		up = a->average_ms * (scales[level - 1] * scales[level - 1]) /
+				(scales[level] * scales[level]);
+		if (up < a->budget_ms * ADAPTIVE_MARGIN)
+			level--;
+		else
+			return;
+	} else {
+		return;
+	}
+	a->frames = 0;
+	atomic_store_explicit(&a->level, level, memory_order_relaxed);
+}
+
+/*
+ * Scale of the frames being computed, 1 is the size of the window.
+ */
+float adaptive_scale(struct adaptive *a)
+{
+	if (a == NULL)
+		return 1.0f;
+	return scales[atomic_load_explicit(&a->level, memory_order_relaxed)];
+}
@@ -0,0 +1,25 @@
+/*
+ * adaptive.h
+ *
+ * Resolution of the frames chosen to hold a frame time budget. The frames
+ * are computed smaller when they take too long, the texture stretches them
+ * to the window.
+ *
+ *  Created on: 2026-10-19
+ *      Author: francis
+ */
+
+#ifndef ADAPTIVE_H_
+#define ADAPTIVE_H_
+
+#include "sinoscope.h"
+
+struct adaptive;
+
+struct adaptive *make_adaptive(int width, int height, float target_fps);
+void free_adaptive(struct adaptive *a);
+void adaptive_apply(struct adaptive *a, sinoscope_t *frame);
+void adaptive_update(struct adaptive *a, double frame_ms);
+float adaptive_scale(struct adaptive *a);
+
+#endif /* ADAPTIVE_H_ */
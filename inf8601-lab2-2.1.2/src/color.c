@@ -122,6 +122,26 @@ void value_color(struct rgb *color, float value, int interval, float interval_in
     *color = c;
 }
 
+/*
+ * value_color() only depends on the integer part of the value, the table
+ * has the color of the values 0 to size - 1.
+ */
+unsigned int *make_color_lut(int size, int interval, float interval_inv)
+{
+    unsigned int *lut;
+    struct rgb c;
+    int i;
+
+    lut = (unsigned int *) malloc(size * sizeof(unsigned int));
+    if (lut == NULL)
+        return NULL;
+    for (i = 0; i < size; i++) {
+        value_color(&c, (float) i, interval, interval_inv);
+        lut[i] = c.r | (c.g << 8) | (c.b << 16);
+    }
+    return lut;
+}
+
 void hue(struct rgb **image, int width, int height)
 {
     int i, j;
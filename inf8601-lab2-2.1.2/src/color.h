@@ -24,4 +24,23 @@ void value_color_set_max(float max);
 void hue(struct rgb **image, int width, int height);
 int get_color_interval(float max);
 float get_color_interval_inv(float max);
+unsigned int *make_color_lut(int size, int interval, float interval_inv);
+
+/*
+ * Color of a value from the table of make_color_lut(). The table holds
+ * the color of each integer value packed as r | g << 8 | b << 16, the
+ * values out of the table, nan included, go through value_color().
+ */
+static inline void lut_color(struct rgb *color, const unsigned int *lut, int size,
+        float value, int interval, float interval_inv)
+{
+    if (value >= 0.0f && value < size) {
+        unsigned int p = lut[(int) value];
+        color->r = p;
+        color->g = p >> 8;
+        color->b = p >> 16;
+    } else {
+        value_color(color, value, interval, interval_inv);
+    }
+}
 #endif /* COLOR_H_ */
@@ -0,0 +1,50 @@
+/*
+ * harmonic.h
+ *
+ * Sum of the odd harmonics of a pixel by angle addition: the sinus and the
+ * cosinus of the base angles are computed once, then each term rotates
+ * the previous one by twice the base angle. The error grows with the
+ * number of terms, it stays far below a color step up to --taylor 99.
+ *
+ *  Created on: 2026-10-19
+ *      Author: francis
+ */
+
+#ifndef HARMONIC_H_
+#define HARMONIC_H_
+
+#include <math.h>
+
+#include "sinoscope.h"
+
+/*
+ * st and ct are the sinus and the cosinus of b->time, the same for every
+ * pixel of a frame.
+ */
+static inline float harmonic_sum(const sinoscope_t *b, float px, float py,
+		float st, float ct)
+{
+	float sa = sinf(px * b->phase1), ca = cosf(px * b->phase1);
+	float sb = sinf(py * b->phase0), cb = cosf(py * b->phase0);
+	/* rotations by 2a and 2b */
+	float s2a = 2 * sa * ca, c2a = 1 - 2 * sa * sa;
+	float s2b = 2 * sb * cb, c2b = 1 - 2 * sb * sb;
+	/* sin(a + time), cos(a + time) and cos(b), sin(b) of the first term */
+	float s = sa * ct + ca * st, c = ca * ct - sa * st;
+	float u = cb, v = sb;
+	float tmp, val = 0.0f;
+	int taylor;
+
+	for (taylor = 1; taylor <= b->taylor; taylor += 2) {
+		val += (s + u) / taylor;
+		tmp = s * c2a + c * s2a;
+		c = c * c2a - s * s2a;
+		s = tmp;
+		tmp = u * c2b - v * s2b;
+		v = v * c2b + u * s2b;
+		u = tmp;
+	}
+	return val;
+}
+
+#endif /* HARMONIC_H_ */
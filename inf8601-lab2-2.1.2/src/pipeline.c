@@ -0,0 +1,233 @@
+/*
+ * pipeline.c
+ *
+ * Single producer, single consumer ring without lock. The producer only
+ * writes tail, the consumer only writes head, each frame is published by
+ * a release store and taken by an acquire load. The frames share the
+ * color table of the state, each has its own buffer. A side waiting
+ * longer than a few yields sleeps on the condition, so that it does not
+ * take a core from the threads computing the frame.
+ *
+ *  Created on: 2026-10-19
+ *      Author: francis
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "sinoscope.h"
+#include "pipeline.h"
+#include "memory.h"
+
+/* yields before sleeping */
+#define PIPELINE_SPINS 64
+
+struct pipeline {
+	/* advanced by the producer between two frames */
+	sinoscope_t *state;
+	sinoscope_t *frames;
+	int depth;
+	pipeline_handler handler;
+	/* scale of the frames, or NULL */
+	struct adaptive *adaptive;
+	pthread_t thread;
+	int running;
+	atomic_uint head;
+	atomic_uint tail;
+	atomic_int stop;
+	atomic_int error;
+	/* only guards the sleeps, the ring is without lock */
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+/*
+ * Wake the other side after a change of head, tail, stop or error. The
+ * lock orders the change before the check of a side going to sleep.
+ */
+static void pipeline_wake(struct pipeline *p)
+{
+	pthread_mutex_lock(&p->lock);
+	pthread_cond_broadcast(&p->cond);
+	pthread_mutex_unlock(&p->lock);
+}
+
+static int producer_waits(struct pipeline *p, unsigned int tail)
+{
+	return !atomic_load_explicit(&p->stop, memory_order_relaxed) &&
+			tail - atomic_load_explicit(&p->head, memory_order_acquire) == (unsigned int) p->depth;
+}
+
+static int consumer_waits(struct pipeline *p, unsigned int head)
+{
+	return !atomic_load_explicit(&p->error, memory_order_acquire) &&
+			atomic_load_explicit(&p->tail, memory_order_acquire) == head;
+}
+
+static void *pipeline_producer(void *arg)
+{
+	struct pipeline *p = arg;
+	unsigned int tail;
+	sinoscope_t *frame;
+	unsigned char *buf;
+	struct timespec t1, t2;
+	int spins;
+
+	while (!atomic_load_explicit(&p->stop, memory_order_relaxed)) {
+		/* 1. Attendre une place libre */
+		tail = atomic_load_explicit(&p->tail, memory_order_relaxed);
+		for (spins = 0; producer_waits(p, tail) && spins < PIPELINE_SPINS; spins++)
+			sched_yield();
+		if (producer_waits(p, tail)) {
+			pthread_mutex_lock(&p->lock);
+			while (producer_waits(p, tail))
+				pthread_cond_wait(&p->cond, &p->lock);
+			pthread_mutex_unlock(&p->lock);
+		}
+		if (atomic_load_explicit(&p->stop, memory_order_relaxed))
+			break;
+
+		/* 2. Calculer l'image suivante dans sa place */
+		frame = &p->frames[tail % p->depth];
+		buf = frame->buf;
+		sinoscope_corners(p->state);
+		*frame = *p->state;
+		frame->buf = buf;
+		if (p->adaptive != NULL)
+			adaptive_apply(p->adaptive, frame);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		if (p->handler(frame) < 0) {
+			atomic_store_explicit(&p->error, 1, memory_order_release);
+			pipeline_wake(p);
+			break;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &t2);
+		if (p->adaptive != NULL)
+			adaptive_update(p->adaptive, (t2.tv_sec - t1.tv_sec) * 1e3 +
+					(t2.tv_nsec - t1.tv_nsec) * 1e-6);
+
+		/* 3. Publier l'image */
+		atomic_store_explicit(&p->tail, tail + 1, memory_order_release);
+		pipeline_wake(p);
+	}
+	return NULL;
+}
+
+struct pipeline *make_pipeline(sinoscope_t *state, int depth)
+{
+	struct pipeline *p = NULL;
+	int i;
+
+	if (state == NULL || depth <= 0)
+		return NULL;
+	if (ALLOC(p) < 0 || ALLOC_N(p->frames, depth) < 0)
+		goto err;
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->cond, NULL);
+	p->state = state;
+	p->depth = depth;
+	for (i = 0; i < depth; i++) {
+		p->frames[i].buf = make_frame_buf(state->buf_size);
+		if (p->frames[i].buf == NULL)
+			goto err;
+	}
+	return p;
+err:
+	free_pipeline(p);
+	return NULL;
+}
+
+void free_pipeline(struct pipeline *p)
+{
+	int i;
+
+	if (p == NULL)
+		return;
+	pipeline_stop(p);
+	if (p->frames != NULL) {
+		for (i = 0; i < p->depth; i++)
+			free_frame_buf(p->frames[i].buf);
+	}
+	if (p->frames != NULL) {
+		pthread_cond_destroy(&p->cond);
+		pthread_mutex_destroy(&p->lock);
+	}
+	FREE(p->frames);
+	FREE(p);
+}
+
+/*
+ * Frames left from a previous run are dropped.
+ */
+int pipeline_start(struct pipeline *p, pipeline_handler handler)
+{
+	if (p == NULL || p->running)
+		return 0;
+	p->handler = handler;
+	atomic_init(&p->head, 0);
+	atomic_init(&p->tail, 0);
+	atomic_init(&p->stop, 0);
+	atomic_init(&p->error, 0);
+	if (pthread_create(&p->thread, NULL, pipeline_producer, p) != 0) {
+		perror("pthread_create failed");
+		return -1;
+	}
+	p->running = 1;
+	return 0;
+}
+
+/*
+ * Wait for the frame being computed, the state can be changed after.
+ */
+void pipeline_stop(struct pipeline *p)
+{
+	if (p == NULL || !p->running)
+		return;
+	atomic_store(&p->stop, 1);
+	pipeline_wake(p);
+	pthread_join(p->thread, NULL);
+	p->running = 0;
+}
+
+/*
+ * Oldest frame of the ring, waits for the producer. The frame stays valid
+ * until pipeline_release(). NULL if the handler failed.
+ */
+sinoscope_t *pipeline_next(struct pipeline *p)
+{
+	unsigned int head = atomic_load_explicit(&p->head, memory_order_relaxed);
+	int spins;
+
+	for (spins = 0; consumer_waits(p, head) && spins < PIPELINE_SPINS; spins++)
+		sched_yield();
+	if (consumer_waits(p, head)) {
+		pthread_mutex_lock(&p->lock);
+		while (consumer_waits(p, head))
+			pthread_cond_wait(&p->cond, &p->lock);
+		pthread_mutex_unlock(&p->lock);
+	}
+	if (atomic_load_explicit(&p->tail, memory_order_acquire) == head)
+		return NULL;
+	return &p->frames[head % p->depth];
+}
+
+/*
+ * Only while the producer is stopped.
+ */
+void pipeline_set_adaptive(struct pipeline *p, struct adaptive *a)
+{
+	if (p != NULL)
+		p->adaptive = a;
+}
+
+void pipeline_release(struct pipeline *p)
+{
+	unsigned int head = atomic_load_explicit(&p->head, memory_order_relaxed);
+	atomic_store_explicit(&p->head, head + 1, memory_order_release);
+	pipeline_wake(p);
+}
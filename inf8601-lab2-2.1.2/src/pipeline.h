@@ -0,0 +1,30 @@
+/*
+ * pipeline.h
+ *
+ * Frames of the sinoscope computed ahead by a producer thread. The ring
+ * holds depth frames, the producer fills them in order and the display
+ * takes them in the same order.
+ *
+ *  Created on: 2026-10-19
+ *      Author: francis
+ */
+
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+
+#include "sinoscope.h"
+#include "adaptive.h"
+
+typedef int (*pipeline_handler)(sinoscope_t *);
+
+struct pipeline;
+
+struct pipeline *make_pipeline(sinoscope_t *state, int depth);
+void free_pipeline(struct pipeline *p);
+int pipeline_start(struct pipeline *p, pipeline_handler handler);
+void pipeline_stop(struct pipeline *p);
+sinoscope_t *pipeline_next(struct pipeline *p);
+void pipeline_release(struct pipeline *p);
+void pipeline_set_adaptive(struct pipeline *p, struct adaptive *a);
+
+#endif /* PIPELINE_H_ */
@@ -0,0 +1,147 @@
+/*
+ * simd_kernel.h
+ *
+ * Row of the sinoscope on SIMD_W float lanes, included once per
+ * instruction set by sinoscope_simd.c with SIMD_W, SIMD_TARGET, SIMD_NAME
+ * and SIMD_GATHER defined. The lanes are consecutive columns: the cosinus term
+ * is the same for the whole row, only the sinus terms, the atan and the
+ * color are computed in the vectors.
+ *
+ *  Created on: 2026-10-19
+ *      Author: francis
+ */
+
+#define SIMD_FN static inline __attribute__((target(SIMD_TARGET), always_inline))
+#define vf SIMD_NAME(vf)
+#define vi SIMD_NAME(vi)
+
+typedef float vf __attribute__((vector_size(SIMD_W * 4)));
+typedef int vi __attribute__((vector_size(SIMD_W * 4)));
+
+SIMD_FN vf SIMD_NAME(select)(vi mask, vf a, vf b)
+{
+	return (vf) (((vi) a & mask) | ((vi) b & ~mask));
+}
+
+SIMD_FN vi SIMD_NAME(selecti)(vi mask, vi a, vi b)
+{
+	return (a & mask) | (b & ~mask);
+}
+
+SIMD_FN int SIMD_NAME(all)(vi mask)
+{
+	int k, all = -1;
+	for (k = 0; k < SIMD_W; k++)
+		all &= mask[k];
+	return all;
+}
+
+/*
+ * sinus, reduced around the closest multiple of pi/2 in three parts, then
+ * the polynomial of the sinus or of the cosinus on [-pi/4, pi/4]
+ */
+SIMD_FN vf SIMD_NAME(vsin)(vf x)
+{
+	vf jf = x * (float) M_2_PI + 12582912.0f - 12582912.0f;
+	vi j = __builtin_convertvector(jf, vi);
+	vf r = x - jf * 1.5703125f - jf * 4.837512969970703125e-4f -
+			jf * 7.54978995489188216e-8f;
+	vf z = r * r;
+	vf s = r + r * z * (-1.6666654611e-1f + z * (8.3321608736e-3f +
+			z * -1.9515295891e-4f));
+	vf c = 1.0f - 0.5f * z + z * z * (4.166664568298827e-2f +
+			z * (-1.388731625493765e-3f + z * 2.443315711809948e-5f));
+	vf y = SIMD_NAME(select)((j & 1) == 0, s, c);
+	return SIMD_NAME(select)((j & 2) == 0, y, -y);
+}
+
+SIMD_FN vf SIMD_NAME(vatan)(vf x)
+{
+	vf a = SIMD_NAME(select)(x < 0.0f, -x, x);
+	vi big = a > 2.414213562373095f;
+	vi mid = (a > 0.4142135623730950f) & ~big;
+	vf y0 = SIMD_NAME(select)(big, (vf) {} + (float) M_PI_2,
+			SIMD_NAME(select)(mid, (vf) {} + (float) M_PI_4, (vf) {}));
+	vf t = SIMD_NAME(select)(big, -1.0f / a,
+			SIMD_NAME(select)(mid, (a - 1.0f) / (a + 1.0f), a));
+	vf z = t * t;
+	vf y = y0 + (((8.05374449538e-2f * z - 1.38776856032e-1f) * z +
+			1.99777106478e-1f) * z - 3.33329491539e-1f) * z * t + t;
+	return SIMD_NAME(select)(x < 0.0f, -y, y);
+}
+
+/*
+ * value_color on the lanes, packed as r | g << 8 | b << 16, for the
+ * values out of the color table
+ */
+SIMD_FN vi SIMD_NAME(vcolor)(vf value, int interval, float interval_inv)
+{
+	vi q = __builtin_convertvector(value, vi);
+	vi d = __builtin_convertvector(__builtin_convertvector(q, vf) * interval_inv, vi);
+	vi m = q - d * interval;
+	m = SIMD_NAME(selecti)(m < 0, m + interval, m);
+	m = SIMD_NAME(selecti)(m >= interval, m - interval, m);
+	vi x = __builtin_convertvector(__builtin_convertvector(m * 255, vf) * interval_inv, vi) & 0xff;
+	vi i = __builtin_convertvector(value * interval_inv, vi);
+	vi full = (vi) {} + 255;
+	vi r, g, b;
+
+	r = SIMD_NAME(selecti)(i == 2, x, SIMD_NAME(selecti)(i >= 3, full, (vi) {}));
+	g = SIMD_NAME(selecti)(i == 0, x, SIMD_NAME(selecti)(i == 3, 255 - x,
+			SIMD_NAME(selecti)(i == 4, (vi) {}, full)));
+	b = SIMD_NAME(selecti)(i == 0, full, SIMD_NAME(selecti)(i == 1, 255 - x,
+			SIMD_NAME(selecti)(i == 4, x, (vi) {})));
+	/* default: white, nan: black */
+	vi white = (i < 0) | (i > 4);
+	r = SIMD_NAME(selecti)(white, full, r);
+	g = SIMD_NAME(selecti)(white, full, g);
+	b = SIMD_NAME(selecti)(white, full, b);
+	vi packed = r | (g << 8) | (b << 16);
+	return SIMD_NAME(selecti)(value == value, packed, (vi) {});
+}
+
+/*
+ * columns [1, width - 1) of the row x
+ */
+__attribute__((target(SIMD_TARGET)))
+static void SIMD_NAME(simd_row)(const sinoscope_t *b, int x)
+{
+	float py = b->dy * x - 2 * M_PI;
+	float row = 0.0f;
+	vf iota;
+	vi packed;
+	int y, k, n, taylor;
+
+	for (taylor = 1; taylor <= b->taylor; taylor += 2)
+		row += cos(py * taylor * b->phase0) / taylor;
+	for (k = 0; k < SIMD_W; k++)
+		iota[k] = k;
+
+	for (y = 1; y < b->width - 1; y += SIMD_W) {
+		vf px = b->dx * (iota + (float) y) - (float) (2 * M_PI);
+		vf val = (vf) {} + row;
+		for (taylor = 1; taylor <= b->taylor; taylor += 2)
+			val += SIMD_NAME(vsin)(px * (float) taylor * b->phase1 + b->time) *
+					(1.0f / taylor);
+		/* (atan(val) - atan(-val)) / pi */
+		val = 2.0f * SIMD_NAME(vatan)(val) * (float) M_1_PI;
+		val = (val + 1.0f) * 100.0f;
+		if (SIMD_NAME(all)((val >= 0.0f) & (val < (float) b->lut_size)))
+			packed = SIMD_GATHER(b->lut, __builtin_convertvector(val, vi));
+		else
+			packed = SIMD_NAME(vcolor)(val, b->interval, b->interval_inv);
+
+		/* 4 bytes stores, the last byte is rewritten by the next pixel */
+		unsigned char *out = b->buf + (y * 3) + (x * 3) * b->width;
+		n = b->width - 1 - y;
+		if (n > SIMD_W)
+			n = SIMD_W;
+		for (k = 0; k < n - 1; k++)
+			memcpy(out + k * 3, &packed[k], 4);
+		memcpy(out + k * 3, &packed[k], 3);
+	}
+}
+
+#undef vf
+#undef vi
+#undef SIMD_FN
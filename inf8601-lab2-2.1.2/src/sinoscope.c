@@ -12,11 +12,11 @@
 #include <getopt.h>
 #include <math.h>
 #include <time.h>
-#include <sys/resource.h>
 #include <sys/time.h>
 #include <omp.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <inttypes.h>
 #include <GL/glew.h>
 #include <GL/glxew.h>
@@ -27,6 +27,12 @@
 #include "sinoscope_openmp.h"
 #include "sinoscope_opencl.h"
 #include "sinoscope_serial.h"
+#include "sinoscope_separable.h"
+#include "sinoscope_simd.h"
+#include "sinoscope_template.h"
+#include "pipeline.h"
+#include "adaptive.h"
+#include "video.h"
 #include "color.h"
 #include "memory.h"
 #include "util.h"
@@ -40,13 +46,23 @@
 #define DEFAULT_IMG_PATH "sinoscope.ppm"
 #define DEFAULT_TAYLOR 3
 #define DEFAULT_ITER 10
+#define DEFAULT_DEPTH 2
+#define DEFAULT_FRAMES 100
+#define DEFAULT_BENCH_LIBS "serial,openmp,opencl"
+#define DEFAULT_BENCH_THREADS "1,8"
+#define DEFAULT_WARMUP 3
+#define VIDEO_FPS 30
 #define TITLE "inf8601-lab2"
 #define FPS_DELAY 3000
 #define BYTE_PER_PIX 3
 #define MICROSECONDS 1000000
+#define CHECK_FRAMES 4
+#define CHECK_FRAME_STEP 250
 
 static int win_x, win_y, win_id;
 static sinoscope_t *global_bl = NULL;
+static struct pipeline *global_pipe = NULL;
+static struct adaptive *global_adaptive = NULL;
 static GLuint tex = 0;
 static int enable_display = 1;
 static struct timeval fpsStart;
@@ -55,10 +71,9 @@ static float max = 1000000.0;
 static float amp = 200.0;
 static const struct command_def const *commands[];
 
-struct stats {
-	struct timeval elapsed;
-	struct timeval user;
-	struct timeval system;
+enum bench_report {
+	REPORT_CSV,
+	REPORT_JSON,
 };
 
 enum thread_lib {
@@ -66,6 +81,9 @@ enum thread_lib {
 	LIB_SERIAL,
 	LIB_OPENMP,
 	LIB_OPENCL,
+	LIB_SEPARABLE,
+	LIB_SIMD,
+	LIB_TEMPLATE,
 };
 
 struct command_opts {
@@ -78,6 +96,21 @@ struct command_opts {
 	int taylor;
 	int iter;
 	int verbose;
+	int recurrence;
+	int precision;
+	int depth;
+	int frames;
+	enum video_format format;
+	/* benchmark matrix, comma separated lists */
+	char *bench_libs;
+	char *bench_threads;
+	char *bench_sizes;
+	char *bench_taylors;
+	int warmup;
+	enum bench_report report;
+	float target_fps;
+	enum opencl_mode cl_mode;
+	int cl_fast_math;
 };
 
 typedef int (*sinoscope_handler)(sinoscope_t *);
@@ -86,16 +119,24 @@ struct lib_def {
 	const char *name;
 	enum thread_lib type;
 	sinoscope_handler handler;
+	/* the handler uses the OpenMP threads */
+	int threaded;
 };
 
 static struct command_opts *global_opts = NULL;
 
 static const struct lib_def libs[] = {
 		{ .name = "serial", .type = LIB_SERIAL, .handler = sinoscope_image_serial },
-		{ .name = "openmp", .type = LIB_OPENMP, .handler = sinoscope_image_openmp },
+		{ .name = "openmp", .type = LIB_OPENMP, .handler = sinoscope_image_openmp, .threaded = 1 },
 		{ .name = "opencl", .type = LIB_OPENCL, .handler = sinoscope_image_opencl },
+		{ .name = "separable", .type = LIB_SEPARABLE, .handler = sinoscope_image_separable, .threaded = 1 },
+		{ .name = "simd", .type = LIB_SIMD, .handler = sinoscope_image_simd, .threaded = 1 },
+		{ .name = "template", .type = LIB_TEMPLATE, .handler = sinoscope_image_template, .threaded = 1 },
+		{ .name = NULL, .type = LIB_NONE, .handler = NULL },
 };
 
+static const struct lib_def *lookup_lib(const char *name);
+
 typedef int (*cmd_handler)(struct command_opts*);
 
 struct command_def {
@@ -110,14 +151,28 @@ static void usage(void)
 	fprintf(stderr, "Usage: " PROGNAME " [OPTIONS] [COMMAND]\n");
 	fprintf(stderr, "\nOptions:\n");
 	fprintf(stderr, "  --help	this help\n");
-	fprintf(stderr, "  --cmd		command [ gui | benchmark | image ]\n");
+	fprintf(stderr, "  --cmd		command [ gui | benchmark | image | check | video ]\n");
 	fprintf(stderr, "  --lib		set the threading library to use "\
-			"[ serial | openmp | opencl ]\n");
-	fprintf(stderr, "  --output set image path output\n");
+			"[ serial | openmp | opencl | separable | simd | template ]\n");
+	fprintf(stderr, "  --output set image path output, or video and benchmark output (default stdout)\n");
 	fprintf(stderr, "  --height	set height\n");
 	fprintf(stderr, "  --width	set width\n");
 	fprintf(stderr, "  --taylor	set taylor series terms\n");
 	fprintf(stderr, "  --iter 	set number of benchmark iterations\n");
+	fprintf(stderr, "  --warmup	frames run before timing a benchmark (default %d)\n", DEFAULT_WARMUP);
+	fprintf(stderr, "  --libs	benchmark libs, comma separated (default %s)\n", DEFAULT_BENCH_LIBS);
+	fprintf(stderr, "  --threads	benchmark thread counts, comma separated (default %s)\n", DEFAULT_BENCH_THREADS);
+	fprintf(stderr, "  --sizes	benchmark resolutions, as WIDTHxHEIGHT,... (default --width x --height)\n");
+	fprintf(stderr, "  --taylors	benchmark taylor counts, comma separated (default --taylor)\n");
+	fprintf(stderr, "  --report	benchmark report [ csv | json ]\n");
+	fprintf(stderr, "  --recurrence	sum the harmonics by angle addition\n");
+	fprintf(stderr, "  --precision	precision of the template kernels [ float | double ]\n");
+	fprintf(stderr, "  --depth	frames computed ahead of the display, 0 to disable (default %d)\n", DEFAULT_DEPTH);
+	fprintf(stderr, "  --frames	number of video frames (default %d)\n", DEFAULT_FRAMES);
+	fprintf(stderr, "  --target-fps	lower the resolution of the GUI to hold this rate, needs --depth > 0\n");
+	fprintf(stderr, "  --format	video format [ y4m | rgb ]\n");
+	fprintf(stderr, "  --cl-mode	transfer of the OpenCL image [ auto | read | zerocopy | bands ]\n");
+	fprintf(stderr, "  --cl-fast-math	build the OpenCL kernel with relaxed math, frames differ from the CPU\n");
 	fprintf(stderr, "\n");
 	exit(EXIT_FAILURE);
 }
@@ -131,8 +186,13 @@ static int init_lib(struct command_opts *opts)
 	switch (opts->lib->type) {
 	case LIB_SERIAL:
 	case LIB_OPENMP:
+	case LIB_SEPARABLE:
+	case LIB_SIMD:
+	case LIB_TEMPLATE:
 		break;
 	case LIB_OPENCL:
+		opencl_set_mode(opts->cl_mode);
+		opencl_set_fast_math(opts->cl_fast_math);
 		ret = opencl_init(opts->width, opts->height);
 		ERR_THROW(0, ret, "init_data error");
 	default:
@@ -151,6 +211,9 @@ static int close_lib(struct command_opts *opts)
 	switch (opts->lib->type) {
 	case LIB_SERIAL:
 	case LIB_OPENMP:
+	case LIB_SEPARABLE:
+	case LIB_SIMD:
+	case LIB_TEMPLATE:
 		break;
 	case LIB_OPENCL:
 		opencl_shutdown();
@@ -166,11 +229,32 @@ static int cmd_gui(struct command_opts *opts)
 
 	ret = init_data(opts->width, opts->height, opts->taylor);
 	ERR_THROW(0, ret, "init_data error");
+	global_bl->recurrence = opts->recurrence;
+	global_bl->precision = opts->precision;
 
-	init_lib(opts);
+	/* the producer calls the handler as soon as it starts */
+	ret = init_lib(opts);
 	ERR_THROW(0, ret, "init_lib error");
 
+	if (opts->target_fps > 0 && opts->depth <= 0)
+		opts->depth = 1;
+	if (opts->depth > 0) {
+		global_pipe = make_pipeline(global_bl, opts->depth);
+		ERR_NOMEM(global_pipe);
+		if (opts->target_fps > 0) {
+			global_adaptive = make_adaptive(opts->width, opts->height, opts->target_fps);
+			ERR_NOMEM(global_adaptive);
+			pipeline_set_adaptive(global_pipe, global_adaptive);
+		}
+		ret = pipeline_start(global_pipe, opts->lib->handler);
+		ERR_THROW(0, ret, "pipeline_start error");
+	}
+
 	run_gui(0, NULL);
+	free_pipeline(global_pipe);
+	global_pipe = NULL;
+	free_adaptive(global_adaptive);
+	global_adaptive = NULL;
 	close_lib(opts);
 
 	error:
@@ -189,116 +273,313 @@ struct timeval time_sub(struct timeval t1, struct timeval t2)
 	return res;
 }
 
-void write_stats_header(FILE *f)
+#define BENCH_MAX_LIST 16
+
+struct bench_size {
+	int width;
+	int height;
+};
+
+struct bench_result {
+	double min;
+	double median;
+	double p99;
+	double total;
+};
+
+/*
+ * Redirect stdout to stderr, the messages of the libs and the progress go
+ * there, and return a descriptor of the original stdout, or of --output
+ * when it is set.
+ */
+static int open_output(struct command_opts *opts)
 {
-	fprintf(f, "experiment,width,height,iter,u,s,e\n");
+	int fd;
+
+	if (!opts->enable_output || strcmp(opts->ppm_path, "-") == 0) {
+		fd = dup(STDOUT_FILENO);
+		if (fd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+			perror("dup failed");
+			return -1;
+		}
+		return fd;
+	}
+	fd = open(opts->ppm_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		perror(opts->ppm_path);
+	return fd;
 }
 
-void write_stats_info(FILE *f, char *name, int width, int height, int iter)
+/*
+ * comma separated integers, return their number or -1
+ */
+static int parse_int_list(const char *str, int *list, int max)
 {
-	fprintf(f, "%s,%d,%d,%d,", name, width, height, iter);
+	char *copy, *tok, *save = NULL;
+	int n = 0;
+
+	if ((copy = strdup(str)) == NULL)
+		return -1;
+	for (tok = strtok_r(copy, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+		if (n == max || (list[n++] = atoi(tok)) <= 0) {
+			n = -1;
+			break;
+		}
+	}
+	free(copy);
+	return n;
 }
 
-void write_stats(FILE *f, struct stats *s)
+/*
+ * comma separated WIDTHxHEIGHT
+ */
+static int parse_size_list(const char *str, struct bench_size *list, int max)
 {
-	if (s == NULL)
-		return;
-	fprintf(f, "%ld.%ld,%ld.%ld,%ld.%ld\n",
-			s->user.tv_sec, s->user.tv_usec,
-			s->system.tv_sec, s->system.tv_usec,
-			s->elapsed.tv_sec, s->elapsed.tv_usec);
+	char *copy, *tok, *save = NULL;
+	int n = 0;
+
+	if ((copy = strdup(str)) == NULL)
+		return -1;
+	for (tok = strtok_r(copy, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+		if (n == max || sscanf(tok, "%dx%d", &list[n].width, &list[n].height) != 2 ||
+				list[n].width <= 2 || list[n].height <= 2) {
+			n = -1;
+			break;
+		}
+		n++;
+	}
+	free(copy);
+	return n;
 }
 
-int run_benchmark(struct stats *s, sinoscope_t *sinoscope, sinoscope_handler handler, int iter)
+static double elapsed_ms(struct timespec *t1, struct timespec *t2)
 {
-	int ret = 0;
+	return (t2->tv_sec - t1->tv_sec) * 1e3 + (t2->tv_nsec - t1->tv_nsec) * 1e-6;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *) a, y = *(const double *) b;
+	return (x > y) - (x < y);
+}
+
+/*
+ * Time each frame after the warm-up frames, the state advances between
+ * two frames as in the GUI.
+ */
+static int run_benchmark(struct bench_result *r, sinoscope_t *s,
+		sinoscope_handler handler, int warmup, int iter, double *times)
+{
+	struct timespec t1, t2;
 	int i;
-	struct rusage r1, r2;
-	struct timeval t1, t2;
 
-	gettimeofday(&t1, NULL);
-	if (getrusage(RUSAGE_SELF, &r1) < 0) {
-		perror("getrusage failed");
-		goto err;
+	for (i = 0; i < warmup + iter; i++) {
+		sinoscope_corners(s);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		if (handler(s) < 0)
+			return -1;
+		clock_gettime(CLOCK_MONOTONIC, &t2);
+		if (i >= warmup)
+			times[i - warmup] = elapsed_ms(&t1, &t2);
 	}
 
-	for(i = 0; i < iter; i++) {
-		printf("%-10s %3.0f %%\r", sinoscope->name, (100 * i) / (float) iter);
-		fflush(stdout);
-		handler(sinoscope);
-	}
-	printf("%-10s %3.0f %%\n", sinoscope->name, 100.0);
+	r->total = 0;
+	for (i = 0; i < iter; i++)
+		r->total += times[i];
+	qsort(times, iter, sizeof(double), cmp_double);
+	r->min = times[0];
+	r->median = iter % 2 ? times[iter / 2] : (times[iter / 2 - 1] + times[iter / 2]) / 2;
+	r->p99 = times[(int) ceil(0.99 * iter) - 1];
+	return 0;
+}
 
-	if (getrusage(RUSAGE_SELF, &r2) < 0) {
-		perror("getrusage failed");
-		goto err;
+static void write_result(FILE *f, enum bench_report report, int first,
+		const char *lib, int threads, int width, int height, int taylor,
+		int iter, struct bench_result *r)
+{
+	double pixels = (double) (width - 2) * (height - 2) * iter;
+	/* a term is one harmonic, its sinus and its cosinus */
+	double terms = pixels * ((taylor + 1) / 2);
+	double seconds = r->total / 1e3;
+
+	if (report == REPORT_JSON) {
+		fprintf(f, "%s\n  { \"lib\": \"%s\", \"threads\": %d, \"width\": %d, "
+				"\"height\": %d, \"taylor\": %d, \"frames\": %d, "
+				"\"min_ms\": %.4f, \"median_ms\": %.4f, \"p99_ms\": %.4f, "
+				"\"mpixel_s\": %.3f, \"gterm_s\": %.4f }",
+				first ? "" : ",", lib, threads, width, height, taylor, iter,
+				r->min, r->median, r->p99, pixels / seconds / 1e6, terms / seconds / 1e9);
+	} else {
+		fprintf(f, "%s,%d,%d,%d,%d,%d,%.4f,%.4f,%.4f,%.3f,%.4f\n",
+				lib, threads, width, height, taylor, iter,
+				r->min, r->median, r->p99, pixels / seconds / 1e6, terms / seconds / 1e9);
 	}
-	gettimeofday(&t2, NULL);
+	fflush(f);
+}
 
-	if (s != NULL) {
-		s->user    = time_sub(r2.ru_utime, r1.ru_utime);
-		s->system  = time_sub(r2.ru_stime, r1.ru_stime);
-		s->elapsed = time_sub(t2, t1);
+/*
+ * Every lib of --libs, with every count of --threads for the libs using
+ * OpenMP, at every --sizes and every --taylors.
+ */
+static int cmd_benchmark(struct command_opts *opts)
+{
+	const struct lib_def *libs_list[BENCH_MAX_LIST];
+	struct bench_size sizes[BENCH_MAX_LIST];
+	int threads[BENCH_MAX_LIST], taylors[BENCH_MAX_LIST];
+	int nb_libs = 0, nb_sizes, nb_threads, nb_taylors;
+	struct command_opts lib_opts;
+	struct bench_result r;
+	sinoscope_t *s = NULL;
+	double *times = NULL;
+	FILE *f = NULL;
+	char *copy = NULL, *tok, *save = NULL;
+	int i, j, k, l, fd, first = 1;
+	int ret = 0;
+
+	if ((copy = strdup(opts->bench_libs)) == NULL)
+		goto error;
+	for (tok = strtok_r(copy, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+		ERR_ASSERT(nb_libs < BENCH_MAX_LIST, "too many libs");
+		libs_list[nb_libs] = lookup_lib(tok);
+		if (libs_list[nb_libs] == NULL) {
+			fprintf(stderr, "unknown threading lib %s\n", tok);
+			goto error;
+		}
+		nb_libs++;
+	}
+	nb_threads = parse_int_list(opts->bench_threads, threads, BENCH_MAX_LIST);
+	ERR_ASSERT(nb_threads > 0, "bad thread list");
+	if (opts->bench_taylors != NULL) {
+		nb_taylors = parse_int_list(opts->bench_taylors, taylors, BENCH_MAX_LIST);
+		ERR_ASSERT(nb_taylors > 0, "bad taylor list");
+	} else {
+		taylors[0] = opts->taylor;
+		nb_taylors = 1;
 	}
+	if (opts->bench_sizes != NULL) {
+		nb_sizes = parse_size_list(opts->bench_sizes, sizes, BENCH_MAX_LIST);
+		ERR_ASSERT(nb_sizes > 0, "bad size list");
+	} else {
+		sizes[0].width = opts->width;
+		sizes[0].height = opts->height;
+		nb_sizes = 1;
+	}
+	ERR_ASSERT(opts->iter > 0 && opts->warmup >= 0, "bad number of frames");
+	if (ALLOC_N(times, opts->iter) < 0)
+		goto error;
+
+	fd = open_output(opts);
+	ERR_ASSERT(fd >= 0, "cannot open output");
+	f = fdopen(fd, "w");
+	ERR_NOMEM(f);
+	if (opts->report == REPORT_JSON)
+		fprintf(f, "[");
+	else
+		fprintf(f, "lib,threads,width,height,taylor,frames,min_ms,median_ms,p99_ms,mpixel_s,gterm_s\n");
+
+	for (i = 0; i < nb_libs; i++) {
+		for (j = 0; j < nb_sizes; j++) {
+			lib_opts = *opts;
+			lib_opts.lib = libs_list[i];
+			lib_opts.width = sizes[j].width;
+			lib_opts.height = sizes[j].height;
+			if (init_lib(&lib_opts) < 0) {
+				fprintf(stderr, "%s: init failed, skipped\n", libs_list[i]->name);
+				continue;
+			}
+			for (k = 0; k < (libs_list[i]->threaded ? nb_threads : 1); k++) {
+				omp_set_num_threads(libs_list[i]->threaded ? threads[k] : 1);
+				for (l = 0; l < nb_taylors; l++) {
+					fprintf(stderr, "%s threads=%d %dx%d taylor=%d\n", libs_list[i]->name,
+							libs_list[i]->threaded ? threads[k] : 1,
+							sizes[j].width, sizes[j].height, taylors[l]);
+					s = make_sinoscope(sizes[j].width, sizes[j].height, taylors[l], amp);
+					ERR_NOMEM(s);
+					s->recurrence = opts->recurrence;
+					s->precision = opts->precision;
+					if (run_benchmark(&r, s, libs_list[i]->handler, opts->warmup,
+							opts->iter, times) < 0) {
+						fprintf(stderr, "%s: handler returned error\n", libs_list[i]->name);
+						ret = -1;
+					} else {
+						write_result(f, opts->report, first, libs_list[i]->name,
+								libs_list[i]->threaded ? threads[k] : 1,
+								sizes[j].width, sizes[j].height, taylors[l], opts->iter, &r);
+						first = 0;
+					}
+					free_sinoscope(s);
+					s = NULL;
+				}
+			}
+			close_lib(&lib_opts);
+		}
+	}
+	if (opts->report == REPORT_JSON)
+		fprintf(f, "\n]\n");
 
 done:
+	free_sinoscope(s);
+	FREE(times);
+	FREE(copy);
+	if (f != NULL)
+		fclose(f);
 	return ret;
-err:
+error:
 	ret = -1;
 	goto done;
 }
 
-static int cmd_benchmark(struct command_opts *opts)
+/*
+ * The frames are computed by the producer of a pipeline while this thread
+ * converts and writes them, the computation never waits for the output
+ * unless the ring is full.
+ */
+static int cmd_video(struct command_opts *opts)
 {
 	int ret = 0;
-	sinoscope_t *b = NULL;
-	struct stats stats;
-	char fname[256];
-	sprintf(fname, "sinoscope-%d.out", getpid());
-	FILE* f = fopen(fname, "w");
-
-	write_stats_header(f);
-
-	b = make_sinoscope(opts->width, opts->height, opts->taylor, amp);
-	ERR_NOMEM(b);
-
-	/* serial */
-	b->name = "serial";
-	write_stats_info(f, b->name, opts->width, opts->height, opts->iter);
-	run_benchmark(&stats, b, sinoscope_image_serial, opts->iter);
-	write_stats(f, &stats);
-
-	/* openmp 1 thread */
-	b->name = "openmp_1";
-	omp_set_num_threads(1);
-	write_stats_info(f, b->name, opts->width, opts->height, opts->iter);
-	run_benchmark(&stats, b, sinoscope_image_openmp, opts->iter);
-	write_stats(f, &stats);
-
-	/* openmp 8 threads */
-	b->name = "openmp_8";
-	omp_set_num_threads(8);
-	write_stats_info(f, b->name, opts->width, opts->height, opts->iter);
-	run_benchmark(&stats, b, sinoscope_image_openmp, opts->iter);
-	write_stats(f, &stats);
-
-	/* opencl */
-	b->name = "opencl";
-	ret = opencl_init(opts->width, opts->height);
-	ERR_THROW(0, ret, "opencl_init failed");
-	write_stats_info(f, b->name, opts->width, opts->height, opts->iter);
-	run_benchmark(&stats, b, sinoscope_image_opencl, opts->iter);
-	write_stats(f, &stats);
-	opencl_shutdown();
-	ERR_THROW(0, ret, "opencl_shutdown failed");
-	printf("\n");
-	fprintf(f, "\n");
-	free_sinoscope(b);
-	b = NULL;
+	int i, fd = -1;
+	sinoscope_t *s = NULL, *frame;
+	struct pipeline *p = NULL;
+	struct video *v = NULL;
+	struct timeval t1, t2, diff;
+
+	fd = open_output(opts);
+	if (fd < 0)
+		goto error;
+
+	ret = init_lib(opts);
+	ERR_THROW(0, ret, "init_lib error");
+	s = make_sinoscope(opts->width, opts->height, opts->taylor, amp);
+	ERR_NOMEM(s);
+	s->recurrence = opts->recurrence;
+	s->precision = opts->precision;
+	v = make_video(fd, opts->format, opts->width, opts->height, VIDEO_FPS);
+	ERR_NOMEM(v);
+	p = make_pipeline(s, opts->depth > 0 ? opts->depth : 1);
+	ERR_NOMEM(p);
+
+	gettimeofday(&t1, NULL);
+	ret = pipeline_start(p, opts->lib->handler);
+	ERR_THROW(0, ret, "pipeline_start error");
+	for (i = 0; i < opts->frames; i++) {
+		frame = pipeline_next(p);
+		ERR_ASSERT(frame != NULL, "handler returned error");
+		ret = video_write_frame(v, frame);
+		ERR_THROW(0, ret, "video_write_frame failed");
+		pipeline_release(p);
+	}
+	pipeline_stop(p);
+	gettimeofday(&t2, NULL);
+	diff = time_sub(t2, t1);
+	fprintf(stderr, "%d frames in %ld.%06ld s\n", opts->frames, diff.tv_sec, diff.tv_usec);
+
 done:
-	free_sinoscope(b);
-	if (f != NULL)
-		fclose(f);
+	free_pipeline(p);
+	free_video(v);
+	close_lib(opts);
+	free_sinoscope(s);
+	if (fd >= 0)
+		close(fd);
 	return ret;
 error:
 	ret = -1;
@@ -315,6 +596,8 @@ static int cmd_image(struct command_opts *opts)
 
 	s = make_sinoscope(opts->width, opts->height, opts->taylor, amp);
 	ERR_NOMEM(s);
+	s->recurrence = opts->recurrence;
+	s->precision = opts->precision;
 	ret = opts->lib->handler(s);
 	ERR_THROW(0, ret, "handler returned error");
 	ret = save_image_uchar(opts->ppm_path, s->buf, s->width, s->height);
@@ -328,12 +611,108 @@ error:
 	goto done;
 }
 
+/*
+ * Compare a frame to the serial frame computed with libm. The frame passes
+ * if no byte is off by more than one step of the color ramp and if less
+ * than 1 % of the bytes differ.
+ */
+static int check_frame(sinoscope_t *ref, sinoscope_t *s, const char *name)
+{
+	int i, diff = 0, max_diff = 0;
+	int step = 255 * ref->interval_inv + 1;
+	const char *variant = s->recurrence ? "+recurrence" :
+			s->precision == PRECISION_DOUBLE ? "+double" : "";
+
+	memset(s->buf, 0, s->buf_size);
+	if (lookup_lib(name)->handler(s) < 0) {
+		printf("FAIL %s taylor=%d handler returned error\n", name, s->taylor);
+		return -1;
+	}
+	for (i = 0; i < s->buf_size; i++) {
+		int d = abs(ref->buf[i] - s->buf[i]);
+		if (d > 0)
+			diff++;
+		if (d > max_diff)
+			max_diff = d;
+	}
+	if (max_diff > step || diff * 100 > s->buf_size) {
+		printf("FAIL %s%s taylor=%d diff=%d max=%d\n", name, variant,
+				s->taylor, diff, max_diff);
+		return -1;
+	}
+	printf("PASS %s%s taylor=%d\n", name, variant, s->taylor);
+	return 0;
+}
+
+struct check_case {
+	const char *name;
+	int recurrence;
+	int precision;
+};
+
+static int cmd_check(struct command_opts *opts)
+{
+	static const int taylors[] = { 1, 3, 15, 51 };
+	static const struct check_case cases[] = {
+			{ .name = "serial", .recurrence = 1 },
+			{ .name = "openmp", .recurrence = 0 },
+			{ .name = "openmp", .recurrence = 1 },
+			{ .name = "separable", .recurrence = 0 },
+			{ .name = "simd", .recurrence = 0 },
+			{ .name = "template", .precision = PRECISION_FLOAT },
+			{ .name = "template", .precision = PRECISION_DOUBLE },
+	};
+	sinoscope_t *ref = NULL, *s = NULL;
+	unsigned char *buf;
+	unsigned int *lut;
+	int i, j, frame;
+	int ret = 0;
+
+	for (i = 0; i < sizeof(taylors) / sizeof(taylors[0]); i++) {
+		ref = make_sinoscope(opts->width, opts->height, taylors[i], amp);
+		ERR_NOMEM(ref);
+		s = make_sinoscope(opts->width, opts->height, taylors[i], amp);
+		ERR_NOMEM(s);
+		for (frame = 0; frame < CHECK_FRAMES; frame++) {
+			for (j = 0; j < CHECK_FRAME_STEP; j++)
+				sinoscope_corners(ref);
+			memset(ref->buf, 0, ref->buf_size);
+			sinoscope_image_serial(ref);
+			buf = s->buf;
+			lut = s->lut;
+			*s = *ref;
+			s->buf = buf;
+			s->lut = lut;
+			for (j = 0; j < sizeof(cases) / sizeof(cases[0]); j++) {
+				s->recurrence = cases[j].recurrence;
+				s->precision = cases[j].precision;
+				if (check_frame(ref, s, cases[j].name) < 0)
+					ret = -1;
+			}
+		}
+		free_sinoscope(ref);
+		free_sinoscope(s);
+		ref = s = NULL;
+	}
+done:
+	free_sinoscope(ref);
+	free_sinoscope(s);
+	return ret;
+error:
+	ret = -1;
+	goto done;
+}
+
 static const struct command_def cmd_gui_def =
 { .name = "gui", .handler = cmd_gui };
 static const struct command_def cmd_benchmark_def =
 { .name = "benchmark", .handler = cmd_benchmark };
 static const struct command_def cmd_image_def =
 { .name = "image", .handler = cmd_image };
+static const struct command_def cmd_video_def =
+{ .name = "video", .handler = cmd_video };
+static const struct command_def cmd_check_def =
+{ .name = "check", .handler = cmd_check };
 static const struct command_def cmd_def_last =
 { .name = NULL, .handler = NULL };
 
@@ -341,6 +720,8 @@ static const struct command_def const *commands[] = {
 		&cmd_gui_def,
 		&cmd_benchmark_def,
 		&cmd_image_def,
+		&cmd_check_def,
+		&cmd_video_def,
 		&cmd_def_last
 };
 
@@ -374,6 +755,13 @@ static void dump_opts(struct command_opts *opts)
 	printf("%10s %d\n", "height", opts->height);
 	printf("%10s %d\n", "taylor", opts->taylor);
 	printf("%10s %d\n", "iter", opts->iter);
+	printf("%10s %d\n", "recurrence", opts->recurrence);
+	printf("%10s %s\n", "precision", opts->precision == PRECISION_DOUBLE ? "double" : "float");
+	printf("%10s %d\n", "depth", opts->depth);
+	printf("%10s %d\n", "frames", opts->frames);
+	printf("%10s %.1f\n", "target-fps", opts->target_fps);
+	printf("%10s %d\n", "cl-mode", opts->cl_mode);
+	printf("%10s %d\n", "cl-fast-math", opts->cl_fast_math);
 }
 
 void default_int_value(int *val, int def)
@@ -398,6 +786,20 @@ static int parse_opts(int argc, char **argv, struct command_opts *opts)
 			{ "taylor",	 1, 0, 't' },
 			{ "iter",	 1, 0, 'i' },
 			{ "verbose", 0, 0, 'v' },
+			{ "recurrence", 0, 0, 'r' },
+			{ "precision", 1, 0, 'p' },
+			{ "depth",	 1, 0, 'd' },
+			{ "frames",	 1, 0, 'f' },
+			{ "format",	 1, 0, 'F' },
+			{ "warmup",	 1, 0, 'w' },
+			{ "libs",	 1, 0, 'L' },
+			{ "threads", 1, 0, 'T' },
+			{ "sizes",	 1, 0, 'S' },
+			{ "taylors", 1, 0, 'A' },
+			{ "report",	 1, 0, 'R' },
+			{ "target-fps", 1, 0, 'G' },
+			{ "cl-mode", 1, 0, 'M' },
+			{ "cl-fast-math", 0, 0, 'X' },
 			{ 0, 0, 0, 0}
 	};
 
@@ -406,8 +808,13 @@ static int parse_opts(int argc, char **argv, struct command_opts *opts)
 	opts->width = DEFAULT_WIDTH;
 	opts->taylor = DEFAULT_TAYLOR;
 	opts->iter = DEFAULT_ITER;
+	opts->depth = DEFAULT_DEPTH;
+	opts->frames = DEFAULT_FRAMES;
+	opts->warmup = DEFAULT_WARMUP;
+	opts->bench_libs = DEFAULT_BENCH_LIBS;
+	opts->bench_threads = DEFAULT_BENCH_THREADS;
 
-	while ((opt = getopt_long(argc, argv, "hvx:y:c:l:o:t:i:", options, &idx)) != -1) {
+	while ((opt = getopt_long(argc, argv, "hvrx:y:c:l:o:t:i:p:d:f:F:w:L:T:S:A:R:G:M:X", options, &idx)) != -1) {
 		switch(opt) {
 		case 'c':
 			opts->cmd = lookup_cmd(optarg);
@@ -422,6 +829,7 @@ static int parse_opts(int argc, char **argv, struct command_opts *opts)
 		case 'o':
 			if (asprintf(&opts->ppm_path, "%s", optarg) < 0)
 				goto err;
+			opts->enable_output = 1;
 			break;
 		case 'y':
 			opts->height = atoi(optarg);
@@ -435,12 +843,86 @@ static int parse_opts(int argc, char **argv, struct command_opts *opts)
 		case 'i':
 			opts->iter = atoi(optarg);
 			break;
+		case 'd':
+			opts->depth = atoi(optarg);
+			break;
+		case 'f':
+			opts->frames = atoi(optarg);
+			break;
+		case 'w':
+			opts->warmup = atoi(optarg);
+			break;
+		case 'G':
+			opts->target_fps = atof(optarg);
+			break;
+		case 'L':
+			opts->bench_libs = optarg;
+			break;
+		case 'T':
+			opts->bench_threads = optarg;
+			break;
+		case 'S':
+			opts->bench_sizes = optarg;
+			break;
+		case 'A':
+			opts->bench_taylors = optarg;
+			break;
+		case 'M':
+			if (strcmp(optarg, "auto") == 0) {
+				opts->cl_mode = OPENCL_MODE_AUTO;
+			} else if (strcmp(optarg, "read") == 0) {
+				opts->cl_mode = OPENCL_MODE_READ;
+			} else if (strcmp(optarg, "zerocopy") == 0) {
+				opts->cl_mode = OPENCL_MODE_ZERO_COPY;
+			} else if (strcmp(optarg, "bands") == 0) {
+				opts->cl_mode = OPENCL_MODE_BANDS;
+			} else {
+				printf("unknown OpenCL mode %s\n", optarg);
+				ret = -1;
+			}
+			break;
+		case 'X':
+			opts->cl_fast_math = 1;
+			break;
+		case 'R':
+			if (strcmp(optarg, "csv") == 0) {
+				opts->report = REPORT_CSV;
+			} else if (strcmp(optarg, "json") == 0) {
+				opts->report = REPORT_JSON;
+			} else {
+				printf("unknown report format %s\n", optarg);
+				ret = -1;
+			}
+			break;
+		case 'F':
+			if (strcmp(optarg, "y4m") == 0) {
+				opts->format = VIDEO_Y4M;
+			} else if (strcmp(optarg, "rgb") == 0) {
+				opts->format = VIDEO_RGB;
+			} else {
+				printf("unknown video format %s\n", optarg);
+				ret = -1;
+			}
+			break;
 		case 'h':
 			usage();
 			break;
 		case 'v':
 			opts->verbose = 1;
 			break;
+		case 'r':
+			opts->recurrence = 1;
+			break;
+		case 'p':
+			if (strcmp(optarg, "float") == 0) {
+				opts->precision = PRECISION_FLOAT;
+			} else if (strcmp(optarg, "double") == 0) {
+				opts->precision = PRECISION_DOUBLE;
+			} else {
+				printf("unknown precision %s\n", optarg);
+				ret = -1;
+			}
+			break;
 		default:
 			printf("unknown option %c\n", opt);
 			ret = -1;
@@ -474,20 +956,48 @@ err:
 	goto done;
 }
 
+/*
+ * Image buffer of size bytes, released by free_frame_buf()
+ */
+unsigned char *make_frame_buf(int size)
+{
+	void *buf;
+
+	if (size <= 0 || posix_memalign(&buf, FRAME_ALIGN, FRAME_BUF_SIZE(size)) != 0)
+		return NULL;
+	return buf;
+}
+
+/*
+ * The OpenCL backend may wrap the buffer in a device buffer, which must
+ * not outlive it
+ */
+void free_frame_buf(unsigned char *buf)
+{
+	if (buf == NULL)
+		return;
+	opencl_release_host(buf);
+	free(buf);
+}
+
 sinoscope_t *make_sinoscope(int width, int height, int taylor, float max)
 {
 	sinoscope_t *b = calloc(1, sizeof(sinoscope_t));
 	if (b == NULL)
 		return NULL;
 	b->buf_size = width * height * BYTE_PER_PIX;
-	b->buf = malloc(b->buf_size);
-	if (b->buf == NULL)
-		return NULL;
+	b->buf = make_frame_buf(b->buf_size);
 	b->width = width;
 	b->height = height;
 	b->max = max;
 	b->interval = get_color_interval(max);
 	b->interval_inv = get_color_interval_inv(max);
+	b->lut_size = (int) max + 1;
+	b->lut = make_color_lut(b->lut_size, b->interval, b->interval_inv);
+	if (b->buf == NULL || b->lut == NULL) {
+		free_sinoscope(b);
+		return NULL;
+	}
 	b->taylor = taylor;
 	b->dx = 3 * M_PI / width;
 	b->dy = 3 * M_PI / height;
@@ -496,8 +1006,10 @@ sinoscope_t *make_sinoscope(int width, int height, int taylor, float max)
 
 void free_sinoscope(sinoscope_t *b)
 {
-	if (b != NULL)
-		FREE(b->buf);
+	if (b != NULL) {
+		free_frame_buf(b->buf);
+		FREE(b->lut);
+	}
 	FREE(b);
 }
 
@@ -542,25 +1054,18 @@ void fps_update(int value)
 	gettimeofday(&t, NULL);
 	struct timeval diff = time_sub(t, fpsStart);
 	double delay = diff.tv_sec + ((double) diff.tv_usec / 1000000.0);
-	sprintf(fps, TITLE " %s (%d x %d): %.1f fps", global_opts->lib->name, win_x, win_y, fpsCount / delay);
+	if (global_adaptive != NULL)
+		sprintf(fps, TITLE " %s (%d x %d): %.1f fps, scale %.2f", global_opts->lib->name,
+				win_x, win_y, fpsCount / delay, adaptive_scale(global_adaptive));
+	else
+		sprintf(fps, TITLE " %s (%d x %d): %.1f fps", global_opts->lib->name, win_x, win_y, fpsCount / delay);
 	glutSetWindowTitle(fps);
 	printf("%s\n", fps);
 	glutTimerFunc(FPS_DELAY, fps_update, value);
 }
 
-void draw_sinoscope(const struct lib_def *def, sinoscope_t *b)
+void display_frame(sinoscope_t *b)
 {
-	int ret = 0;
-	if (def == NULL || b == NULL) {
-		printf("BUG in draw_sinoscope\n");
-		exit(1);
-	}
-	sinoscope_corners(b);
-	ret = def->handler(b);
-	if (ret < 0) {
-		printf("Error while executing sinoscope %s\n", def->name);
-		exit(1);
-	}
 	if (tex == 0) {
 		glGenTextures(1, &tex);
 	}
@@ -580,6 +1085,22 @@ void draw_sinoscope(const struct lib_def *def, sinoscope_t *b)
 	fpsCount++;
 }
 
+void draw_sinoscope(const struct lib_def *def, sinoscope_t *b)
+{
+	int ret = 0;
+	if (def == NULL || b == NULL) {
+		printf("BUG in draw_sinoscope\n");
+		exit(1);
+	}
+	sinoscope_corners(b);
+	ret = def->handler(b);
+	if (ret < 0) {
+		printf("Error while executing sinoscope %s\n", def->name);
+		exit(1);
+	}
+	display_frame(b);
+}
+
 void pre_display()
 {
 	glViewport(0, 0, win_x, win_y);
@@ -604,6 +1125,8 @@ void init_fps()
 void key_func(unsigned char key, int x, int y)
 {
 	init_fps();
+	/* the producer must not run while the lib or the state change */
+	pipeline_stop(global_pipe);
 	switch (key) {
 	case 'q':
 	case 'Q':
@@ -625,10 +1148,30 @@ void key_func(unsigned char key, int x, int y)
 		global_opts->lib = lookup_lib("opencl");
 		init_lib(global_opts);
 		break;
+	case '4':
+		close_lib(global_opts);
+		global_opts->lib = lookup_lib("separable");
+		init_lib(global_opts);
+		break;
+	case '5':
+		close_lib(global_opts);
+		global_opts->lib = lookup_lib("simd");
+		init_lib(global_opts);
+		break;
+	case '6':
+		close_lib(global_opts);
+		global_opts->lib = lookup_lib("template");
+		init_lib(global_opts);
+		break;
+	case 'r':
+	case 'R':
+		global_bl->recurrence = !global_bl->recurrence;
+		break;
 	case ' ':
 		enable_display = !enable_display;
 		break;
 	}
+	pipeline_start(global_pipe, global_opts->lib->handler);
 }
 
 static void mouse_func(int button, int state, int x, int y)
@@ -656,8 +1199,20 @@ static void idle_func()
 
 static void display_func()
 {
+	sinoscope_t *frame;
+
 	pre_display();
-	draw_sinoscope(global_opts->lib, global_bl);
+	if (global_pipe == NULL) {
+		draw_sinoscope(global_opts->lib, global_bl);
+	} else {
+		frame = pipeline_next(global_pipe);
+		if (frame == NULL) {
+			printf("Error while executing sinoscope %s\n", global_opts->lib->name);
+			exit(1);
+		}
+		display_frame(frame);
+		pipeline_release(global_pipe);
+	}
 	post_display();
 }
 
@@ -676,6 +1231,8 @@ void open_glut_window()
 	glutSwapBuffers();
 	glClear(GL_COLOR_BUFFER_BIT);
 	glutSwapBuffers();
+	/* rows of rgb frames, scaled ones are not a multiple of 4 bytes */
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
 	pre_display();
 
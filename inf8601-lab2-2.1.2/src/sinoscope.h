@@ -10,6 +10,18 @@
 
 typedef struct sinoscope sinoscope_t;
 
+/*
+ * Image buffers start on a page and end on a page, so that OpenCL can
+ * use them in place (CL_MEM_USE_HOST_PTR) without a copy
+ */
+#define FRAME_ALIGN 4096
+#define FRAME_BUF_SIZE(size) (((size_t) (size) + FRAME_ALIGN - 1) & ~((size_t) FRAME_ALIGN - 1))
+
+enum precision {
+    PRECISION_FLOAT,
+    PRECISION_DOUBLE,
+};
+
 struct sinoscope {
     unsigned char *buf;
     char *name;
@@ -25,8 +37,16 @@ struct sinoscope {
     float phase1;
     float dx;
     float dy;
+    int recurrence;
+    /* colors of the values 0 to lut_size - 1, see lut_color() */
+    unsigned int *lut;
+    int lut_size;
+    /* precision of the template kernels */
+    int precision;
 };
 
+unsigned char *make_frame_buf(int size);
+void free_frame_buf(unsigned char *buf);
 sinoscope_t *make_sinoscope(int width, int height, int taylor, float max);
 void free_sinoscope(sinoscope_t *b);
 int init_data(int width, int height, int taylor);
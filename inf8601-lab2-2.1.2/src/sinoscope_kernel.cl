@@ -47,6 +47,9 @@ struct kernel_args {
 	float phase1;
 	float dx;
 	float dy;
+	int recurrence;
+	int lut_size;
+	int height;
 };
 
 
@@ -102,7 +105,35 @@ void value_color(struct rgb *color, float value, int interval, float interval_in
 	*color = c;
 }
 
-__kernel void sinoscope_kernel(__global unsigned char *output, kernel_args_t b)
+/*
+ * Odd harmonics by angle addition, as harmonic_sum() of the host
+ */
+float harmonic_sum(kernel_args_t *b, float px, float py)
+{
+	float sa = sin(px * b->phase1), ca = cos(px * b->phase1);
+	float sb = sin(py * b->phase0), cb = cos(py * b->phase0);
+	float s2a = 2 * sa * ca, c2a = 1 - 2 * sa * sa;
+	float s2b = 2 * sb * cb, c2b = 1 - 2 * sb * sb;
+	float st = sin(b->time), ct = cos(b->time);
+	float s = sa * ct + ca * st, c = ca * ct - sa * st;
+	float u = cb, v = sb;
+	float tmp, val = 0.0f;
+	int taylor;
+
+	for (taylor = 1; taylor <= b->taylor; taylor += 2) {
+		val += (s + u) / taylor;
+		tmp = mad(s, c2a, c * s2a);
+		c = mad(c, c2a, -s * s2a);
+		s = tmp;
+		tmp = mad(u, c2b, -v * s2b);
+		v = mad(v, c2b, u * s2b);
+		u = tmp;
+	}
+	return val;
+}
+
+__kernel void sinoscope_kernel(__global unsigned char *output, kernel_args_t b,
+		__constant unsigned int *lut)
 {
 	int x, y, index, taylor;
 	struct rgb c;
@@ -110,19 +141,39 @@ __kernel void sinoscope_kernel(__global unsigned char *output, kernel_args_t b)
 	
 	x = get_global_id(0);
 	y = get_global_id(1);
+	/* the range is rounded up to the work-groups */
+	if (x >= b.height || y >= b.width)
+		return;
 	
 	val = 0.0f;
 	px = b.dx * y - 2 * M_PI;
 	py = b.dy * x - 2 * M_PI;
 
-	for (taylor = 1; taylor <= b.taylor; taylor += 2)
+	if (b.recurrence)
+	{
+		val = harmonic_sum(&b, px, py);
+	}
+	else
 	{
-		val += sin(px * taylor * b.phase1 + b.time) / taylor + cos(py * taylor * b.phase0) / taylor;
+		for (taylor = 1; taylor <= b.taylor; taylor += 2)
+		{
+			val += sin(px * taylor * b.phase1 + b.time) / taylor + cos(py * taylor * b.phase0) / taylor;
+		}
 	}
 
 	val = (atan(1.0 * val) - atan(-1.0 * val)) / (M_PI);
 	val = (val + 1) * 100;
-	value_color(&c, val, b.interval, b.interval_inv);
+	if (val >= 0.0f && val < b.lut_size)
+	{
+		unsigned int p = lut[(int) val];
+		c.r = p;
+		c.g = p >> 8;
+		c.b = p >> 16;
+	}
+	else
+	{
+		value_color(&c, val, b.interval, b.interval_inv);
+	}
 
 	index = (y * 3) + (x * 3) * b.width;
 	output[index + 0] = c.r;
@@ -11,6 +11,13 @@ extern "C" {
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include "sinoscope.h"
 #include "color.h"
 #include "memory.h"
@@ -24,8 +31,21 @@ using namespace std;
 
 #define BUF_SIZE 1024
 #define MAGIC "!@#~"
+/* rows of the frame are cut in bands in OPENCL_MODE_BANDS */
+#define OPENCL_BANDS 4
+/* image buffers wrapped as device buffers in OPENCL_MODE_ZERO_COPY */
+#define OPENCL_HOST_BUFS 8
+/* frames timed per work-group shape, the fastest one counts */
+#define TUNE_RUNS 3
+#define TUNE_TAYLOR 31
 extern char __ocl_code_start, __ocl_code_end;
 static cl_command_queue queue = NULL;
+/* reads of the bands, beside the kernels */
+static cl_command_queue read_queue = NULL;
+static cl_device_id device = NULL;
+static enum opencl_mode mode = OPENCL_MODE_AUTO;
+/* relaxed math changes the frames against the CPU backends, opt-in only */
+static const char *build_options = "";
 static cl_context context = NULL;
 static cl_program prog = NULL;
 static cl_kernel kernel = NULL;
@@ -35,6 +55,31 @@ static cl_kernel kernel = NULL;
  */
 static cl_mem output = NULL;
 
+/* color table of the sinoscope, uploaded again when the scale changes */
+static cl_mem lut = NULL;
+static int lut_size = 0;
+static int lut_interval = 0;
+
+struct host_buf {
+    unsigned char *host;
+    size_t size;
+    cl_mem mem;
+};
+
+static struct host_buf host_bufs[OPENCL_HOST_BUFS];
+static int host_buf_next = 0;
+
+/*
+ * Cache of the program binary and of the tuned work-group, as
+ * <dir>/<key>.bin and <dir>/<key>.tune. The key is the hash of the device,
+ * its driver, the build options and the kernel source.
+ */
+static char cache_prefix[PATH_MAX];
+static int cache_enabled = 0;
+
+/* work-group of the kernel, rows by columns, 0 lets the driver choose */
+static size_t local_work_size[2] = { 0, 0 };
+
 typedef struct kernel_args kernel_args_t;
 
 struct kernel_args {
@@ -47,13 +92,16 @@ struct kernel_args {
 	float phase1;
 	float dx;
 	float dy;
+	int recurrence;
+	int lut_size;
+	int height;
 };
 
 int get_opencl_queue()
 {
     cl_int ret, i;
     cl_uint num_dev;
-    cl_device_id device;
+    cl_bool unified;
     cl_platform_id *platform_ids = NULL;
     cl_uint num_platforms;
     cl_uint info;
@@ -100,6 +148,16 @@ int get_opencl_queue()
 
     queue = clCreateCommandQueue(context, device, 0, &ret);
     ERR_THROW(CL_SUCCESS, ret, "failed to create queue");
+    read_queue = clCreateCommandQueue(context, device, 0, &ret);
+    ERR_THROW(CL_SUCCESS, ret, "failed to create read queue");
+
+    if (mode == OPENCL_MODE_AUTO) {
+        ret = clGetDeviceInfo(device, CL_DEVICE_HOST_UNIFIED_MEMORY, sizeof(cl_bool), &unified, NULL);
+        ERR_THROW(CL_SUCCESS, ret, "failed to get device info");
+        mode = unified ? OPENCL_MODE_ZERO_COPY : OPENCL_MODE_BANDS;
+    }
+    cout << "mode " << (mode == OPENCL_MODE_ZERO_COPY ? "zero copy" :
+            mode == OPENCL_MODE_BANDS ? "bands" : "read") << "\n";
 
     ret = 0;
 
@@ -162,6 +220,348 @@ error:
     goto done;
 }
 
+int upload_lut(sinoscope_t *ptr)
+{
+    cl_int ret = 0;
+
+    if (lut != NULL && lut_size == ptr->lut_size && lut_interval == ptr->interval)
+        return 0;
+    if (lut != NULL)
+        clReleaseMemObject(lut);
+    lut = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+            ptr->lut_size * sizeof(unsigned int), ptr->lut, &ret);
+    ERR_THROW(CL_SUCCESS, ret, "clCreateBuffer failed");
+    lut_size = ptr->lut_size;
+    lut_interval = ptr->interval;
+
+done:
+    return ret;
+error:
+    lut = NULL;
+    ret = -1;
+    goto done;
+}
+
+static uint64_t hash_bytes(uint64_t h, const void *data, size_t len)
+{
+    const unsigned char *p = (const unsigned char *) data;
+    size_t i;
+
+    /* FNV-1a */
+    for (i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static int make_dir(const char *path)
+{
+    if (mkdir(path, 0755) < 0 && errno != EEXIST)
+        return -1;
+    return 0;
+}
+
+/*
+ * The directory is $SINOSCOPE_CL_CACHE, or sinoscope in $XDG_CACHE_HOME or
+ * in ~/.cache. Without a directory nothing is cached.
+ */
+static int init_cache(const char *code, size_t length)
+{
+    const cl_device_info infos[] = { CL_DEVICE_VENDOR, CL_DEVICE_NAME,
+            CL_DEVICE_VERSION, CL_DRIVER_VERSION };
+    char dir[PATH_MAX];
+    char info[BUF_SIZE];
+    const char *env;
+    uint64_t key = 0xcbf29ce484222325ULL;
+    size_t len;
+    unsigned i;
+    int n;
+
+    cache_enabled = 0;
+    if ((env = getenv("SINOSCOPE_CL_CACHE")) != NULL) {
+        n = snprintf(dir, sizeof(dir), "%s", env);
+    } else if ((env = getenv("XDG_CACHE_HOME")) != NULL) {
+        n = snprintf(dir, sizeof(dir), "%s/sinoscope", env);
+    } else if ((env = getenv("HOME")) != NULL) {
+        n = snprintf(dir, sizeof(dir), "%s/.cache", env);
+        if (n < (int) sizeof(dir) && make_dir(dir) < 0)
+            return -1;
+        n = snprintf(dir, sizeof(dir), "%s/.cache/sinoscope", env);
+    } else {
+        return -1;
+    }
+    if (n >= (int) sizeof(dir) || make_dir(dir) < 0)
+        return -1;
+
+    for (i = 0; i < sizeof(infos) / sizeof(infos[0]); i++) {
+        if (clGetDeviceInfo(device, infos[i], sizeof(info), info, &len) != CL_SUCCESS)
+            return -1;
+        key = hash_bytes(key, info, len);
+    }
+    key = hash_bytes(key, build_options, strlen(build_options) + 1);
+    key = hash_bytes(key, code, length);
+
+    n = snprintf(cache_prefix, sizeof(cache_prefix), "%s/%016" PRIx64, dir, key);
+    if (n + 5 >= (int) sizeof(cache_prefix))
+        return -1;
+    cache_enabled = 1;
+    return 0;
+}
+
+static char *read_cache(const char *ext, size_t *length)
+{
+    char path[PATH_MAX];
+    char *data = NULL;
+    struct stat st;
+    FILE *f;
+
+    snprintf(path, sizeof(path), "%s%s", cache_prefix, ext);
+    if ((f = fopen(path, "r")) == NULL)
+        return NULL;
+    if (fstat(fileno(f), &st) < 0 || st.st_size == 0)
+        goto done;
+    data = (char *) malloc(st.st_size + 1);
+    if (data == NULL)
+        goto done;
+    if (fread(data, 1, st.st_size, f) != (size_t) st.st_size) {
+        FREE(data);
+        goto done;
+    }
+    data[st.st_size] = '\0';
+    *length = st.st_size;
+done:
+    fclose(f);
+    return data;
+}
+
+/*
+ * Written aside then renamed, another instance never reads half a file
+ */
+static int write_cache(const char *ext, const void *data, size_t length)
+{
+    char path[PATH_MAX];
+    char tmp[PATH_MAX];
+    FILE *f;
+    int ret = 0;
+
+    snprintf(path, sizeof(path), "%s%s", cache_prefix, ext);
+    if (snprintf(tmp, sizeof(tmp), "%s.%d", path, (int) getpid()) >= (int) sizeof(tmp))
+        return -1;
+    if ((f = fopen(tmp, "w")) == NULL)
+        return -1;
+    if (fwrite(data, 1, length, f) != length)
+        ret = -1;
+    if (fclose(f) != 0)
+        ret = -1;
+    if (ret == 0 && rename(tmp, path) < 0)
+        ret = -1;
+    if (ret < 0)
+        unlink(tmp);
+    return ret;
+}
+
+static int load_program_binary()
+{
+    cl_int err, status;
+    size_t length = 0;
+    char *binary;
+
+    if (!cache_enabled || (binary = read_cache(".bin", &length)) == NULL)
+        return -1;
+    prog = clCreateProgramWithBinary(context, 1, &device, &length,
+            (const unsigned char **) &binary, &status, &err);
+    FREE(binary);
+    if (err == CL_SUCCESS && status == CL_SUCCESS &&
+            clBuildProgram(prog, 1, &device, build_options, NULL, NULL) == CL_SUCCESS)
+        return 0;
+    /* stale or rejected by the driver, built again from the source */
+    if (prog)
+        clReleaseProgram(prog);
+    prog = NULL;
+    return -1;
+}
+
+static int save_program_binary()
+{
+    int ret = 0;
+    size_t length;
+    unsigned char *binary = NULL;
+
+    if (!cache_enabled)
+        return 0;
+    ERR_THROW(CL_SUCCESS, clGetProgramInfo(prog, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &length, NULL), "clGetProgramInfo failed");
+    ERR_ASSERT(length > 0, "empty program binary");
+    binary = (unsigned char *) malloc(length);
+    ERR_NOMEM(binary);
+    ERR_THROW(CL_SUCCESS, clGetProgramInfo(prog, CL_PROGRAM_BINARIES, sizeof(unsigned char *), &binary, NULL), "clGetProgramInfo failed");
+    ERR_THROW(0, write_cache(".bin", binary, length), "cannot write the program cache");
+
+done:
+    FREE(binary);
+    return ret;
+error:
+    ret = -1;
+    goto done;
+}
+
+static int build_program(char *code, size_t length)
+{
+    cl_int err = 0;
+    char log[BUF_SIZE * 8];
+
+    init_cache(code, length);
+    if (load_program_binary() == 0) {
+        cout << "program loaded from " << cache_prefix << ".bin\n";
+        return 0;
+    }
+    prog = clCreateProgramWithSource(context, 1, (const char **) &code, &length, &err);
+    ERR_THROW(CL_SUCCESS, err, "clCreateProgramWithSource failed");
+    err = clBuildProgram(prog, 1, &device, build_options, NULL, NULL);
+    if (err != CL_SUCCESS) {
+        if (clGetProgramBuildInfo(prog, device, CL_PROGRAM_BUILD_LOG, sizeof(log), log, NULL) == CL_SUCCESS)
+            cerr << log << "\n";
+        ERR_THROW(CL_SUCCESS, err, "clBuildProgram failed");
+    }
+    /* the binary is only a shortcut, the program works without it */
+    save_program_binary();
+    return 0;
+error:
+    return -1;
+}
+
+/*
+ * Work-group of the launches, NULL when the driver chooses
+ */
+static const size_t *local_size()
+{
+    return local_work_size[0] ? local_work_size : NULL;
+}
+
+/*
+ * Range of the kernel for height rows and width columns, rounded up to
+ * the work-groups
+ */
+static void global_size(size_t *global, int height, int width)
+{
+    const size_t *local = local_size();
+    int i;
+
+    global[0] = height;
+    global[1] = width;
+    for (i = 0; local != NULL && i < 2; i++)
+        global[i] = (global[i] + local[i] - 1) / local[i] * local[i];
+}
+
+static double tune_time(kernel_args *args)
+{
+    struct timespec t0, t1;
+    double best = 0, t;
+    size_t global[2];
+    int i;
+
+    global_size(global, args->height, args->width);
+    /* first run out of the timings */
+    for (i = 0; i <= TUNE_RUNS; i++) {
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        if (clEnqueueNDRangeKernel(queue, kernel, 2, 0, global, local_size(), 0, NULL, NULL) != CL_SUCCESS ||
+                clFinish(queue) != CL_SUCCESS)
+            return -1;
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        t = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+        if (i > 0 && (best == 0 || t < best))
+            best = t;
+    }
+    return best;
+}
+
+/*
+ * Time the power of two work-groups the kernel accepts on a frame of the
+ * size of the window, keep the fastest one. Done once per device, the
+ * result is cached with the binary.
+ */
+static int tune_local_size(int width, int height)
+{
+    const size_t sides[] = { 1, 2, 4, 8, 16, 32, 64 };
+    const int nb_sides = sizeof(sides) / sizeof(sides[0]);
+    size_t max_group, max_items[3];
+    size_t best[2] = { 0, 0 };
+    double best_time, t;
+    kernel_args args;
+    cl_mem dummy_lut = NULL;
+    unsigned int zero = 0;
+    char line[64];
+    char *cached;
+    size_t length;
+    int ret = 0;
+    int i, j;
+
+    if (cache_enabled && (cached = read_cache(".tune", &length)) != NULL) {
+        i = sscanf(cached, "%zu %zu", &local_work_size[0], &local_work_size[1]);
+        FREE(cached);
+        if (i == 2 && (local_work_size[0] == 0) == (local_work_size[1] == 0))
+            goto done;
+    }
+    local_work_size[0] = local_work_size[1] = 0;
+
+    ERR_THROW(CL_SUCCESS, clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &max_group, NULL), "clGetKernelWorkGroupInfo failed");
+    ERR_THROW(CL_SUCCESS, clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_ITEM_SIZES, sizeof(max_items), max_items, NULL), "failed to get device info");
+
+    memset(&args, 0, sizeof(args));
+    args.width = width;
+    args.height = height;
+    args.interval = 1;
+    args.interval_inv = 1.0f;
+    args.taylor = TUNE_TAYLOR;
+    args.phase0 = 1.0f;
+    args.phase1 = 1.0f;
+    args.dx = 4 * M_PI / width;
+    args.dy = 4 * M_PI / height;
+    dummy_lut = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(zero), &zero, &ret);
+    ERR_THROW(CL_SUCCESS, ret, "clCreateBuffer failed");
+    ERR_THROW(CL_SUCCESS, clSetKernelArg(kernel, 0, sizeof(cl_mem), &output), "clSetKernelArg : passing output failed");
+    ERR_THROW(CL_SUCCESS, clSetKernelArg(kernel, 1, sizeof(kernel_args), &args), "clSetKernelArg : passing kernel arguments failed");
+    ERR_THROW(CL_SUCCESS, clSetKernelArg(kernel, 2, sizeof(cl_mem), &dummy_lut), "clSetKernelArg : passing color table failed");
+
+    best_time = tune_time(&args);
+    ERR_ASSERT(best_time >= 0, "kernel launch failed");
+    for (i = 0; i < nb_sides; i++) {
+        for (j = 0; j < nb_sides; j++) {
+            if (sides[i] * sides[j] > max_group || sides[i] > max_items[0] ||
+                    sides[j] > max_items[1])
+                continue;
+            local_work_size[0] = sides[i];
+            local_work_size[1] = sides[j];
+            t = tune_time(&args);
+            if (t > 0 && t < best_time) {
+                best_time = t;
+                best[0] = sides[i];
+                best[1] = sides[j];
+            }
+        }
+    }
+    local_work_size[0] = best[0];
+    local_work_size[1] = best[1];
+
+    if (cache_enabled) {
+        snprintf(line, sizeof(line), "%zu %zu\n", best[0], best[1]);
+        write_cache(".tune", line, strlen(line));
+    }
+
+done:
+    if (local_work_size[0])
+        cout << "work-group " << local_work_size[0] << "x" << local_work_size[1] << "\n";
+    else
+        cout << "work-group chosen by the driver\n";
+    if (dummy_lut)
+        clReleaseMemObject(dummy_lut);
+    return ret;
+error:
+    local_work_size[0] = local_work_size[1] = 0;
+    ret = -1;
+    goto done;
+}
+
 int opencl_init(int width, int height)
 {
     cl_int err;
@@ -176,28 +576,103 @@ int opencl_init(int width, int height)
         return -1;
 
     /*
-     * Initialisation du programme
+     * Initialisation du programme, depuis le cache si possible
      */
-    prog = clCreateProgramWithSource(context, 1, (const char **) &code, &length, &err);
-    ERR_THROW(CL_SUCCESS, err, "clCreateProgramWithSource failed");
-    err = clBuildProgram(prog, 0, NULL, "-cl-fast-relaxed-math", NULL, NULL);
-    ERR_THROW(CL_SUCCESS, err, "clBuildProgram failed");
+    err = build_program(code, length);
+    ERR_THROW(0, err, "build_program failed");
     kernel = clCreateKernel(prog, "sinoscope_kernel", &err);
     ERR_THROW(CL_SUCCESS, err, "clCreateKernel failed");
     err = create_buffer(width, height);
     ERR_THROW(CL_SUCCESS, err, "create_buffer failed");
+    /* without a tuned work-group the driver chooses */
+    tune_local_size(width, height);
 
     free(code);
     return 0;
 error:
+    FREE(code);
     return -1;
 }
 
 
+void opencl_set_mode(enum opencl_mode m)
+{
+    mode = m;
+}
+
+void opencl_set_fast_math(int fast_math)
+{
+    build_options = fast_math ? "-cl-fast-relaxed-math" : "";
+}
+
+/*
+ * Device buffer over the image buffer of the frame, created once per
+ * buffer. The mapping of such a buffer is the image buffer itself, a
+ * device sharing the memory of the host does not copy it.
+ */
+/*
+ * Device buffer wrapping the image buffer host, kept for the next frames.
+ * OpenCL needs host valid as long as the buffer lives, see
+ * opencl_release_host()
+ */
+static cl_mem host_buffer(unsigned char *host, size_t size)
+{
+    cl_int ret;
+    int i;
+
+    for (i = 0; i < OPENCL_HOST_BUFS; i++) {
+        if (host_bufs[i].host == host && host_bufs[i].size == size)
+            return host_bufs[i].mem;
+    }
+    struct host_buf *hb = &host_bufs[host_buf_next];
+    host_buf_next = (host_buf_next + 1) % OPENCL_HOST_BUFS;
+    if (hb->mem != NULL)
+        clReleaseMemObject(hb->mem);
+    hb->mem = clCreateBuffer(context, CL_MEM_WRITE_ONLY | CL_MEM_USE_HOST_PTR, size, host, &ret);
+    if (ret != CL_SUCCESS) {
+        hb->host = NULL;
+        hb->mem = NULL;
+        return NULL;
+    }
+    hb->host = host;
+    hb->size = size;
+    return hb->mem;
+}
+
+/*
+ * Release the device buffer wrapping host before host is freed. Not called
+ * during a render of host.
+ */
+void opencl_release_host(unsigned char *host)
+{
+    int i;
+
+    for (i = 0; i < OPENCL_HOST_BUFS; i++) {
+        if (host_bufs[i].host != host)
+            continue;
+        if (host_bufs[i].mem)
+            clReleaseMemObject(host_bufs[i].mem);
+        host_bufs[i].mem = NULL;
+        host_bufs[i].host = NULL;
+    }
+}
+
 void opencl_shutdown()
 {
+    int i;
+
+    for (i = 0; i < OPENCL_HOST_BUFS; i++) {
+        if (host_bufs[i].mem)
+            clReleaseMemObject(host_bufs[i].mem);
+        host_bufs[i].mem = NULL;
+        host_bufs[i].host = NULL;
+    }
+    if (read_queue)	clReleaseCommandQueue(read_queue);
     if (queue) 	clReleaseCommandQueue(queue);
     if (context)	clReleaseContext(context);
+    read_queue = NULL;
+    queue = NULL;
+    context = NULL;
 
     /*
      * TODO: liberer les ressources allouees
@@ -205,19 +680,131 @@ void opencl_shutdown()
 	if (output)
 	{
 		clReleaseMemObject(output);
+		output = NULL;
+	}
+
+	if (lut)
+	{
+		clReleaseMemObject(lut);
+		lut = NULL;
+		lut_size = 0;
 	}
 
 	if (kernel)
 	{
 		clReleaseKernel(kernel);
+		kernel = NULL;
 	}
 
 	if (prog)
 	{
 		clReleaseProgram(prog);
+		prog = NULL;
 	}
 }
 
+/*
+ * Kernel over the whole frame, then blocking read
+ */
+static int run_read(sinoscope_t *ptr, size_t *global_work_size, size_t size)
+{
+    cl_int ret = 0;
+
+    ERR_THROW(CL_SUCCESS, clSetKernelArg(kernel, 0, sizeof(cl_mem), &output), "clSetKernelArg : passing output failed");
+    ERR_THROW(CL_SUCCESS, clEnqueueNDRangeKernel(queue, kernel, 2, 0, global_work_size, local_size(), 0, NULL, NULL), "clEnqueueNDRangeKernel failed");
+    ERR_THROW(CL_SUCCESS, clFinish(queue), "clFinish failed");
+    ERR_THROW(CL_SUCCESS, clEnqueueReadBuffer(queue, output, CL_TRUE, 0, size, ptr->buf, 0 , NULL, NULL), "clEnqueueReadBuffer failed");
+
+done:
+    return ret;
+error:
+    ret = -1;
+    goto done;
+}
+
+/*
+ * The kernel writes in the image buffer of the frame, the map makes its
+ * content visible to the host without a copy on a unified memory device
+ */
+static int run_zero_copy(sinoscope_t *ptr, size_t *global_work_size, size_t size)
+{
+    cl_int ret = 0;
+    cl_mem mem;
+    void *map;
+
+    /* the frame buffer is allocated up to the end of its page */
+    mem = host_buffer(ptr->buf, FRAME_BUF_SIZE(size));
+    ERR_ASSERT(mem != NULL, "clCreateBuffer with host pointer failed");
+    ERR_THROW(CL_SUCCESS, clSetKernelArg(kernel, 0, sizeof(cl_mem), &mem), "clSetKernelArg : passing output failed");
+    ERR_THROW(CL_SUCCESS, clEnqueueNDRangeKernel(queue, kernel, 2, 0, global_work_size, local_size(), 0, NULL, NULL), "clEnqueueNDRangeKernel failed");
+    map = clEnqueueMapBuffer(queue, mem, CL_TRUE, CL_MAP_READ, 0, size, 0, NULL, NULL, &ret);
+    ERR_THROW(CL_SUCCESS, ret, "clEnqueueMapBuffer failed");
+    ERR_THROW(CL_SUCCESS, clEnqueueUnmapMemObject(queue, mem, map, 0, NULL, NULL), "clEnqueueUnmapMemObject failed");
+    ERR_THROW(CL_SUCCESS, clFinish(queue), "clFinish failed");
+
+done:
+    return ret;
+error:
+    ret = -1;
+    goto done;
+}
+
+/*
+ * The rows are cut in bands. Each band is read on the second queue as soon
+ * as its kernel ends, while the kernel of the next band runs.
+ */
+static int run_bands(sinoscope_t *ptr, size_t *global_work_size)
+{
+    cl_int ret = 0;
+    cl_event kernels[OPENCL_BANDS];
+    cl_event reads[OPENCL_BANDS];
+    size_t offset[2], band[2];
+    size_t row = ptr->width * 3;
+    /* the bands are cut between work-groups */
+    size_t group = local_size() ? local_work_size[0] : 1;
+    size_t groups = global_work_size[0] / group;
+    size_t x0, x1, rows;
+    int i, n = 0;
+
+    ERR_THROW(CL_SUCCESS, clSetKernelArg(kernel, 0, sizeof(cl_mem), &output), "clSetKernelArg : passing output failed");
+    for (i = 0; i < OPENCL_BANDS; i++) {
+        x0 = i * groups / OPENCL_BANDS * group;
+        x1 = (i + 1) * groups / OPENCL_BANDS * group;
+        if (x0 == x1)
+            continue;
+        offset[0] = x0;
+        offset[1] = 0;
+        band[0] = x1 - x0;
+        band[1] = global_work_size[1];
+        /* the last band has the padding rows of the range */
+        rows = (x1 < (size_t) ptr->height ? x1 : ptr->height) - x0;
+        ERR_THROW(CL_SUCCESS, clEnqueueNDRangeKernel(queue, kernel, 2, offset, band, local_size(), 0, NULL, &kernels[n]), "clEnqueueNDRangeKernel failed");
+        ret = clEnqueueReadBuffer(read_queue, output, CL_FALSE, x0 * row, rows * row,
+                ptr->buf + x0 * row, 1, &kernels[n], &reads[n]);
+        if (ret != CL_SUCCESS) {
+            clReleaseEvent(kernels[n]);
+            ERR_THROW(CL_SUCCESS, ret, "clEnqueueReadBuffer failed");
+        }
+        n++;
+        ERR_THROW(CL_SUCCESS, clFlush(queue), "clFlush failed");
+        ERR_THROW(CL_SUCCESS, clFlush(read_queue), "clFlush failed");
+    }
+    ERR_THROW(CL_SUCCESS, clWaitForEvents(n, reads), "clWaitForEvents failed");
+
+done:
+    for (i = 0; i < n; i++) {
+        clReleaseEvent(kernels[i]);
+        clReleaseEvent(reads[i]);
+    }
+    return ret;
+error:
+    /* the reads still queued write in the frame */
+    clFinish(queue);
+    clFinish(read_queue);
+    ret = -1;
+    goto done;
+}
+
 int sinoscope_image_opencl(sinoscope_t *ptr)
 {
     /*
@@ -252,27 +839,34 @@ int sinoscope_image_opencl(sinoscope_t *ptr)
 	args.phase1 = ptr->phase1;
 	args.dx = ptr->dx;
 	args.dy = ptr->dy;
+	args.recurrence = ptr->recurrence;
+	args.lut_size = ptr->lut_size;
+	args.height = height;
 
     size = width * height * sizeof(unsigned char) * 3;
-    global_work_size[0] = width;
-    global_work_size[1] = height;
+    /* x is the row of the pixel, y its column */
+    global_size(global_work_size, height, width);
 
     // 1. Passer les arguments au noyau avec clSetKernelArg(). Si des
     // arguments sont passees par un tampon, copier les valeurs avec
     // clEnqueueWriteBuffer() de maniere synchrone.
-    ERR_THROW(CL_SUCCESS, clSetKernelArg(kernel, 0, sizeof(cl_mem), &output), "clSetKernelArg : passing output failed");
     ERR_THROW(CL_SUCCESS, clSetKernelArg(kernel, 1, sizeof(kernel_args), &args), "clSetKernelArg : passing kernel arguments failed");
-
-    // 2. Appeller le noyau avec clEnqueueNDRangeKernel(). L'argument
-    // work_dim de clEnqueueNDRangeKernel() est un tableau size_t
-    // avec les dimensions width et height.
-    ERR_THROW(CL_SUCCESS, clEnqueueNDRangeKernel(queue, kernel, 2, 0, global_work_size, NULL, 0, NULL, NULL), "clEnqueueNDRangeKernel failed");
-
-    // 3. Attendre que le noyau termine avec clFinish()
-    ERR_THROW(CL_SUCCESS, clFinish(queue), "clFinish failed");
-
-    // 4. Copier le resultat dans la structure sinoscope_t avec clEnqueueReadBuffer() de maniere synchrone
-    ERR_THROW(CL_SUCCESS, clEnqueueReadBuffer(queue, output, CL_TRUE, 0, size, ptr->buf, 0 , NULL, NULL), "clEnqueueReadBuffer failed");
+    ERR_THROW(0, upload_lut(ptr), "upload_lut failed");
+    ERR_THROW(CL_SUCCESS, clSetKernelArg(kernel, 2, sizeof(cl_mem), &lut), "clSetKernelArg : passing color table failed");
+
+    // 2. Appeller le noyau et recuperer l'image selon le mode
+    switch (mode) {
+    case OPENCL_MODE_ZERO_COPY:
+        ret = run_zero_copy(ptr, global_work_size, size);
+        break;
+    case OPENCL_MODE_BANDS:
+        ret = run_bands(ptr, global_work_size);
+        break;
+    default:
+        ret = run_read(ptr, global_work_size, size);
+        break;
+    }
+    ERR_THROW(0, ret, "kernel run failed");
 
 done:
     return ret;
@@ -12,7 +12,21 @@
 extern "C" {
 #endif
 
+enum opencl_mode {
+	/* zero copy on unified memory, bands otherwise */
+	OPENCL_MODE_AUTO,
+	/* kernel, then blocking read */
+	OPENCL_MODE_READ,
+	/* the image buffer is the device buffer, mapped after the kernel */
+	OPENCL_MODE_ZERO_COPY,
+	/* bands, the read of a band overlaps the kernel of the next one */
+	OPENCL_MODE_BANDS,
+};
+
 int sinoscope_image_opencl(sinoscope_t *ptr);
+void opencl_set_mode(enum opencl_mode mode);
+void opencl_set_fast_math(int fast_math);
+void opencl_release_host(unsigned char *host);
 int opencl_init(int width, int height);
 void opencl_shutdown();
 
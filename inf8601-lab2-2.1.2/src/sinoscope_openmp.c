@@ -11,6 +11,7 @@
 
 #include "sinoscope.h"
 #include "color.h"
+#include "harmonic.h"
 #include "util.h"
 
 int sinoscope_image_openmp(sinoscope_t *ptr) {
@@ -25,8 +26,9 @@ int sinoscope_image_openmp(sinoscope_t *ptr) {
 	int x, y, index, taylor;
 	struct rgb c;
 	float val, px, py;
+	float st = sinf(b.time), ct = cosf(b.time);
 
-	#pragma omp parallel for private(x, y, c, val, px, py, taylor, index) shared(b)
+	#pragma omp parallel for private(x, y, c, val, px, py, taylor, index) shared(b, st, ct)
 	for (x = 1; x < b.height - 1; ++x)
 	{
 		for (y = 1; y < b.width - 1; ++y)
@@ -35,14 +37,21 @@ int sinoscope_image_openmp(sinoscope_t *ptr) {
 			px = b.dx * y - 2 * M_PI;
 			py = b.dy * x - 2 * M_PI;
 
-			for (taylor = 1; taylor <= b.taylor; taylor += 2)
+			if (b.recurrence)
 			{
-				val += sin(px * taylor * b.phase1 + b.time) / taylor + cos(py * taylor * b.phase0) / taylor;
+				val = harmonic_sum(&b, px, py, st, ct);
+			}
+			else
+			{
+				for (taylor = 1; taylor <= b.taylor; taylor += 2)
+				{
+					val += sin(px * taylor * b.phase1 + b.time) / taylor + cos(py * taylor * b.phase0) / taylor;
+				}
 			}
 
 			val = (atan(1.0 * val) - atan(-1.0 * val)) / (M_PI);
 			val = (val + 1) * 100;
-			value_color(&c, val, b.interval, b.interval_inv);
+			lut_color(&c, b.lut, b.lut_size, val, b.interval, b.interval_inv);
 
 			index = (y * 3) + (x * 3) * b.width;
 			b.buf[index + 0] = c.r;
@@ -0,0 +1,87 @@
+/*
+ * sinoscope_separable.c
+ *
+ * The sinus term of the sum only depends on the column and the cosinus
+ * term only on the row. Both sums are computed once per frame, then each
+ * pixel adds its column and its row before the color mapping.
+ *
+ *  Created on: 2026-10-19
+ *      Author: francis
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "sinoscope.h"
+#include "sinoscope_separable.h"
+#include "color.h"
+#include "memory.h"
+#include "util.h"
+
+int sinoscope_image_separable(sinoscope_t *ptr)
+{
+	if (ptr == NULL)
+		return -1;
+
+	sinoscope_t b = *ptr;
+	int x, y, index, taylor;
+	struct rgb c;
+	float val, px, py;
+	float *cols = NULL, *rows = NULL;
+	int ret = 0;
+
+	if (ALLOC_N(cols, b.width) < 0 || ALLOC_N(rows, b.height) < 0)
+		goto error;
+
+	#pragma omp parallel private(x, y, c, val, px, py, taylor, index) shared(b, cols, rows)
+	{
+		/* 1. Somme des sinus de chaque colonne */
+		#pragma omp for nowait
+		for (y = 1; y < b.width - 1; ++y)
+		{
+			val = 0.0f;
+			px = b.dx * y - 2 * M_PI;
+			for (taylor = 1; taylor <= b.taylor; taylor += 2)
+				val += sin(px * taylor * b.phase1 + b.time) / taylor;
+			cols[y] = val;
+		}
+
+		/* 2. Somme des cosinus de chaque rangee */
+		#pragma omp for
+		for (x = 1; x < b.height - 1; ++x)
+		{
+			val = 0.0f;
+			py = b.dy * x - 2 * M_PI;
+			for (taylor = 1; taylor <= b.taylor; taylor += 2)
+				val += cos(py * taylor * b.phase0) / taylor;
+			rows[x] = val;
+		}
+
+		/* 3. Couleur de chaque pixel */
+		#pragma omp for
+		for (x = 1; x < b.height - 1; ++x)
+		{
+			for (y = 1; y < b.width - 1; ++y)
+			{
+				val = cols[y] + rows[x];
+				val = (atan(1.0 * val) - atan(-1.0 * val)) / (M_PI);
+				val = (val + 1) * 100;
+				lut_color(&c, b.lut, b.lut_size, val, b.interval, b.interval_inv);
+
+				index = (y * 3) + (x * 3) * b.width;
+				b.buf[index + 0] = c.r;
+				b.buf[index + 1] = c.g;
+				b.buf[index + 2] = c.b;
+			}
+		}
+	}
+
+done:
+	FREE(cols);
+	FREE(rows);
+	return ret;
+error:
+	ret = -1;
+	goto done;
+}
@@ -0,0 +1,15 @@
+/*
+ * sinoscope_separable.h
+ *
+ *  Created on: 2026-10-19
+ *      Author: francis
+ */
+
+#ifndef SINOSCOPE_SEPARABLE_H_
+#define SINOSCOPE_SEPARABLE_H_
+
+#include "sinoscope.h"
+
+int sinoscope_image_separable(sinoscope_t *b_ptr);
+
+#endif /* SINOSCOPE_SEPARABLE_H_ */
@@ -10,6 +10,7 @@
 #include <math.h>
 
 #include "color.h"
+#include "harmonic.h"
 #include "sinoscope_serial.h"
 
 int sinoscope_image_serial(sinoscope_t *ptr)
@@ -21,6 +22,7 @@ int sinoscope_image_serial(sinoscope_t *ptr)
     int x, y, index, taylor;
     struct rgb c;
     float val, px, py;
+    float st = sinf(b.time), ct = cosf(b.time);
 
     x = 1;
     while(1) {
@@ -28,23 +30,27 @@ int sinoscope_image_serial(sinoscope_t *ptr)
         while(1) {
             px = b.dx * y - 2 * M_PI;
             py = b.dy * x - 2 * M_PI;
-            val = 0.0f;
-            for (taylor = 1; taylor <= b.taylor; taylor += 2) {
-                val += sin(px * taylor * b.phase1 + b.time) / taylor + cos(py * taylor * b.phase0) / taylor;
+            if (b.recurrence) {
+                val = harmonic_sum(&b, px, py, st, ct);
+            } else {
+                val = 0.0f;
+                for (taylor = 1; taylor <= b.taylor; taylor += 2) {
+                    val += sin(px * taylor * b.phase1 + b.time) / taylor + cos(py * taylor * b.phase0) / taylor;
+                }
             }
             val = (atan(1.0 * val) - atan(-1.0 * val)) / (M_PI);
             val = (val + 1) * 100;
-            value_color(&c, val, b.interval, b.interval_inv);
+            lut_color(&c, b.lut, b.lut_size, val, b.interval, b.interval_inv);
             index = (y * 3) + (x * 3) * b.width;
             b.buf[index + 0] = c.r;
             b.buf[index + 1] = c.g;
             b.buf[index + 2] = c.b;
             y++;
-            if (y >= b.height-1)
+            if (y >= b.width-1)
                 break;
         }
         x++;
-        if (x >= b.width-1)
+        if (x >= b.height-1)
             break;
     }
     return 0;
@@ -0,0 +1,16 @@
+/*
+ * sinoscope_simd.h
+ *
+ *  Created on: 2026-10-19
+ *      Author: francis
+ */
+
+#ifndef SINOSCOPE_SIMD_H_
+#define SINOSCOPE_SIMD_H_
+
+#include "sinoscope.h"
+
+int sinoscope_image_simd(sinoscope_t *b_ptr);
+const char *sinoscope_simd_isa(void);
+
+#endif /* SINOSCOPE_SIMD_H_ */
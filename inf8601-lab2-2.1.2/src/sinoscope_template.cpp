@@ -0,0 +1,136 @@
+/*
+ * sinoscope_template.cpp
+ *
+ * Kernels specialized at compile time on the number of terms and on the
+ * precision. The sum of the harmonics is unrolled by the Harmonics
+ * template, each divisor is a constant. The odd counts 1 to 15 have
+ * their own kernel, the other counts use the generic loop.
+ *
+ *  Created on: 2026-10-19
+ *      Author: francis
+ */
+
+#include <cmath>
+
+extern "C" {
+#include <stdlib.h>
+#include <stdio.h>
+#include "sinoscope.h"
+#include "color.h"
+}
+
+#include "sinoscope_template.h"
+
+#define TEMPLATE_MAX_TAYLOR 15
+
+template <typename T>
+struct Frame {
+	T phase0;
+	T phase1;
+	T time;
+};
+
+/* sum of the terms 1, 3, ..., K, in the order of the serial loop */
+template <typename T, int K>
+struct Harmonics {
+	static inline T sum(T px, T py, const Frame<T>& f) {
+		return Harmonics<T, K - 2>::sum(px, py, f) +
+				(std::sin(px * T(K) * f.phase1 + f.time) +
+				std::cos(py * T(K) * f.phase0)) * (T(1) / T(K));
+	}
+};
+
+template <typename T>
+struct Harmonics<T, -1> {
+	static inline T sum(T, T, const Frame<T>&) {
+		return T(0);
+	}
+};
+
+template <typename T>
+static inline T generic_sum(T px, T py, const Frame<T>& f, int taylor)
+{
+	T val = T(0);
+	for (int t = 1; t <= taylor; t += 2)
+		val += (std::sin(px * T(t) * f.phase1 + f.time) +
+				std::cos(py * T(t) * f.phase0)) / T(t);
+	return val;
+}
+
+/* K == 0 is the generic loop */
+template <typename T, int K>
+struct Sum {
+	static inline T eval(T px, T py, const Frame<T>& f, int) {
+		return Harmonics<T, K>::sum(px, py, f);
+	}
+};
+
+template <typename T>
+struct Sum<T, 0> {
+	static inline T eval(T px, T py, const Frame<T>& f, int taylor) {
+		return generic_sum(px, py, f, taylor);
+	}
+};
+
+template <typename T, int K>
+static int sinoscope_rows(sinoscope_t *ptr)
+{
+	const sinoscope_t b = *ptr;
+	const Frame<T> f = { b.phase0, b.phase1, b.time };
+	const T two_pi = T(2 * M_PI);
+	int x;
+
+	#pragma omp parallel for schedule(static)
+	for (x = 1; x < b.height - 1; ++x)
+	{
+		T py = T(b.dy) * x - two_pi;
+		for (int y = 1; y < b.width - 1; ++y)
+		{
+			struct rgb c;
+			T px = T(b.dx) * y - two_pi;
+			T val = Sum<T, K>::eval(px, py, f, b.taylor);
+			val = (std::atan(val) - std::atan(-val)) / T(M_PI);
+			val = (val + 1) * 100;
+			lut_color(&c, b.lut, b.lut_size, val, b.interval, b.interval_inv);
+
+			int index = (y * 3) + (x * 3) * b.width;
+			b.buf[index + 0] = c.r;
+			b.buf[index + 1] = c.g;
+			b.buf[index + 2] = c.b;
+		}
+	}
+	return 0;
+}
+
+typedef int (*template_kernel)(sinoscope_t *);
+
+/* kernels of the odd counts 1 to 15, indexed by count / 2 */
+template <typename T>
+struct Kernels {
+	static const template_kernel unrolled[TEMPLATE_MAX_TAYLOR / 2 + 1];
+};
+
+template <typename T>
+const template_kernel Kernels<T>::unrolled[TEMPLATE_MAX_TAYLOR / 2 + 1] = {
+	sinoscope_rows<T, 1>, sinoscope_rows<T, 3>, sinoscope_rows<T, 5>,
+	sinoscope_rows<T, 7>, sinoscope_rows<T, 9>, sinoscope_rows<T, 11>,
+	sinoscope_rows<T, 13>, sinoscope_rows<T, 15>,
+};
+
+template <typename T>
+static template_kernel lookup_kernel(int taylor)
+{
+	/* an even count has the terms of the odd count below */
+	if (taylor >= 1 && taylor <= TEMPLATE_MAX_TAYLOR)
+		return Kernels<T>::unrolled[(taylor - 1) / 2];
+	return sinoscope_rows<T, 0>;
+}
+
+int sinoscope_image_template(sinoscope_t *ptr)
+{
+	if (ptr == NULL)
+		return -1;
+	if (ptr->precision == PRECISION_DOUBLE)
+		return lookup_kernel<double>(ptr->taylor)(ptr);
+	return lookup_kernel<float>(ptr->taylor)(ptr);
+}
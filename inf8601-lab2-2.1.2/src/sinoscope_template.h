@@ -0,0 +1,21 @@
+/*
+ * sinoscope_template.h
+ *
+ *  Created on: 2026-10-19
+ *      Author: francis
+ */
+
+#ifndef SINOSCOPE_TEMPLATE_H_
+#define SINOSCOPE_TEMPLATE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int sinoscope_image_template(sinoscope_t *ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SINOSCOPE_TEMPLATE_H_ */
@@ -0,0 +1,135 @@
+/*
+ * video.c
+ *
+ * Frames of the sinoscope written as a stream, either YUV4MPEG2 4:4:4 or
+ * raw rgb24 without header. A frame goes out with a single writev() of
+ * its header and its planes.
+ *
+ *  Created on: 2026-10-19
+ *      Author: francis
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "sinoscope.h"
+#include "video.h"
+#include "memory.h"
+
+#define Y4M_FRAME "FRAME\n"
+
+struct video {
+	int fd;
+	enum video_format format;
+	int width;
+	int height;
+	/* Y, U and V planes of the frame being written */
+	unsigned char *yuv;
+};
+
+/*
+ * writev() until everything is written, the iovecs are consumed
+ */
+static int write_iov(int fd, struct iovec *iov, int cnt)
+{
+	ssize_t n;
+
+	while (cnt > 0) {
+		n = writev(fd, iov, cnt);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("video write failed");
+			return -1;
+		}
+		while (cnt > 0 && (size_t) n >= iov->iov_len) {
+			n -= iov->iov_len;
+			iov++;
+			cnt--;
+		}
+		if (cnt > 0) {
+			iov->iov_base = (char *) iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	}
+	return 0;
+}
+
+struct video *make_video(int fd, enum video_format format, int width, int height, int fps)
+{
+	struct video *v = NULL;
+	struct iovec iov;
+	char header[128];
+
+	if (ALLOC(v) < 0)
+		goto err;
+	v->fd = fd;
+	v->format = format;
+	v->width = width;
+	v->height = height;
+	if (format != VIDEO_Y4M)
+		return v;
+
+	if (ALLOC_N(v->yuv, width * height * 3) < 0)
+		goto err;
+	iov.iov_base = header;
+	iov.iov_len = snprintf(header, sizeof(header),
+			"YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", width, height, fps);
+	if (write_iov(fd, &iov, 1) < 0)
+		goto err;
+	return v;
+err:
+	free_video(v);
+	return NULL;
+}
+
+void free_video(struct video *v)
+{
+	if (v == NULL)
+		return;
+	FREE(v->yuv);
+	FREE(v);
+}
+
+/*
+ * rgb to studio range BT.601
+ */
+static void rgb_to_yuv444(const unsigned char *rgb, unsigned char *yuv, int pixels)
+{
+	unsigned char *y = yuv, *u = yuv + pixels, *v = yuv + 2 * pixels;
+	int i, r, g, b;
+
+	for (i = 0; i < pixels; i++) {
+		r = rgb[i * 3 + 0];
+		g = rgb[i * 3 + 1];
+		b = rgb[i * 3 + 2];
+		y[i] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+		u[i] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+		v[i] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+	}
+}
+
+int video_write_frame(struct video *v, sinoscope_t *frame)
+{
+	struct iovec iov[2];
+	int pixels = v->width * v->height;
+
+	if (frame->width != v->width || frame->height != v->height)
+		return -1;
+	if (v->format == VIDEO_RGB) {
+		iov[0].iov_base = frame->buf;
+		iov[0].iov_len = pixels * 3;
+		return write_iov(v->fd, iov, 1);
+	}
+	rgb_to_yuv444(frame->buf, v->yuv, pixels);
+	iov[0].iov_base = Y4M_FRAME;
+	iov[0].iov_len = strlen(Y4M_FRAME);
+	iov[1].iov_base = v->yuv;
+	iov[1].iov_len = pixels * 3;
+	return write_iov(v->fd, iov, 2);
+}
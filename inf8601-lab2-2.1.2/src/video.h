@@ -0,0 +1,24 @@
+/*
+ * video.h
+ *
+ *  Created on: 2026-10-19
+ *      Author: francis
+ */
+
+#ifndef VIDEO_H_
+#define VIDEO_H_
+
+#include "sinoscope.h"
+
+enum video_format {
+	VIDEO_Y4M,
+	VIDEO_RGB,
+};
+
+struct video;
+
+struct video *make_video(int fd, enum video_format format, int width, int height, int fps);
+void free_video(struct video *v);
+int video_write_frame(struct video *v, sinoscope_t *frame);
+
+#endif /* VIDEO_H_ */
@@ -2,4 +2,5 @@
 
 ${abs_top_srcdir}/encode/encode --cmd check
 RET=$?
+${abs_top_builddir}/src/sinoscope --cmd check --width 256 --height 256 || RET=1
 exit $RET